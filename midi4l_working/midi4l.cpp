@@ -1,11 +1,12 @@
 #include <map>
+#include <atomic>
 #include "RtMidi.h"
 #include "maxcpp6.h"
 
 
 
 typedef std::map<t_symbol*,int> portmap;
-typedef std::vector<unsigned char> midimessage;
+typedef RtMidiMessage midimessage;
 
 const int MAX_STR_SIZE = 512;
 
@@ -13,16 +14,50 @@ const int OUTLET_MIDI     = 0;
 const int OUTLET_SYSEX    = 1;
 const int OUTLET_INPORTS  = 2;
 const int OUTLET_OUTPORTS = 3;
+const int OUTLET_STATS    = 4;
 
 const int SYSEX_START = 0xF0;
 const int SYSEX_STOP  = 0xF7;
 
+const long POLL_INTERVAL_MS = 1;            // how often queued input is drained
+const long ERROR_INTERVAL_MS = 250;         // how often input thread errors are reported
+const unsigned int QUEUE_GROW_MAX = 1 << 20; // default byte cap for (overflow grow)
+
 t_symbol *SYM_APPEND = gensym("append");
 t_symbol *SYM_CLEAR  = gensym("clear");
 t_symbol *SYM_SET    = gensym("set");
 t_symbol *SYM_NONE  = gensym("<none>");
+t_symbol *SYM_IN     = gensym("in");
+t_symbol *SYM_OUT    = gensym("out");
+t_symbol *SYM_RESET  = gensym("reset");
+t_symbol *SYM_OFF        = gensym("off");
+t_symbol *SYM_DROPNEWEST = gensym("dropnewest");
+t_symbol *SYM_DROPOLDEST = gensym("dropoldest");
+t_symbol *SYM_GROW       = gensym("grow");
+t_symbol *SYM_COALESCE   = gensym("coalesce");
+t_symbol *SYM_STOP       = gensym("stop");
+t_symbol *SYM_REPLAY     = gensym("replay");
+t_symbol *SYM_THRU       = gensym("thru");
+t_symbol *SYM_MONITOR    = gensym("monitor");
+t_symbol *SYM_CHANNEL    = gensym("channel");
+t_symbol *SYM_TRANSPOSE  = gensym("transpose");
+t_symbol *SYM_SPLIT      = gensym("split");
+t_symbol *SYM_NOTE       = gensym("note");
+t_symbol *SYM_VELOCITY   = gensym("velocity");
+t_symbol *SYM_CC         = gensym("cc");
+t_symbol *SYM_CC14       = gensym("cc14");
+t_symbol *SYM_RPN        = gensym("rpn");
+t_symbol *SYM_NRPN       = gensym("nrpn");
 
-void midiInputCallback(double deltatime, midimessage *message, void *userData);
+void midiInputCallback(double deltatime, const unsigned char *message, size_t size, unsigned int portTag, void *userData);
+void midiUmpCallback(double deltatime, const uint32_t *words, unsigned int count, unsigned int portTag, void *userData);
+void midiOverflowCallback(RtMidiIn::OverflowPolicy action, const unsigned char *message, size_t size, void *userData);
+bool midiQueueFilter(double timeStamp, unsigned char *message, size_t size, void *userData);
+void midiReplayCallback(double time, const unsigned char *message, size_t size, void *userData);
+void midiReplayOutCallback(double time, const unsigned char *message, size_t size, void *userData);
+void midiErrorCallback(RtMidiError::Type type, const std::string &errorText);
+void pollInputTick(void *x);
+void reportErrorsTick(void *x);
 
 
 static inline std::string &trim(std::string &s)
@@ -61,12 +96,40 @@ public:
         inPortName(NULL),
         outPortName(NULL),
         message(),
-        isSysEx(false)
+        isSysEx(false),
+        queuedInput(false),
+        overflowed(false),
+        pollMessage(),
+        umpMode(0),
+        umpInWords(64),
+        umpOutWords(64),
+        recorder(),
+        player(),
+        replayToOutput(false),
+        replayInPortName(NULL),
+        thruOutputs(),
+        thruMonitor(true),
+        inputTransform(),
+        transformActive(false),
+        assembler(),
+        sentNotes(),
+        replayNotes(),
+        thruNotes(),
+        noteOffs()
     {
-		setupIO(1, 4); // inlets / outlets
+		setupIO(1, 5); // inlets / outlets
+        pollClock = clock_new((t_object *)this, (method)pollInputTick);
+        errorClock = clock_new((t_object *)this, (method)reportErrorsTick);
         
         try {
             midiin = new RtMidiIn();
+            // Errors on the input thread are collected and reported by errorClock,
+            // other errors go to the Max console instead of being thrown.
+            midiin->enableErrorEvents(true);
+            midiin->setErrorCallback(&midiErrorCallback);
+            // Queued input is still transformed and sent thru on the input thread.
+            midiin->setQueueFilter(&midiQueueFilter, this);
+            clock_delay(errorClock, ERROR_INTERVAL_MS);
         }
         catch ( RtMidiError &error ) {
             printError("RtMidiIn constructor failure", error);
@@ -74,6 +137,7 @@ public:
         
         try {
             midiout = new RtMidiOut();
+            midiout->setErrorCallback(&midiErrorCallback);
         }
         catch ( RtMidiError &error ) {
             printError("RtMidiOut consturctor failure", error);
@@ -92,15 +156,22 @@ public:
 	}
 	
     ~MIDI4L() {
+        player.stop();
+        clock_unset(pollClock);
+        object_free(pollClock);
+        clock_unset(errorClock);
+        object_free(errorClock);
         if(midiin) {
             midiin->cancelCallback();
             midiin->closePort();
             delete midiin;
         }
         if(midiout) {
+            releaseNotes();
             midiout->closePort();
             delete midiout;
         }
+        closeThru();
     }
     
     
@@ -109,7 +180,7 @@ public:
      */
     void assist(void *b, long io, long index, char *msg) {
         if (io == ASSIST_INLET) {
-            strncpy_zero(msg, "(send list) send MIDI to output port, (bang) list ports, (input name) set input port, (output name) set output port", MAX_STR_SIZE);
+            strncpy_zero(msg, "(send list) send MIDI to output port, (sendump list) send UMP words, (bang) list ports, (input name) set input port, (output name) set output port, (ump 0/1/2) output MIDI as bytes or UMP lists, (record file) record input to a log, (tosmf log file) convert a log to a MIDI file, (replay in/out file speed) replay a log or MIDI file, (thru name ...) forward input to output ports, (thru monitor 0/1) also output forwarded input, (transform ...) remap input channels, notes, velocities and controllers, (nrpn 0/1/2) join parameter changes, (cc14 num 0/1/2) join 14-bit controllers, (panic) release the notes sent to the output and thru ports", MAX_STR_SIZE);
         }
         else if (io==ASSIST_OUTLET) {
             switch (index) {
@@ -125,6 +196,9 @@ public:
                 case OUTLET_OUTPORTS:
                     strncpy_zero(msg, "output port list", MAX_STR_SIZE);
                     break;
+                case OUTLET_STATS:
+                    strncpy_zero(msg, "port statistics", MAX_STR_SIZE);
+                    break;
             }
         }
     }
@@ -158,7 +232,14 @@ public:
             if (midiin) {
                 int portIndex = getPortIndex(inPortMap, portName);
                 
+                // Live input and a replay to the outlets must not both output input.
+                if(portIndex >= 0 && !replayToOutput) {
+                    player.stop();
+                    replayInPortName = NULL;
+                }
+                
                 if(portIndex >= 0 || portName == SYM_NONE) {
+                    clock_unset(pollClock);
                     midiin->cancelCallback();
                     midiin->closePort();
                     inPortName = NULL;
@@ -166,9 +247,16 @@ public:
                 
                 if(portIndex >= 0) {
                     midiin->openPort( portIndex );
-                    midiin->setCallback( &midiInputCallback, this );
+                    if(queuedInput) {
+                        clock_delay(pollClock, POLL_INTERVAL_MS);
+                    }
+                    else if(umpMode) {
+                        midiin->setCallback( &midiUmpCallback, this, 0, umpMode == 2 ? RtMidiUmp::MIDI2 : RtMidiUmp::MIDI1 );
+                    }
+                    else {
+                        midiin->setCallback( &midiInputCallback, this );
+                    }
                     midiin->ignoreTypes( false, true, true ); // ignore MIDI timing and active sensing messages (but not SysEx)
-                    // TODO? midiin->setErrorCallback()
                     inPortName = portName;
                 }
                 else if(portName != SYM_NONE) {
@@ -183,6 +271,443 @@ public:
     }
     
     
+    /**
+     * Set the scheduling of the MIDI input thread: (realtime <priority> [cpu]).
+     * A priority above 0 requests real-time (SCHED_FIFO) scheduling at that priority, 0 restores normal scheduling.
+     * The optional cpu pins the thread to that processor, -1 lets it run anywhere.
+     * Only the Linux (ALSA) backend runs its own input thread, elsewhere this is ignored.
+     * An open input port is reopened so the new setting takes effect right away.
+     */
+    void realtime(long inlet, t_symbol *s, long ac, t_atom *av) {
+        if(ac < 1) {
+            object_error((t_object *)this, "Invalid realtime. A priority is required (0 for normal scheduling), optionally followed by a cpu.");
+            return;
+        }
+        
+        long priority = atom_getlong(av);
+        long cpu = (ac > 1) ? atom_getlong(av+1) : -1;
+        
+        if (midiin) {
+            // The input thread picks up the setting when the port is reopened.
+            t_symbol *portName = closeInput();
+            midiin->setThreadScheduling( priority, cpu );
+            reopenInput(portName);
+        }
+    }
+    
+    
+    /**
+     * Choose how MIDI input is delivered when it arrives faster than the patch handles it: (overflow <policy> [maxbytes]).
+     * With (overflow off), the default, messages go straight from the MIDI input thread to the outlets.
+     * With a policy, RtMidi queues the messages and the Max scheduler outputs them every millisecond;
+     * the (thru) ports still get them straight from the MIDI input thread.
+     * The policy decides what happens when the queue is full: dropnewest discards incoming messages,
+     * dropoldest discards the oldest queued ones, grow enlarges the queue up to maxbytes (default 1 MB),
+     * and coalesce merges control changes for the same controller so that a busy controller leaves room for notes.
+     * Lost messages are reported in the Max console and counted by (stats).
+     * An open input port is reopened so the new setting takes effect right away.
+     */
+    void overflow(long inlet, t_symbol *s, long ac, t_atom *av) {
+        t_symbol *policyName = _sym_nothing;
+        RtMidiIn::OverflowPolicy policy = RtMidiIn::DROP_NEWEST;
+        
+        if( atom_arg_getsym(&policyName, 0, ac, av) != MAX_ERR_NONE ) {
+            object_error((t_object *)this, "Invalid overflow. A policy is required: off, dropnewest, dropoldest, grow or coalesce.");
+            return;
+        }
+        
+        if(policyName == SYM_DROPOLDEST) policy = RtMidiIn::DROP_OLDEST;
+        else if(policyName == SYM_GROW) policy = RtMidiIn::GROW;
+        else if(policyName == SYM_COALESCE) policy = RtMidiIn::COALESCE_CC;
+        else if(policyName != SYM_OFF && policyName != SYM_DROPNEWEST) {
+            object_error((t_object *)this, "Unknown overflow policy: %s", policyName->s_name);
+            return;
+        }
+        
+        long maxBytes = (ac > 1) ? atom_getlong(av+1) : QUEUE_GROW_MAX;
+        
+        if (midiin) {
+            // Close the port while the queue is reconfigured, then reopen it.
+            t_symbol *portName = closeInput();
+            queuedInput = (policyName != SYM_OFF);
+            midiin->setOverflowPolicy(policy, maxBytes > 0 ? (unsigned int)maxBytes : 0, &midiOverflowCallback, this);
+            reopenInput(portName);
+        }
+    }
+    
+    
+    /**
+     * Choose the form of MIDI input at the outlets: (ump 0), the default, outputs MIDI bytes one at a time.
+     * (ump 1) outputs each message as a list of Universal MIDI Packet words, with channel messages in the MIDI 1.0 protocol,
+     * and (ump 2) gives channel messages in the MIDI 2.0 protocol, with 16-bit velocities and 32-bit controller values.
+     * Sysex is output on the SysEx outlet as one list per packet of up to six bytes.
+     * Words are 32-bit values and may show up as negative ints in Max.
+     */
+    void ump(long inlet, t_symbol *s, long ac, t_atom *av) {
+        long mode = (ac > 0) ? atom_getlong(av) : 0;
+        
+        if(mode < 0 || mode > 2) {
+            object_error((t_object *)this, "Invalid ump. Use 0 for MIDI bytes, 1 for MIDI 1.0 packets or 2 for MIDI 2.0 packets.");
+            return;
+        }
+        
+        if (midiin) {
+            // The callback is chosen when the port is opened.
+            t_symbol *portName = closeInput();
+            umpMode = (int)mode;
+            reopenInput(portName);
+        }
+    }
+    
+    
+    /**
+     * Send Universal MIDI Packet words to the output port: (sendump <word> ...).
+     * The packets are translated to MIDI 1.0 messages, so MIDI 2.0 values are scaled down.
+     * Sysex packets are gathered until the last packet of the message arrives.
+     */
+    void sendump(long inlet, t_symbol *s, long ac, t_atom *av) {
+        if(ac <= 0 || !midiout || !midiout->isPortOpen()) return;
+        
+        if(umpOutWords.size() < (size_t)ac) umpOutWords.resize(ac);
+        for(long i=0; i<ac; i++) {
+            umpOutWords[i] = (uint32_t)atom_getlong(av+i);
+        }
+        midiout->sendUmp(&umpOutWords[0], (unsigned int)ac);
+        
+        // Follow the notes as the port gets them, in MIDI 1.0.
+        for(long i=0; i<ac; ) {
+            unsigned int type = umpOutWords[i] >> 28;
+            unsigned int size = RtMidiUmp::wordCount(umpOutWords[i]);
+            if(i + (long)size > ac) break;
+            if(type == RtMidiUmp::MIDI1_CHANNEL || type == RtMidiUmp::MIDI2_CHANNEL) {
+                unsigned char bytes[RtMidiUmp::maxBytes];
+                sentNotes.track(bytes, RtMidiUmp::toBytes(&umpOutWords[i], bytes));
+            }
+            i += size;
+        }
+    }
+    
+    
+    /**
+     * Record everything the input port delivers to a log file: (record <file>), and (record stop) or (record) to stop.
+     * The messages are copied on the MIDI input thread and written to disk by a background thread, so recording
+     * does not slow down the input or the patch. Recording continues when the input port changes.
+     * The log keeps the time of each message and can be converted to a MIDI file with (tosmf).
+     * The number of messages recorded and lost is reported by (stats).
+     */
+    void record(long inlet, t_symbol *s, long ac, t_atom *av) {
+        t_symbol *fileName = _sym_nothing;
+        char path[MAX_PATH_CHARS];
+        
+        if (!midiin) return;
+        
+        if(recorder.isOpen()) {
+            midiin->setRecorder(NULL);
+            try {
+                recorder.close();
+            }
+            catch ( RtMidiError &error ) {
+                printError("Error closing the MIDI log", error);
+            }
+        }
+        
+        if( atom_arg_getsym(&fileName, 0, ac, av) != MAX_ERR_NONE || fileName == SYM_STOP ) {
+            return;
+        }
+        
+        path_nameconform(fileName->s_name, path, PATH_STYLE_NATIVE, PATH_TYPE_BOOT);
+        try {
+            recorder.open(path);
+            midiin->setRecorder(&recorder);
+        }
+        catch ( RtMidiError &error ) {
+            printError("Error opening the MIDI log", error);
+        }
+    }
+    
+    
+    /**
+     * Convert a log written by (record) to a Standard MIDI File: (tosmf <log file> <MIDI file>).
+     * The MIDI file has a single track with a resolution of 100 microseconds.
+     */
+    void tosmf(long inlet, t_symbol *s, long ac, t_atom *av) {
+        t_symbol *logName = _sym_nothing;
+        t_symbol *smfName = _sym_nothing;
+        char logPath[MAX_PATH_CHARS];
+        char smfPath[MAX_PATH_CHARS];
+        
+        if( atom_arg_getsym(&logName, 0, ac, av) != MAX_ERR_NONE || atom_arg_getsym(&smfName, 1, ac, av) != MAX_ERR_NONE ) {
+            object_error((t_object *)this, "Invalid tosmf. A log file and a MIDI file are required.");
+            return;
+        }
+        
+        path_nameconform(logName->s_name, logPath, PATH_STYLE_NATIVE, PATH_TYPE_BOOT);
+        path_nameconform(smfName->s_name, smfPath, PATH_STYLE_NATIVE, PATH_TYPE_BOOT);
+        try {
+            RtMidiLog log;
+            log.open(logPath);
+            log.writeSmf(smfPath);
+            object_post((t_object *)this, "%lld messages written to %s", (long long)log.getMessageCount(), smfName->s_name);
+        }
+        catch ( RtMidiError &error ) {
+            printError("Error converting the MIDI log", error);
+        }
+    }
+    
+    
+    /**
+     * Replay a log written by (record) or a MIDI file: (replay <in|out> <file> [speed]), and (replay stop).
+     * With in, the messages come out of the outlets as if they had been received on the input port.
+     * The input port is closed meanwhile, so that only the player outputs input, and is reopened by
+     * the next (replay) message, including (replay stop). Opening an input port stops such a replay.
+     * With out, the messages are sent to the output port.
+     * A speed of 1, the default, replays in real time, 2 twice as fast and so on, and 0 as fast as possible.
+     * The messages are sent from a timer thread with their original timing, which makes replays
+     * reproducible load tests. The number of messages replayed is reported by (stats).
+     */
+    void replay(long inlet, t_symbol *s, long ac, t_atom *av) {
+        t_symbol *target = _sym_nothing;
+        t_symbol *fileName = _sym_nothing;
+        char path[MAX_PATH_CHARS];
+        
+        player.stop();
+        reopenAfterReplay();
+        
+        if( atom_arg_getsym(&target, 0, ac, av) != MAX_ERR_NONE || target == SYM_STOP ) {
+            return;
+        }
+        if( (target != SYM_IN && target != SYM_OUT) || atom_arg_getsym(&fileName, 1, ac, av) != MAX_ERR_NONE ) {
+            object_error((t_object *)this, "Invalid replay. Use (replay in <file> [speed]), (replay out <file> [speed]) or (replay stop).");
+            return;
+        }
+        
+        double speed = (ac > 2) ? atom_getfloat(av+2) : 1.0;
+        RtMidiPlayer::Mode mode = RtMidiPlayer::REAL_TIME;
+        if(speed <= 0.0) mode = RtMidiPlayer::AS_FAST_AS_POSSIBLE;
+        else if(speed != 1.0) mode = RtMidiPlayer::SCALED;
+        
+        replayToOutput = (target == SYM_OUT);
+        if(replayToOutput && (!midiout || !midiout->isPortOpen())) {
+            object_error((t_object *)this, "Cannot replay to the output, no output port is open.");
+            return;
+        }
+        
+        path_nameconform(fileName->s_name, path, PATH_STYLE_NATIVE, PATH_TYPE_BOOT);
+        try {
+            // The player thread takes the place of the input thread.
+            if(!replayToOutput) replayInPortName = closeInput();
+            player.open(path);
+            player.setOutput(replayToOutput ? midiout : NULL);
+            player.setCallback(replayToOutput ? &midiReplayOutCallback : &midiReplayCallback, this);
+            player.start(mode, speed);
+        }
+        catch ( RtMidiError &error ) {
+            printError("Error replaying the MIDI file", error);
+            player.stop();
+            reopenAfterReplay();
+        }
+    }
+    
+    
+    /**
+     * Forward the input port straight to one or more output ports: (thru <portname> ...), and (thru) or (thru <none>) to stop.
+     * Messages are sent from the MIDI input thread as soon as they arrive, without going through the Max scheduler
+     * even when an (overflow) policy queues them for the outlets,
+     * which makes this the lowest-latency path from a keyboard to a synth. The thru ports are opened separately
+     * from the (output) port, which may also be one of them. With (thru monitor 1), the default, the forwarded
+     * messages still come out of the outlets; (thru monitor 0) leaves the patch out entirely.
+     * The input port is briefly closed while the thru ports change.
+     */
+    void thru(long inlet, t_symbol *s, long ac, t_atom *av) {
+        if(ac > 0 && atom_getsym(av) == SYM_MONITOR) {
+            thruMonitor.store(ac > 1 && atom_getlong(av+1) != 0);
+            return;
+        }
+        
+        // The input thread must not forward while the list changes.
+        t_symbol *portName = closeInput();
+        closeThru();
+        
+        for(long i=0; i<ac; i++) {
+            t_symbol *thruName = atom_getsym(av+i);
+            if(thruName == SYM_NONE) continue;
+            
+            int portIndex = getPortIndex(outPortMap, thruName);
+            if(portIndex < 0) {
+                object_error((t_object *)this, "Thru port not found: %s", thruName->s_name);
+                continue;
+            }
+            
+            RtMidiOut *thruOutput = NULL;
+            try {
+                thruOutput = new RtMidiOut();
+                thruOutput->openPort(portIndex);
+                thruOutput->setErrorCallback(&midiErrorCallback);
+                thruOutputs.push_back(thruOutput);
+            }
+            catch ( RtMidiError &error ) {
+                printError("Error opening the MIDI thru port", error);
+                delete thruOutput;
+            }
+        }
+        
+        reopenInput(portName);
+    }
+    
+    
+    /**
+     * Remap the input before it reaches the outlets and the thru ports. Channels are numbered from 1 to 16:
+     *   (transform channel <in> <out>) moves a channel, or drops it when out is 0. This resets the notes of the channel.
+     *   (transform transpose <channel> <semitones>) transposes all notes of a channel.
+     *   (transform split <channel> <low> <high> <out> [semitones]) sends a range of notes to another channel.
+     *   (transform note <channel> <note> <out channel> <out note>) maps a single note, or drops it when out channel is 0.
+     *   (transform velocity <exponent> [min] [max]) sets a note on velocity curve, 1 being linear.
+     *   (transform cc <in> <out>) renumbers a controller on all channels, or drops it when out is -1.
+     *   (transform reset) turns all of it off.
+     * The settings are compiled into lookup tables, so each message takes the same few steps on the MIDI input
+     * thread however many are in use. Changes take effect right away; a note held while its mapping changes
+     * may not get its note off.
+     */
+    void transform(long inlet, t_symbol *s, long ac, t_atom *av) {
+        t_symbol *command = (ac > 0) ? atom_getsym(av) : _sym_nothing;
+        long a[5] = { 0, 0, 0, 0, 0 };
+        for(long i=1; i<ac && i<=5; i++) {
+            a[i-1] = atom_getlong(av+i);
+        }
+        
+        try {
+            if(command == SYM_RESET) {
+                transformActive.store(false);
+                inputTransform.reset();
+                inputTransform.commit();
+                return;
+            }
+            else if(command == SYM_CHANNEL && ac >= 3) {
+                inputTransform.setChannel(a[0] - 1, a[1] - 1);
+            }
+            else if(command == SYM_TRANSPOSE && ac >= 3) {
+                inputTransform.setTranspose(a[0] - 1, a[1]);
+            }
+            else if(command == SYM_SPLIT && ac >= 5) {
+                inputTransform.setSplit(a[0] - 1, a[1], a[2], a[3] - 1, a[4]);
+            }
+            else if(command == SYM_NOTE && ac >= 5) {
+                inputTransform.setNote(a[0] - 1, a[1], a[2] - 1, a[3]);
+            }
+            else if(command == SYM_VELOCITY && ac >= 2) {
+                inputTransform.setVelocityCurve(atom_getfloat(av+1), (ac > 2) ? a[1] : 1, (ac > 3) ? a[2] : 127);
+            }
+            else if(command == SYM_CC && ac >= 3) {
+                inputTransform.setControl(a[0], a[1]);
+            }
+            else {
+                object_error((t_object *)this, "Invalid transform. Use channel, transpose, split, note, velocity, cc or reset with their arguments.");
+                return;
+            }
+            inputTransform.commit();
+            transformActive.store(true);
+        }
+        catch ( RtMidiError &error ) {
+            printError("Invalid transform", error);
+        }
+    }
+    
+    
+    /**
+     * Join registered and non-registered parameter changes (controllers 101/100 or 99/98, then 6 and 38) into
+     * single messages at the MIDI outlet: [rpn <channel> <parameter> <value>] and [nrpn <channel> <parameter> <value>],
+     * with 14-bit parameter numbers and values. (nrpn 1) outputs a value once its data entry LSB arrives,
+     * (nrpn 2) outputs it with the MSB, for devices that send no LSB, and again if an LSB follows. (nrpn 0) turns it off.
+     * The thru ports still get the original controllers, and so do the outlets in (ump 1) and (ump 2) modes.
+     */
+    void nrpn(long inlet, t_symbol *s, long ac, t_atom *av) {
+        long mode = (ac > 0) ? atom_getlong(av) : 1;
+        
+        if(mode == 0) assembler.setParameterMode(RtMidiControlAssembler::PARAMETERS_OFF);
+        else if(mode == 1) assembler.setParameterMode(RtMidiControlAssembler::PARAMETERS_FINE);
+        else if(mode == 2) assembler.setParameterMode(RtMidiControlAssembler::PARAMETERS_COARSE);
+        else object_error((t_object *)this, "Invalid nrpn. Use 0 to turn it off, 1 to wait for the data entry LSB or 2 to output on the MSB.");
+    }
+    
+    
+    /**
+     * Join a 14-bit controller, its MSB on controller 0-31 followed by its LSB 32 higher, into a single message at the
+     * MIDI outlet: [cc14 <channel> <controller> <value>]. (cc14 <controller>) or (cc14 <controller> 1) turns it on
+     * for that controller on all channels, outputting a value once its LSB arrives. (cc14 <controller> 2) outputs it
+     * with the MSB, LSB zero, for controllers that may move only their MSB, and again if an LSB follows.
+     * (cc14 <controller> 0) turns it off.
+     */
+    void cc14(long inlet, t_symbol *s, long ac, t_atom *av) {
+        long mode = (ac > 1) ? atom_getlong(av+1) : 1;
+        
+        if(ac < 1 || mode < 0 || mode > 2) {
+            object_error((t_object *)this, "Invalid cc14. A controller from 0 to 31 is required, optionally followed by 0 to turn it off, 1 to wait for the LSB or 2 to output on the MSB.");
+            return;
+        }
+        
+        try {
+            assembler.setCc14((unsigned int)atom_getlong(av), mode != 0, mode == 2);
+        }
+        catch ( RtMidiError &error ) {
+            printError("Invalid cc14", error);
+        }
+    }
+    
+    
+    /**
+     * Release the notes left on at the output port and the thru ports: (panic).
+     * A note off is sent for each note that was sent on and not off, and nothing else. The same happens
+     * automatically before the output port is switched or closed, and before the thru ports change.
+     * A replay to the output is stopped first, and the input port is briefly closed while the thru ports are released.
+     */
+    void panic(long inlet, t_symbol *s, long ac, t_atom *av) {
+        if(replayToOutput) player.stop();
+        releaseNotes();
+        
+        if(!thruOutputs.empty()) {
+            // The input thread must not forward while the thru notes are released.
+            t_symbol *portName = closeInput();
+            releaseThruNotes();
+            reopenInput(portName);
+        }
+    }
+    
+    
+    /**
+     * Dump the RtMidi counters of the input and output ports to the statistics (5th) outlet: (stats) or (stats reset).
+     * Each counter is sent as a message such as [in messages 1234] or [out queue_drops 0].
+     * The time spent in the input callback, which includes the patch triggered by the MIDI outlets, is sent
+     * as [in callback_us <calls under 1us> <calls 1-2us> <calls 2-4us> ...] with the last bin open-ended.
+     * With the reset argument the counters start again from zero after the dump.
+     */
+    void stats(long inlet, t_symbol *s, long ac, t_atom *av) {
+        RtMidiStats portStats;
+        bool reset = (ac > 0 && atom_getsym(av) == SYM_RESET);
+        
+        if (midiin) {
+            midiin->getStats(&portStats);
+            dumpStats(SYM_IN, portStats, true);
+            if(reset) midiin->resetStats();
+        }
+        if (midiout) {
+            midiout->getStats(&portStats);
+            dumpStats(SYM_OUT, portStats, false);
+            if(reset) midiout->resetStats();
+        }
+        unsigned long long thruMessages = 0, thruDrops = 0;
+        for(size_t i=0; i<thruOutputs.size(); i++) {
+            thruOutputs[i]->getStats(&portStats);
+            thruMessages += portStats.messages;
+            thruDrops += portStats.queueDrops;
+            if(reset) thruOutputs[i]->resetStats();
+        }
+        dumpStat(m_outlets[OUTLET_STATS], SYM_THRU, "messages", thruMessages);
+        dumpStat(m_outlets[OUTLET_STATS], SYM_THRU, "queue_drops", thruDrops);
+        dumpStat(m_outlets[OUTLET_STATS], SYM_REPLAY, "messages", player.getPlayedCount());
+        dumpStat(m_outlets[OUTLET_STATS], SYM_REPLAY, "late_max_us", (unsigned long long)(player.getMaxLateness() * 1000000.0));
+    }
+    
+    
     /**
      * Set the output port by name.
      * If the name is valid, this object will pass messages received to it's first inlet to the MIDI port.
@@ -201,13 +726,15 @@ public:
                 int portIndex = getPortIndex(outPortMap, portName);
                 
                 if(portIndex >= 0 || portName == SYM_NONE) {
+                    // The player must not send while the port changes.
+                    if(replayToOutput) player.stop();
+                    releaseNotes();
                     midiout->closePort();
                     outPortName = NULL;
                 }
                 
                 if(portIndex >= 0) {
                     midiout->openPort( portIndex );
-                    // TODO? midiout->setErrorCallback()
                     outPortName = portName;
                 }
                 else if(portName != SYM_NONE) {
@@ -222,13 +749,13 @@ public:
     }
  
 
-	bool is_valid_message(std::vector<unsigned char> *message)
+	bool is_valid_message(midimessage *message)
 	{
 		//post("is valid message...");
 		unsigned char l = message->size();
 		//post("size %ld", l);
 		if(l==2)
-		{	unsigned char i=message->front();
+		{	unsigned char i=(*message)[0];
 			//post("2, front is %ld", i);
 			if((192<=i)&&(i<224))
 			{
@@ -237,7 +764,7 @@ public:
 		}
 		else if(l==3)
 		{
-			unsigned char i=message->front();
+			unsigned char i=(*message)[0];
 			//post("3, front is %ld", i);
 			if((144<=i)&&(i<192))
 			{
@@ -270,6 +797,7 @@ public:
 			{
 				if(midiout && midiout->isPortOpen()) {
 					midiout->sendMessage( &message );
+					sentNotes.track( message.data(), message.size() );
 				}
 				message.clear();
 			}
@@ -285,6 +813,7 @@ public:
 			
 			if(midiout && midiout->isPortOpen()) {
 				midiout->sendMessage( &message );
+				sentNotes.track( message.data(), message.size() );
 				
 			}
 			message.clear();
@@ -305,6 +834,7 @@ public:
 			{
 				if(midiout && midiout->isPortOpen()) {
 					midiout->sendMessage( &message );
+					sentNotes.track( message.data(), message.size() );
 				}
 				message.clear();
 			}
@@ -312,20 +842,150 @@ public:
 		}
 	}
 			
+    /**
+     * Send a message received from midiin to the thru ports, then to the outlets unless monitoring is off.
+     * NOTE: This is an internal callback running on the MIDI input thread.
+     */
+    void forward(const unsigned char *message, size_t size) {
+        unsigned char bytes[3];
+        
+        // Only channel messages are transformed, and they fit in three bytes.
+        if(transformActive.load(std::memory_order_relaxed) && size <= 3) {
+            memcpy(bytes, message, size);
+            if(!inputTransform.apply(bytes, size)) return;
+            message = bytes;
+        }
+        
+        if(sendThru(message, size)) {
+            receive(message, size);
+        }
+    }
+    
+    
+    /**
+     * Transform a message about to be queued for pollInput() and send it to the thru ports,
+     * returning false if it is not for the outlets. The message is RtMidi's copy and is changed in place.
+     * NOTE: This is an internal callback running on the MIDI input thread.
+     */
+    bool filterQueued(unsigned char *message, size_t size) {
+        if(transformActive.load(std::memory_order_relaxed) && size <= 3 && !inputTransform.apply(message, size)) {
+            return false;
+        }
+        return sendThru(message, size);
+    }
+    
+    
+    /**
+     * Send a message to the thru ports, returning true if it should also reach the outlets.
+     * NOTE: This runs on the MIDI input thread.
+     */
+    bool sendThru(const unsigned char *message, size_t size) {
+        for(size_t i=0; i<thruOutputs.size(); i++) {
+            thruOutputs[i]->sendMessage(message, size);
+        }
+        if(!thruOutputs.empty()) thruNotes.track(message, size);
+        return thruOutputs.empty() || thruMonitor.load(std::memory_order_relaxed);
+    }
+    
+    
+    /**
+     * Send the Universal MIDI Packets of a message received from midiin to the thru ports, then to the outlets
+     * unless monitoring is off.
+     * NOTE: This is an internal callback running on the MIDI input thread.
+     */
+    void forwardUmp(const uint32_t *words, unsigned int count) {
+        uint32_t packet[2];
+        
+        if(transformActive.load(std::memory_order_relaxed) && count <= 2) {
+            memcpy(packet, words, count * sizeof(uint32_t));
+            if(!transformUmp(packet)) return;
+            words = packet;
+        }
+        
+        for(size_t i=0; i<thruOutputs.size(); i++) {
+            thruOutputs[i]->sendUmp(words, count);
+        }
+        if(!thruOutputs.empty()) {
+            unsigned int type = words[0] >> 28;
+            if(type == RtMidiUmp::MIDI1_CHANNEL || type == RtMidiUmp::MIDI2_CHANNEL) {
+                unsigned char bytes[RtMidiUmp::maxBytes];
+                thruNotes.track(bytes, RtMidiUmp::toBytes(words, bytes));
+            }
+        }
+        if(thruOutputs.empty() || thruMonitor.load(std::memory_order_relaxed)) {
+            receiveUmp(words, count);
+        }
+    }
+    
+    
+    /**
+     * Apply the transform to a channel voice packet in place, returning false if it is dropped.
+     * The status and the note or controller number sit in the same bits of the first word in both protocols,
+     * so only a MIDI 2.0 note on velocity is scaled to 7 bits for the lookup, and replaced only if it changed.
+     */
+    bool transformUmp(uint32_t *packet) {
+        unsigned int type = packet[0] >> 28;
+        if(type != RtMidiUmp::MIDI1_CHANNEL && type != RtMidiUmp::MIDI2_CHANNEL) return true;
+        
+        unsigned char bytes[3];
+        bytes[0] = (packet[0] >> 16) & 0xFF;
+        bytes[1] = (packet[0] >> 8) & 0x7F;
+        if(type == RtMidiUmp::MIDI1_CHANNEL) bytes[2] = packet[0] & 0x7F;
+        else bytes[2] = (unsigned char)RtMidiUmp::scaleDown(packet[1] >> 16, 16, 7);
+        if(bytes[0] < 0x80) return true; // MIDI 2.0 per-note and registered controllers are left alone
+        
+        unsigned char velocity = bytes[2];
+        if(!inputTransform.apply(bytes, 3)) return false;
+        
+        packet[0] = (packet[0] & 0xFF0000FF) | (bytes[0] << 16) | (bytes[1] << 8);
+        if(bytes[2] != velocity) {
+            if(type == RtMidiUmp::MIDI1_CHANNEL) packet[0] = (packet[0] & 0xFFFFFF00) | bytes[2];
+            else packet[1] = (RtMidiUmp::scaleUp(bytes[2], 7, 16) << 16) | (packet[1] & 0xFFFF);
+        }
+        return true;
+    }
+    
+    
     /**
      * Pass a multi-byte MIDI message received from midiin to the outlet.
+     * The bytes point into RtMidi's input buffer and are only valid during this call.
      * NOTE: This is an internal callback, it is not part of the interface with the Max patch.
      */
-    void receive(midimessage *message) {
-        if(message) {
+    void receive(const unsigned char *message, size_t size) {
+        if(message && umpMode) {
+            // Queued input arrives as bytes and is translated here.
+            RtMidiUmp::Protocol protocol = (umpMode == 2) ? RtMidiUmp::MIDI2 : RtMidiUmp::MIDI1;
+            unsigned int count = RtMidiUmp::fromBytes(message, size, &umpInWords[0], umpInWords.size(), protocol);
+            if(count > umpInWords.size()) {
+                umpInWords.resize(count);
+                RtMidiUmp::fromBytes(message, size, &umpInWords[0], count, protocol);
+            }
+            receiveUmp(&umpInWords[0], count);
+        }
+        else if(message) {
             void *midiOutlet = m_outlets[OUTLET_MIDI];
             void *sysexOutlet = m_outlets[OUTLET_SYSEX];
             
+            if(midiOutlet && assembler.isActive()) {
+                RtMidiControlAssembler::Event event;
+                RtMidiControlAssembler::Result result = assembler.process(message, size, &event);
+                if(result == RtMidiControlAssembler::HOLD) return;
+                if(result == RtMidiControlAssembler::EVENT) {
+                    t_atom atoms[3];
+                    atom_setlong(&atoms[0], event.channel + 1);
+                    atom_setlong(&atoms[1], event.number);
+                    atom_setlong(&atoms[2], event.value);
+                    t_symbol *selector = (event.type == RtMidiControlAssembler::CC14) ? SYM_CC14 :
+                                         (event.type == RtMidiControlAssembler::RPN) ? SYM_RPN : SYM_NRPN;
+                    outlet_anything(midiOutlet, selector, 3, atoms);
+                    return;
+                }
+            }
+            
             if(midiOutlet && sysexOutlet) {
                 
-                int byteCount = message->size();                
-                for(int i=0; i<byteCount; i++) {
-                    int byte = (int)message->at(i);
+                for(size_t i=0; i<size; i++) {
+                    int byte = (int)message[i];
           
                     if(byte == SYSEX_START) {
                         isSysEx = true;
@@ -342,6 +1002,95 @@ public:
     }
     
     
+    /**
+     * Pass the Universal MIDI Packets of a message received from midiin to the outlets, one list per packet.
+     * NOTE: This is an internal callback, it is not part of the interface with the Max patch.
+     */
+    void receiveUmp(const uint32_t *words, unsigned int count) {
+        void *midiOutlet = m_outlets[OUTLET_MIDI];
+        void *sysexOutlet = m_outlets[OUTLET_SYSEX];
+        t_atom atoms[4];
+        
+        if(!midiOutlet || !sysexOutlet) return;
+        
+        for(unsigned int i=0; i<count; ) {
+            unsigned int size = RtMidiUmp::wordCount(words[i]);
+            if(i + size > count) break;
+            for(unsigned int j=0; j<size; j++) {
+                atom_setlong(&atoms[j], (t_atom_long)(int32_t)words[i+j]);
+            }
+            bool sysex = (words[i] >> 28) == RtMidiUmp::DATA64;
+            outlet_list(sysex ? sysexOutlet : midiOutlet, NULL, size, atoms);
+            i += size;
+        }
+    }
+    
+    
+    /**
+     * Output the messages queued by RtMidi, then check again after POLL_INTERVAL_MS.
+     * They were already transformed and sent to the thru ports on the input thread by filterQueued().
+     * NOTE: This is an internal clock callback used when an (overflow) policy is set. It runs in the Max scheduler.
+     */
+    void pollInput() {
+        if(!midiin || !inPortName) return;
+        
+        for(;;) {
+            midiin->getMessage(&pollMessage);
+            if(pollMessage.empty()) break;
+            receive(pollMessage.data(), pollMessage.size());
+        }
+        
+        if(overflowed.exchange(false)) {
+            RtMidiStats portStats;
+            midiin->getStats(&portStats);
+            object_warn((t_object *)this, "MIDI input queue overflow, %lld message(s) lost so far",
+                        (long long)(portStats.queueDrops + portStats.queueDropsOldest));
+        }
+        
+        clock_delay(pollClock, POLL_INTERVAL_MS);
+    }
+    
+    
+    /**
+     * Post the errors collected from the MIDI input thread, then check again after ERROR_INTERVAL_MS.
+     * Each error is posted once with the number of times it happened since it was last posted.
+     * NOTE: This is an internal clock callback. It runs in the Max scheduler.
+     */
+    void reportErrors() {
+        RtMidiErrorEvent events[RtMidiErrorEvent::CODE_COUNT];
+        unsigned int count = midiin->getErrorEvents(events, RtMidiErrorEvent::CODE_COUNT);
+        for(unsigned int i=0; i<count; i++) {
+            if(events[i].count > 1) {
+                object_error((t_object *)this, "%s (%lld times)", events[i].message, (long long)events[i].count);
+            }
+            else {
+                object_error((t_object *)this, "%s", events[i].message);
+            }
+        }
+        clock_delay(errorClock, ERROR_INTERVAL_MS);
+    }
+    
+    
+    /**
+     * Follow a note replayed to the output port.
+     * NOTE: This is an internal callback running on the player thread.
+     */
+    void trackReplay(const unsigned char *message, size_t size) {
+        replayNotes.track(message, size);
+    }
+    
+    
+    /**
+     * Remember that the input queue overflowed, to be reported from the scheduler.
+     * NOTE: This is an internal callback running on the MIDI input thread, so it must not call into Max.
+     */
+    void noteOverflow(RtMidiIn::OverflowPolicy action) {
+        if(action == RtMidiIn::DROP_NEWEST || action == RtMidiIn::DROP_OLDEST) {
+            overflowed.store(true);
+        }
+    }
+    
+    
 private:
     
     RtMidiIn  *midiin;
@@ -354,6 +1103,105 @@ private:
     t_symbol *outPortName;
     midimessage message;
     bool isSysEx;
+    bool queuedInput;
+    std::atomic<bool> overflowed;
+    midimessage pollMessage;
+    void *pollClock;
+    void *errorClock;
+    int umpMode;
+    std::vector<uint32_t> umpInWords;   // queued input translated in the scheduler
+    std::vector<uint32_t> umpOutWords;  // words of the last (sendump)
+    RtMidiRecorder recorder;
+    RtMidiPlayer player;
+    bool replayToOutput;
+    t_symbol *replayInPortName;             // input port closed while replaying to the outlets
+    std::vector<RtMidiOut *> thruOutputs;   // only changed while the input port is closed
+    std::atomic<bool> thruMonitor;
+    RtMidiTransform inputTransform;
+    std::atomic<bool> transformActive;
+    RtMidiControlAssembler assembler;   // used where input reaches the outlets as MIDI bytes
+    RtMidiNoteTracker sentNotes;        // notes on at the output port, sent by the patch
+    RtMidiNoteTracker replayNotes;      // notes on at the output port, sent by the player
+    RtMidiNoteTracker thruNotes;        // notes on at the thru ports, followed by the input thread
+    std::vector<unsigned char> noteOffs;
+    
+    
+    /**
+     * Send a note off for each note still on at the output port, back to back in one call, and forget the notes.
+     * The player must be stopped, since it follows the notes it replays on its own thread.
+     */
+    void releaseNotes() {
+        sentNotes.merge(replayNotes);
+        replayNotes.clear();
+        noteOffs.clear();
+        
+        if(sentNotes.release(&noteOffs) > 0 && midiout && midiout->isPortOpen()) {
+            midiout->sendMessages(&noteOffs[0], noteOffs.size());
+        }
+    }
+    
+    
+    /**
+     * Send a note off to every thru port for each note still on there, back to back in one call, and forget the notes.
+     * The input port must be closed, so that nothing is being forwarded.
+     */
+    void releaseThruNotes() {
+        noteOffs.clear();
+        if(thruNotes.release(&noteOffs) > 0) {
+            for(size_t i=0; i<thruOutputs.size(); i++) {
+                thruOutputs[i]->sendMessages(&noteOffs[0], noteOffs.size());
+            }
+        }
+    }
+    
+    
+    /**
+     * Release the notes still on at the thru ports, then close and forget them.
+     * The input port must be closed, so that nothing is being forwarded.
+     */
+    void closeThru() {
+        releaseThruNotes();
+        
+        for(size_t i=0; i<thruOutputs.size(); i++) {
+            thruOutputs[i]->closePort();
+            delete thruOutputs[i];
+        }
+        thruOutputs.clear();
+    }
+    
+    
+    /**
+     * Close the input port, returning its name so that it can be reopened with reopenInput().
+     */
+    t_symbol *closeInput() {
+        t_symbol *portName = inPortName;
+        t_atom atoms[1];
+        atom_setsym(&atoms[0], SYM_NONE);
+        input(0, NULL, 1, atoms);
+        return portName;
+    }
+    
+    
+    /**
+     * Reopen the input port closed for a replay to the outlets, if there was one. The player must be stopped.
+     */
+    void reopenAfterReplay() {
+        t_symbol *portName = replayInPortName;
+        replayInPortName = NULL;
+        reopenInput(portName);
+    }
+    
+    
+    /**
+     * Reopen the input port closed by closeInput(), if there was one.
+     */
+    void reopenInput(t_symbol *portName) {
+        if(portName) {
+            t_atom atoms[1];
+            atom_setsym(&atoms[0], portName);
+            input(0, NULL, 1, atoms);
+        }
+    }
     
     
     /**
@@ -471,6 +1319,46 @@ private:
     }
     
     
+    /**
+     * Send the counters of one port out the statistics outlet, each as a message selected by the port direction.
+     */
+    void dumpStats(t_symbol *direction, RtMidiStats &portStats, bool isInput) {
+        void *outlet = m_outlets[OUTLET_STATS];
+        t_atom atoms[1 + RtMidiStats::callbackBins];
+        
+        dumpStat(outlet, direction, "messages", portStats.messages);
+        dumpStat(outlet, direction, "bytes", portStats.bytes);
+        dumpStat(outlet, direction, "sysex", portStats.sysexMessages);
+        dumpStat(outlet, direction, "overruns", portStats.overruns);
+        dumpStat(outlet, direction, "queue_drops", portStats.queueDrops);
+        
+        if(isInput) {
+            dumpStat(outlet, direction, "queue_high_water", portStats.queueHighWater);
+            dumpStat(outlet, direction, "queue_drops_oldest", portStats.queueDropsOldest);
+            dumpStat(outlet, direction, "queue_coalesced", portStats.queueCoalesced);
+            dumpStat(outlet, direction, "queue_growths", portStats.queueGrowths);
+            dumpStat(outlet, direction, "sysex_peak_size", portStats.sysexPeakSize);
+            dumpStat(outlet, direction, "sysex_reallocations", portStats.sysexReallocations);
+            dumpStat(outlet, direction, "recorded", recorder.getRecordedCount());
+            dumpStat(outlet, direction, "record_drops", recorder.getDroppedCount());
+            
+            atom_setsym(&atoms[0], gensym("callback_us"));
+            for(unsigned int i=0; i<RtMidiStats::callbackBins; i++) {
+                atom_setlong(&atoms[1+i], (t_atom_long)portStats.callbackTime[i]);
+            }
+            outlet_anything(outlet, direction, 1 + RtMidiStats::callbackBins, atoms);
+        }
+    }
+    
+    
+    void dumpStat(void *outlet, t_symbol *direction, const char *name, unsigned long long value) {
+        t_atom atoms[2];
+        atom_setsym(&atoms[0], gensym(name));
+        atom_setlong(&atoms[1], (t_atom_long)value);
+        outlet_anything(outlet, direction, 2, atoms);
+    }
+    
+    
     /**
      * Print an RtMidiError to the Max console
      * NOTE: I have not been able to test this code because I don't know how to trigger an RtMidiError. It always "just works" for me.
@@ -506,8 +1394,46 @@ void testint2(long inlet, long v) {
 
 
 
-void midiInputCallback(double deltatime, midimessage *message, void *userData) {
-    ((MIDI4L*)userData)->receive(message);
+void midiInputCallback(double deltatime, const unsigned char *message, size_t size, unsigned int portTag, void *userData) {
+    ((MIDI4L*)userData)->forward(message, size);
+}
+
+void midiUmpCallback(double deltatime, const uint32_t *words, unsigned int count, unsigned int portTag, void *userData) {
+    ((MIDI4L*)userData)->forwardUmp(words, count);
+}
+
+void midiOverflowCallback(RtMidiIn::OverflowPolicy action, const unsigned char *message, size_t size, void *userData) {
+    ((MIDI4L*)userData)->noteOverflow(action);
+}
+
+bool midiQueueFilter(double timeStamp, unsigned char *message, size_t size, void *userData) {
+    return ((MIDI4L*)userData)->filterQueued(message, size);
+}
+
+void midiReplayCallback(double time, const unsigned char *message, size_t size, void *userData) {
+    ((MIDI4L*)userData)->receive(message, size);
+}
+
+void midiReplayOutCallback(double time, const unsigned char *message, size_t size, void *userData) {
+    ((MIDI4L*)userData)->trackReplay(message, size);
+}
+
+void midiErrorCallback(RtMidiError::Type type, const std::string &errorText) {
+    // RtMidi passes no object, so these go to the console without one.
+    if(type == RtMidiError::WARNING || type == RtMidiError::DEBUG_WARNING) {
+        post("midi4l: %s", errorText.c_str());
+    }
+    else {
+        error("midi4l: %s", errorText.c_str());
+    }
+}
+
+void pollInputTick(void *x) {
+    ((MIDI4L*)x)->pollInput();
+}
+
+void reportErrorsTick(void *x) {
+    ((MIDI4L*)x)->reportErrors();
 }
 
 
@@ -523,6 +1449,19 @@ C74_EXPORT int main(void) {
     REGISTER_METHOD_GIMME(MIDI4L, send);
     REGISTER_METHOD_GIMME(MIDI4L, input);
     REGISTER_METHOD_GIMME(MIDI4L, output);
+    REGISTER_METHOD_GIMME(MIDI4L, realtime);
+    REGISTER_METHOD_GIMME(MIDI4L, stats);
+    REGISTER_METHOD_GIMME(MIDI4L, overflow);
+    REGISTER_METHOD_GIMME(MIDI4L, ump);
+    REGISTER_METHOD_GIMME(MIDI4L, sendump);
+    REGISTER_METHOD_GIMME(MIDI4L, record);
+    REGISTER_METHOD_GIMME(MIDI4L, tosmf);
+    REGISTER_METHOD_GIMME(MIDI4L, replay);
+    REGISTER_METHOD_GIMME(MIDI4L, thru);
+    REGISTER_METHOD_GIMME(MIDI4L, transform);
+    REGISTER_METHOD_GIMME(MIDI4L, nrpn);
+    REGISTER_METHOD_GIMME(MIDI4L, cc14);
+    REGISTER_METHOD_GIMME(MIDI4L, panic);
 
 
 
@@ -37,7 +37,625 @@
 /**********************************************************************/
 
 #include "RtMidi.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <sstream>
+#include <thread>
+
+//*********************************************************************//
+//  RtMidiMessage Definitions
+//*********************************************************************//
+
+void RtMidiMessage :: reallocate( size_t nBytes )
+{
+  // Only ever grows, so the inline buffer is left for good once a
+  // message has needed the heap.
+  unsigned char *heap = new unsigned char[nBytes];
+  memcpy( heap, data(), size_ );
+  if ( !isInline() ) delete [] storage_.heap;
+  storage_.heap = heap;
+  capacity_ = (unsigned int) nBytes;
+}
+
+void RtMidiMessage :: swap( RtMidiMessage &other )
+{
+  // Inline bytes and heap pointers are exchanged alike.
+  std::swap( timeStamp, other.timeStamp );
+  std::swap( size_, other.size_ );
+  std::swap( capacity_, other.capacity_ );
+  std::swap( storage_, other.storage_ );
+}
+
+//*********************************************************************//
+//  RtMidiUmp Definitions
+//*********************************************************************//
+
+// Size of a MIDI 1.0 message from its status byte, or zero for sysex
+// and data bytes.
+static unsigned int midiMessageSize( unsigned char status )
+{
+  if ( status < 0x80 ) return 0;
+  if ( status < 0xC0 ) return 3;
+  if ( status < 0xE0 ) return 2;
+  if ( status < 0xF0 ) return 3;
+  switch ( status ) {
+  case 0xF0: return 0;
+  case 0xF1: case 0xF3: return 2;
+  case 0xF2: return 3;
+  default: return 1;
+  }
+}
+
+// Length of the complete message at the start of bytes, sysex
+// included, or zero if it does not start with a status byte or is cut
+// short by the end of the buffer.
+static size_t midiMessageLength( const unsigned char *bytes, size_t size )
+{
+  if ( bytes[0] == 0xF0 ) {
+    const unsigned char *end = (const unsigned char *) memchr( bytes, 0xF7, size );
+    return end ? end - bytes + 1 : 0;
+  }
+  size_t length = midiMessageSize( bytes[0] );
+  return length <= size ? length : 0;
+}
+
+unsigned int RtMidiUmp :: wordCount( uint32_t word )
+{
+  // Packet sizes by message type, including the reserved ones.
+  static const unsigned char sizes[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+  return sizes[word >> 28];
+}
+
+uint32_t RtMidiUmp :: scaleUp( uint32_t value, unsigned int srcBits, unsigned int dstBits )
+{
+  // Values up to the center are only shifted.  Above it, the bits
+  // below the top one are repeated into the new low bits so that the
+  // maximum maps to the maximum.
+  unsigned int scaleBits = dstBits - srcBits;
+  uint32_t scaled = value << scaleBits;
+  if ( value <= ( 1u << ( srcBits - 1 ) ) ) return scaled;
+
+  unsigned int repeatBits = srcBits - 1;
+  uint32_t repeat = value & ( ( 1u << repeatBits ) - 1 );
+  if ( scaleBits > repeatBits ) repeat <<= scaleBits - repeatBits;
+  else repeat >>= repeatBits - scaleBits;
+  while ( repeat != 0 ) {
+    scaled |= repeat;
+    repeat >>= repeatBits;
+  }
+  return scaled;
+}
+
+unsigned int RtMidiUmp :: fromBytes( const unsigned char *bytes, size_t size, uint32_t *words,
+                                     unsigned int maxWords, Protocol protocol, unsigned int group )
+{
+  if ( size == 0 || bytes[0] < 0x80 ) return 0;
+  uint32_t status = bytes[0], groupBits = ( group & 0x0F ) << 24;
+
+  if ( status == 0xF0 ) {
+    // The data between 0xF0 and 0xF7 goes six bytes per packet, with
+    // the packet's place in the message in its status nibble.
+    size_t nData = size - 1;
+    if ( nData > 0 && bytes[size-1] == 0xF7 ) nData--;
+    unsigned int nPackets = nData == 0 ? 1 : (unsigned int) ( ( nData + 5 ) / 6 );
+    if ( 2 * nPackets > maxWords ) return 2 * nPackets;
+
+    for ( unsigned int i=0; i<nPackets; i++ ) {
+      unsigned char data[6] = { 0, 0, 0, 0, 0, 0 };
+      uint32_t n = nData - 6 * i < 6 ? (uint32_t) ( nData - 6 * i ) : 6;
+      uint32_t state = nPackets == 1 ? 0x0 : i == 0 ? 0x1 : i + 1 < nPackets ? 0x2 : 0x3;
+      for ( unsigned int j=0; j<n; j++ ) data[j] = bytes[1 + 6 * i + j] & 0x7F;
+      words[2*i] = ( (uint32_t) DATA64 << 28 ) | groupBits | ( state << 20 ) | ( n << 16 ) | ( data[0] << 8 ) | data[1];
+      words[2*i+1] = ( (uint32_t) data[2] << 24 ) | ( data[3] << 16 ) | ( data[4] << 8 ) | data[5];
+    }
+    return 2 * nPackets;
+  }
+
+  uint32_t data1 = size > 1 ? bytes[1] & 0x7F : 0;
+  uint32_t data2 = size > 2 ? bytes[2] & 0x7F : 0;
+  if ( status > 0xF0 || protocol == MIDI1 ) {
+    if ( maxWords < 1 ) return 1;
+    uint32_t type = status > 0xF0 ? SYSTEM : MIDI1_CHANNEL;
+    words[0] = ( type << 28 ) | groupBits | ( status << 16 ) | ( data1 << 8 ) | data2;
+    return 1;
+  }
+
+  // A MIDI 2.0 channel voice message keeps the status byte in the
+  // same place and moves the value to the second word.
+  if ( maxWords < 2 ) return 2;
+  uint32_t word0 = ( (uint32_t) MIDI2_CHANNEL << 28 ) | groupBits, word1 = 0;
+  switch ( status & 0xF0 ) {
+  case 0x90:
+    if ( data2 == 0 ) status = 0x80 | ( status & 0x0F );  // note off
+    // fall through
+  case 0x80:
+    word0 |= data1 << 8;
+    word1 = scaleUp( data2, 7, 16 ) << 16;
+    break;
+  case 0xA0:
+  case 0xB0:
+    word0 |= data1 << 8;
+    word1 = scaleUp( data2, 7, 32 );
+    break;
+  case 0xC0:
+    word1 = data1 << 24;
+    break;
+  case 0xD0:
+    word1 = scaleUp( data1, 7, 32 );
+    break;
+  case 0xE0:
+    word1 = scaleUp( data1 | ( data2 << 7 ), 14, 32 );
+    break;
+  }
+  words[0] = word0 | ( status << 16 );
+  words[1] = word1;
+  return 2;
+}
+
+unsigned int RtMidiUmp :: toBytes( const uint32_t *packet, unsigned char *bytes )
+{
+  uint32_t word0 = packet[0];
+  unsigned char status = ( word0 >> 16 ) & 0xFF;
+  unsigned char data1 = ( word0 >> 8 ) & 0x7F, data2 = word0 & 0x7F;
+  unsigned int n = 0;
+
+  switch ( word0 >> 28 ) {
+  case SYSTEM:
+  case MIDI1_CHANNEL:
+    if ( ( ( word0 >> 28 ) == SYSTEM ) != ( status >= 0xF0 ) ) return 0;
+    n = midiMessageSize( status );
+    bytes[0] = status;
+    if ( n > 1 ) bytes[1] = data1;
+    if ( n > 2 ) bytes[2] = data2;
+    return n;
+
+  case DATA64: {
+    uint32_t state = ( word0 >> 20 ) & 0x0F, nData = ( word0 >> 16 ) & 0x0F;
+    unsigned char data[6] = { data1, data2, (unsigned char) ( packet[1] >> 24 ), (unsigned char) ( packet[1] >> 16 ),
+                              (unsigned char) ( packet[1] >> 8 ), (unsigned char) packet[1] };
+    if ( state > 0x3 ) return 0;
+    if ( nData > 6 ) nData = 6;
+    if ( state == 0x0 || state == 0x1 ) bytes[n++] = 0xF0;
+    for ( unsigned int i=0; i<nData; i++ ) bytes[n++] = data[i] & 0x7F;
+    if ( state == 0x0 || state == 0x3 ) bytes[n++] = 0xF7;
+    return n;
+  }
+
+  case MIDI2_CHANNEL: {
+    uint32_t word1 = packet[1], value;
+    unsigned char channel = status & 0x0F;
+    switch ( status & 0xF0 ) {
+    case 0x80:
+    case 0x90:
+      // A MIDI 1.0 note on cannot have a zero velocity.
+      value = scaleDown( word1 >> 16, 16, 7 );
+      if ( ( status & 0xF0 ) == 0x90 && value == 0 ) value = 1;
+      bytes[n++] = status;
+      bytes[n++] = data1;
+      bytes[n++] = (unsigned char) value;
+      break;
+    case 0xA0:
+    case 0xB0:
+      bytes[n++] = status;
+      bytes[n++] = data1;
+      bytes[n++] = (unsigned char) scaleDown( word1, 32, 7 );
+      break;
+    case 0xC0:
+      if ( word0 & 0x01 ) {
+        // Bank select MSB and LSB precede the program change.
+        bytes[n++] = 0xB0 | channel; bytes[n++] = 0x00; bytes[n++] = ( word1 >> 8 ) & 0x7F;
+        bytes[n++] = 0xB0 | channel; bytes[n++] = 0x20; bytes[n++] = word1 & 0x7F;
+      }
+      bytes[n++] = status;
+      bytes[n++] = ( word1 >> 24 ) & 0x7F;
+      break;
+    case 0xD0:
+      bytes[n++] = status;
+      bytes[n++] = (unsigned char) scaleDown( word1, 32, 7 );
+      break;
+    case 0xE0:
+      value = scaleDown( word1, 32, 14 );
+      bytes[n++] = status;
+      bytes[n++] = value & 0x7F;
+      bytes[n++] = ( value >> 7 ) & 0x7F;
+      break;
+    case 0x20:
+    case 0x30: {
+      // Registered and non-registered controllers become the
+      // parameter number and data entry MSB and LSB.
+      unsigned char first = ( status & 0xF0 ) == 0x20 ? 101 : 99;
+      value = scaleDown( word1, 32, 14 );
+      bytes[n++] = 0xB0 | channel; bytes[n++] = first; bytes[n++] = data1;
+      bytes[n++] = 0xB0 | channel; bytes[n++] = first - 1; bytes[n++] = data2;
+      bytes[n++] = 0xB0 | channel; bytes[n++] = 6; bytes[n++] = ( value >> 7 ) & 0x7F;
+      bytes[n++] = 0xB0 | channel; bytes[n++] = 38; bytes[n++] = value & 0x7F;
+      break;
+    }
+    }
+    return n;
+  }
+  }
+
+  return 0;
+}
+
+//*********************************************************************//
+//  RtMidiTransform Definitions
+//*********************************************************************//
+
+// Note map entries hold the output channel in the high byte and the
+// output note in the low byte; other tables hold the output value.
+static const unsigned short transformDropNote = 0xFFFF;
+static const unsigned char transformDrop = 0xFF;
+
+struct TransformTables {
+  unsigned short notes[16][128];
+  unsigned char channels[16];
+  unsigned char velocities[128];
+  unsigned char controls[128];
+};
+
+// The TransformData structure holds the private data of a transform.
+// apply() counts itself in readers while it uses the current tables.
+// commit() fills the tables not in use, makes them current and waits
+// for readers to drop to zero, after which the previous tables are
+// free to be filled by the next commit.
+struct TransformData {
+  TransformTables staged;
+  TransformTables tables[2];
+  std::atomic<TransformTables *> current;
+  mutable std::atomic<unsigned int> readers;
+
+  TransformData() : current(&tables[0]), readers(0) {}
+};
+
+static void checkTransformChannel( unsigned int channel )
+{
+  if ( channel > 15 )
+    throw( RtMidiError( "RtMidiTransform: the channel must be from 0 to 15.", RtMidiError::INVALID_PARAMETER ) );
+}
+
+static void checkTransformNumber( unsigned int number )
+{
+  if ( number > 127 )
+    throw( RtMidiError( "RtMidiTransform: notes, velocities and controllers must be from 0 to 127.", RtMidiError::INVALID_PARAMETER ) );
+}
+
+static unsigned short transformNote( int outChannel, int outNote )
+{
+  if ( outChannel < 0 || outChannel > 15 || outNote < 0 || outNote > 127 ) return transformDropNote;
+  return (unsigned short) ( ( outChannel << 8 ) | outNote );
+}
+
+RtMidiTransform :: RtMidiTransform( void )
+{
+  data_ = (void *) new TransformData;
+  reset();
+  commit();
+}
+
+RtMidiTransform :: ~RtMidiTransform( void )
+{
+  delete (TransformData *) data_;
+}
+
+void RtMidiTransform :: reset( void )
+{
+  TransformTables &staged = ( (TransformData *) data_ )->staged;
+  for ( unsigned int channel=0; channel<16; channel++ ) {
+    staged.channels[channel] = (unsigned char) channel;
+    for ( unsigned int note=0; note<128; note++ )
+      staged.notes[channel][note] = transformNote( channel, note );
+  }
+  for ( unsigned int i=0; i<128; i++ ) {
+    staged.velocities[i] = (unsigned char) i;
+    staged.controls[i] = (unsigned char) i;
+  }
+}
+
+void RtMidiTransform :: setChannel( unsigned int channel, int outChannel )
+{
+  checkTransformChannel( channel );
+  TransformTables &staged = ( (TransformData *) data_ )->staged;
+  staged.channels[channel] = ( outChannel < 0 || outChannel > 15 ) ? transformDrop : (unsigned char) outChannel;
+  for ( unsigned int note=0; note<128; note++ )
+    staged.notes[channel][note] = transformNote( outChannel, note );
+}
+
+void RtMidiTransform :: setTranspose( unsigned int channel, int semitones )
+{
+  checkTransformChannel( channel );
+  TransformTables &staged = ( (TransformData *) data_ )->staged;
+  int outChannel = staged.channels[channel] == transformDrop ? -1 : staged.channels[channel];
+  setSplit( channel, 0, 127, outChannel, semitones );
+}
+
+void RtMidiTransform :: setSplit( unsigned int channel, unsigned int lowNote, unsigned int highNote,
+                                  int outChannel, int semitones )
+{
+  checkTransformChannel( channel );
+  checkTransformNumber( lowNote );
+  checkTransformNumber( highNote );
+  TransformTables &staged = ( (TransformData *) data_ )->staged;
+  for ( unsigned int note=lowNote; note<=highNote; note++ )
+    staged.notes[channel][note] = transformNote( outChannel, (int) note + semitones );
+}
+
+void RtMidiTransform :: setNote( unsigned int channel, unsigned int note, int outChannel, int outNote )
+{
+  checkTransformChannel( channel );
+  checkTransformNumber( note );
+  ( (TransformData *) data_ )->staged.notes[channel][note] = transformNote( outChannel, outNote );
+}
+
+void RtMidiTransform :: setVelocity( unsigned int velocity, unsigned int outVelocity )
+{
+  checkTransformNumber( velocity );
+  // A velocity of zero means note off and is never mapped, nor
+  // mapped to.
+  if ( velocity == 0 ) return;
+  if ( outVelocity < 1 ) outVelocity = 1;
+  if ( outVelocity > 127 ) outVelocity = 127;
+  ( (TransformData *) data_ )->staged.velocities[velocity] = (unsigned char) outVelocity;
+}
+
+void RtMidiTransform :: setVelocityCurve( double exponent, unsigned int minVelocity, unsigned int maxVelocity )
+{
+  if ( exponent <= 0.0 )
+    throw( RtMidiError( "RtMidiTransform::setVelocityCurve: the exponent must be positive.", RtMidiError::INVALID_PARAMETER ) );
+  for ( unsigned int velocity=1; velocity<128; velocity++ ) {
+    double position = std::pow( ( velocity - 1 ) / 126.0, exponent );
+    setVelocity( velocity, (unsigned int) ( minVelocity + position * ( (double) maxVelocity - minVelocity ) + 0.5 ) );
+  }
+}
+
+void RtMidiTransform :: setControl( unsigned int control, int outControl )
+{
+  checkTransformNumber( control );
+  ( (TransformData *) data_ )->staged.controls[control] =
+    ( outControl < 0 || outControl > 127 ) ? transformDrop : (unsigned char) outControl;
+}
+
+void RtMidiTransform :: commit( void )
+{
+  TransformData *data = (TransformData *) data_;
+  TransformTables *next = ( data->current.load() == &data->tables[0] ) ? &data->tables[1] : &data->tables[0];
+  *next = data->staged;
+  data->current.store( next );
+  while ( data->readers.load() > 0 ) std::this_thread::yield();
+}
+
+bool RtMidiTransform :: apply( unsigned char *message, size_t size ) const
+{
+  if ( size < 2 || message[0] < 0x80 || message[0] >= 0xF0 ) return true;
+
+  TransformData *data = (TransformData *) data_;
+  data->readers.fetch_add( 1 );
+  const TransformTables *tables = data->current.load();
+  unsigned char status = message[0] & 0xF0, channel = message[0] & 0x0F;
+  bool keep = true;
+
+  if ( status <= 0xA0 ) {
+    if ( size < 3 ) keep = false;
+    else {
+      unsigned short note = tables->notes[channel][ message[1] & 0x7F ];
+      if ( note == transformDropNote ) keep = false;
+      else {
+        message[0] = status | ( note >> 8 );
+        message[1] = note & 0x7F;
+        if ( status == 0x90 ) message[2] = tables->velocities[ message[2] & 0x7F ];
+      }
+    }
+  }
+  else {
+    unsigned char outChannel = tables->channels[channel];
+    if ( outChannel == transformDrop ) keep = false;
+    else {
+      message[0] = status | outChannel;
+      if ( status == 0xB0 && size >= 3 ) {
+        unsigned char control = tables->controls[ message[1] & 0x7F ];
+        if ( control == transformDrop ) keep = false;
+        else message[1] = control;
+      }
+    }
+  }
+
+  data->readers.fetch_sub( 1 );
+  return keep;
+}
+
+//*********************************************************************//
+//  RtMidiControlAssembler Definitions
+//*********************************************************************//
+
+RtMidiControlAssembler :: RtMidiControlAssembler( void )
+  : parameterMode_(PARAMETERS_OFF), cc14_(0), cc14Coarse_(0)
+{
+  reset();
+}
+
+void RtMidiControlAssembler :: reset( void )
+{
+  for ( unsigned int channel=0; channel<16; channel++ ) {
+    ChannelState &state = channels_[channel];
+    state.parameterType = -1;
+    state.parameter[0] = state.parameter[1] = 0;
+    state.dataMsb = 0;
+    memset( state.ccMsb, 0, sizeof( state.ccMsb ) );
+  }
+}
+
+void RtMidiControlAssembler :: setParameterMode( ParameterMode mode )
+{
+  parameterMode_.store( mode );
+}
+
+void RtMidiControlAssembler :: setCc14( unsigned int control, bool enable, bool coarse )
+{
+  if ( control > 31 )
+    throw( RtMidiError( "RtMidiControlAssembler::setCc14: the controller must be from 0 to 31.", RtMidiError::INVALID_PARAMETER ) );
+  if ( enable && coarse ) cc14Coarse_.fetch_or( 1u << control );
+  else cc14Coarse_.fetch_and( ~( 1u << control ) );
+  if ( enable ) cc14_.fetch_or( 1u << control );
+  else cc14_.fetch_and( ~( 1u << control ) );
+}
+
+bool RtMidiControlAssembler :: isActive( void ) const
+{
+  return parameterMode_.load() != PARAMETERS_OFF || cc14_.load() != 0;
+}
+
+RtMidiControlAssembler::Result RtMidiControlAssembler :: process( const unsigned char *message, size_t size,
+                                                                  Event *event )
+{
+  if ( size != 3 || ( message[0] & 0xF0 ) != 0xB0 ) return PASS;
+
+  unsigned int channel = message[0] & 0x0F;
+  unsigned char control = message[1] & 0x7F, value = message[2] & 0x7F;
+  ChannelState &state = channels_[channel];
+
+  // 14-bit controllers: the MSB waits for its LSB, unless it is coarse
+  // and counts on its own with an LSB of zero.  An LSB on its own
+  // refines the last MSB.
+  uint32_t cc14 = cc14_.load( std::memory_order_relaxed );
+  if ( control < 32 && ( cc14 & ( 1u << control ) ) ) {
+    state.ccMsb[control] = value;
+    if ( !( cc14Coarse_.load( std::memory_order_relaxed ) & ( 1u << control ) ) ) return HOLD;
+    event->type = CC14;
+    event->channel = channel;
+    event->number = control;
+    event->value = value << 7;
+    return EVENT;
+  }
+  if ( control >= 32 && control < 64 && ( cc14 & ( 1u << ( control - 32 ) ) ) ) {
+    control -= 32;
+    event->type = CC14;
+    event->channel = channel;
+    event->number = control;
+    event->value = ( state.ccMsb[control] << 7 ) | value;
+    return EVENT;
+  }
+
+  int mode = parameterMode_.load( std::memory_order_relaxed );
+  if ( mode == PARAMETERS_OFF ) return PASS;
+
+  switch ( control ) {
+  case 99: case 98: case 101: case 100: {
+    int type = ( control >= 100 ) ? RPN : NRPN;
+    if ( state.parameterType != type ) state.parameter[0] = state.parameter[1] = 0;
+    state.parameterType = type;
+    state.parameter[ ( control & 1 ) ? 0 : 1 ] = value;
+    // The null RPN deselects the parameter.
+    if ( type == RPN && state.parameter[0] == 127 && state.parameter[1] == 127 ) state.parameterType = -1;
+    return HOLD;
+  }
+  case 6:
+    if ( state.parameterType < 0 ) return PASS;
+    state.dataMsb = value;
+    if ( mode == PARAMETERS_FINE ) return HOLD;
+    value = 0;
+    break;
+  case 38:
+    if ( state.parameterType < 0 ) return PASS;
+    break;
+  default:
+    return PASS;
+  }
+
+  event->type = (Type) state.parameterType;
+  event->channel = channel;
+  event->number = ( state.parameter[0] << 7 ) | state.parameter[1];
+  event->value = ( state.dataMsb << 7 ) | value;
+  return EVENT;
+}
+
+//*********************************************************************//
+//  RtMidiNoteTracker Definitions
+//*********************************************************************//
+
+RtMidiNoteTracker :: RtMidiNoteTracker( void )
+{
+  clear();
+}
+
+void RtMidiNoteTracker :: track( const unsigned char *message, size_t size )
+{
+  if ( size == 0 ) return;
+  if ( message[0] == 0xFF ) {
+    clear();
+    return;
+  }
+  if ( size < 3 ) return;
+
+  unsigned char status = message[0] & 0xF0, channel = message[0] & 0x0F;
+  if ( status == 0x90 || status == 0x80 ) {
+    unsigned char note = message[1] & 0x7F;
+    uint64_t &word = notes_[channel][note >> 6];
+    uint64_t bit = (uint64_t) 1 << ( note & 63 );
+    bool on = ( status == 0x90 && message[2] > 0 );
+    if ( on && !( word & bit ) ) {
+      word |= bit;
+      count_++;
+    }
+    else if ( !on && ( word & bit ) ) {
+      word &= ~bit;
+      count_--;
+    }
+  }
+  else if ( status == 0xB0 && ( message[1] == 120 || message[1] == 123 ) ) {
+    for ( unsigned int i=0; i<2; i++ ) {
+      for ( uint64_t word = notes_[channel][i]; word; word &= word - 1 ) count_--;
+      notes_[channel][i] = 0;
+    }
+  }
+}
+
+unsigned int RtMidiNoteTracker :: getCount( void ) const
+{
+  return count_;
+}
+
+void RtMidiNoteTracker :: merge( const RtMidiNoteTracker &other )
+{
+  count_ = 0;
+  for ( unsigned int channel=0; channel<16; channel++ ) {
+    for ( unsigned int i=0; i<2; i++ ) {
+      notes_[channel][i] |= other.notes_[channel][i];
+      for ( uint64_t word = notes_[channel][i]; word; word &= word - 1 ) count_++;
+    }
+  }
+}
+
+void RtMidiNoteTracker :: clear( void )
+{
+  memset( notes_, 0, sizeof( notes_ ) );
+  count_ = 0;
+}
+
+unsigned int RtMidiNoteTracker :: release( std::vector<unsigned char> *messages )
+{
+  unsigned int released = count_;
+  messages->reserve( messages->size() + 3 * count_ );
+
+  // Only the words with notes on are looked at bit by bit.
+  for ( unsigned int channel=0; channel<16 && count_>0; channel++ ) {
+    for ( unsigned int i=0; i<2; i++ ) {
+      uint64_t word = notes_[channel][i];
+      for ( unsigned int bit=0; word; bit++, word >>= 1 ) {
+        if ( !( word & 1 ) ) continue;
+        messages->push_back( 0x80 | channel );
+        messages->push_back( (unsigned char) ( i * 64 + bit ) );
+        messages->push_back( 0 );
+      }
+    }
+  }
+
+  clear();
+  return released;
+}
 
 //*********************************************************************//
 //  RtMidi Definitions
@@ -78,8 +696,8 @@ void RtMidi :: getCompiledApi( std::vector<RtMidi::Api> &apis ) throw()
 #if defined(__WINDOWS_MM__)
   apis.push_back( WINDOWS_MM );
 #endif
-#if defined(__RTMIDI_DUMMY__)
-  apis.push_back( RTMIDI_DUMMY );
+#if defined(__RTMIDI_LOOPBACK__)
+  apis.push_back( RTMIDI_LOOPBACK );
 #endif
 }
 
@@ -109,9 +727,9 @@ void RtMidiIn :: openMidiApi( RtMidi::Api api, const std::string clientName, uns
   if ( api == MACOSX_CORE )
     rtapi_ = new MidiInCore( clientName, queueSizeLimit );
 #endif
-#if defined(__RTMIDI_DUMMY__)
-  if ( api == RTMIDI_DUMMY )
-    rtapi_ = new MidiInDummy( clientName, queueSizeLimit );
+#if defined(__RTMIDI_LOOPBACK__)
+  if ( api == RTMIDI_LOOPBACK )
+    rtapi_ = new MidiInLoopback( clientName, queueSizeLimit );
 #endif
 }
 
@@ -129,10 +747,13 @@ RtMidiIn :: RtMidiIn( RtMidi::Api api, const std::string clientName, unsigned in
   }
 
   // Iterate through the compiled APIs and return as soon as we find
-  // one with at least one port or we reach the end of the list.
+  // one with at least one port or we reach the end of the list.  The
+  // loopback API, which comes last, is skipped unless it is the only
+  // one, so that a system API is kept even when it has no ports yet.
   std::vector< RtMidi::Api > apis;
   getCompiledApi( apis );
   for ( unsigned int i=0; i<apis.size(); i++ ) {
+    if ( apis[i] == RTMIDI_LOOPBACK && i > 0 ) break;
     openMidiApi( apis[i], clientName, queueSizeLimit );
     if ( rtapi_->getPortCount() ) break;
   }
@@ -140,8 +761,7 @@ RtMidiIn :: RtMidiIn( RtMidi::Api api, const std::string clientName, unsigned in
   if ( rtapi_ ) return;
 
   // It should not be possible to get here because the preprocessor
-  // definition __RTMIDI_DUMMY__ is automatically defined if no
-  // API-specific definitions are passed to the compiler. But just in
+  // definition __RTMIDI_LOOPBACK__ is always defined. But just in
   // case something weird happens, we'll throw an error.
   std::string errorText = "RtMidiIn: no compiled API support found ... critical error!!";
   throw( RtMidiError( errorText, RtMidiError::UNSPECIFIED ) );
@@ -178,9 +798,9 @@ void RtMidiOut :: openMidiApi( RtMidi::Api api, const std::string clientName )
   if ( api == MACOSX_CORE )
     rtapi_ = new MidiOutCore( clientName );
 #endif
-#if defined(__RTMIDI_DUMMY__)
-  if ( api == RTMIDI_DUMMY )
-    rtapi_ = new MidiOutDummy( clientName );
+#if defined(__RTMIDI_LOOPBACK__)
+  if ( api == RTMIDI_LOOPBACK )
+    rtapi_ = new MidiOutLoopback( clientName );
 #endif
 }
 
@@ -197,10 +817,13 @@ RtMidiOut :: RtMidiOut( RtMidi::Api api, const std::string clientName )
   }
 
   // Iterate through the compiled APIs and return as soon as we find
-  // one with at least one port or we reach the end of the list.
+  // one with at least one port or we reach the end of the list.  The
+  // loopback API, which comes last, is skipped unless it is the only
+  // one, so that a system API is kept even when it has no ports yet.
   std::vector< RtMidi::Api > apis;
   getCompiledApi( apis );
   for ( unsigned int i=0; i<apis.size(); i++ ) {
+    if ( apis[i] == RTMIDI_LOOPBACK && i > 0 ) break;
     openMidiApi( apis[i], clientName );
     if ( rtapi_->getPortCount() ) break;
   }
@@ -208,8 +831,7 @@ RtMidiOut :: RtMidiOut( RtMidi::Api api, const std::string clientName )
   if ( rtapi_ ) return;
 
   // It should not be possible to get here because the preprocessor
-  // definition __RTMIDI_DUMMY__ is automatically defined if no
-  // API-specific definitions are passed to the compiler. But just in
+  // definition __RTMIDI_LOOPBACK__ is always defined. But just in
   // case something weird happens, we'll thrown an error.
   std::string errorText = "RtMidiOut: no compiled API support found ... critical error!!";
   throw( RtMidiError( errorText, RtMidiError::UNSPECIFIED ) );
@@ -267,6 +889,68 @@ void MidiApi :: error( RtMidiError::Type type, std::string errorString )
   }
 }
 
+void MidiApi :: getStats( RtMidiStats *stats )
+{
+  stats->messages = counters_.messages.load( std::memory_order_relaxed );
+  stats->bytes = counters_.bytes.load( std::memory_order_relaxed );
+  stats->overruns = counters_.overruns.load( std::memory_order_relaxed );
+  stats->queueDrops = counters_.queueDrops.load( std::memory_order_relaxed );
+  stats->queueDropsOldest = counters_.queueDropsOldest.load( std::memory_order_relaxed );
+  stats->queueCoalesced = counters_.queueCoalesced.load( std::memory_order_relaxed );
+  stats->queueGrowths = counters_.queueGrowths.load( std::memory_order_relaxed );
+  stats->sysexMessages = counters_.sysexMessages.load( std::memory_order_relaxed );
+  stats->sysexPeakSize = 0;
+  stats->sysexReallocations = 0;
+  stats->queueHighWater = counters_.queueHighWater.load( std::memory_order_relaxed );
+  for ( unsigned int i=0; i<RtMidiStats::callbackBins; i++ )
+    stats->callbackTime[i] = counters_.callbackTime[i].load( std::memory_order_relaxed );
+}
+
+void MidiApi :: resetStats( void )
+{
+  counters_.reset();
+}
+
+void MidiApi::Counters :: reset( void )
+{
+  messages.store( 0 );
+  bytes.store( 0 );
+  overruns.store( 0 );
+  queueDrops.store( 0 );
+  queueDropsOldest.store( 0 );
+  queueCoalesced.store( 0 );
+  queueGrowths.store( 0 );
+  sysexMessages.store( 0 );
+  queueHighWater.store( 0 );
+  for ( unsigned int i=0; i<RtMidiStats::callbackBins; i++ )
+    callbackTime[i].store( 0 );
+}
+
+void MidiApi::Counters :: countMessage( const unsigned char *bytes, unsigned int nBytes )
+{
+  messages.fetch_add( 1, std::memory_order_relaxed );
+  this->bytes.fetch_add( nBytes, std::memory_order_relaxed );
+  if ( nBytes > 0 && bytes[0] == 0xF0 )
+    sysexMessages.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void MidiApi::Counters :: countCallback( double seconds )
+{
+  // Bins double in width from one microsecond.
+  double microseconds = seconds * 1000000.0;
+  unsigned int bin = 0;
+  while ( microseconds >= 1.0 && bin < RtMidiStats::callbackBins - 1 ) {
+    microseconds *= 0.5;
+    bin++;
+  }
+  callbackTime[bin].fetch_add( 1, std::memory_order_relaxed );
+}
+
+static double statsNow( void )
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
 //*********************************************************************//
 //  Common MidiInApi Definitions
 //*********************************************************************//
@@ -274,10 +958,15 @@ void MidiApi :: error( RtMidiError::Type type, std::string errorString )
 MidiInApi :: MidiInApi( unsigned int queueSizeLimit )
   : MidiApi()
 {
-  // Allocate the MIDI queue.
-  inputData_.queue.ringSize = queueSizeLimit;
-  if ( inputData_.queue.ringSize > 0 )
-    inputData_.queue.ring = new MidiMessage[ inputData_.queue.ringSize ];
+  // Allocate the MIDI queue, leaving room for queueSizeLimit
+  // three-byte messages and never less than minBytes, so that a
+  // large sysex message can always be queued whole.
+  if ( queueSizeLimit > 0 ) {
+    unsigned int nBytes = queueSizeLimit * ( MidiQueue::headerSize + 3 );
+    if ( nBytes < MidiQueue::minBytes ) nBytes = MidiQueue::minBytes;
+    inputData_.queue.allocate( nBytes );
+  }
+  inputData_.counters = &counters_;
 }
 
 MidiInApi :: ~MidiInApi( void )
@@ -286,81 +975,1734 @@ MidiInApi :: ~MidiInApi( void )
   if ( inputData_.queue.ringSize > 0 ) delete [] inputData_.queue.ring;
 }
 
-void MidiInApi :: setCallback( RtMidiIn::RtMidiCallback callback, void *userData )
-{
-  if ( inputData_.usingCallback ) {
-    errorString_ = "MidiInApi::setCallback: a callback function is already set!";
-    error( RtMidiError::WARNING, errorString_ );
-    return;
-  }
-
-  if ( !callback ) {
-    errorString_ = "RtMidiIn::setCallback: callback function value is invalid!";
-    error( RtMidiError::WARNING, errorString_ );
-    return;
-  }
+// The head word of a MidiQueue holds the front index in its low half
+// and the edit sequence in its high half.
+#define QUEUE_EDIT_STEP ( 1ULL << 32 )
+#define QUEUE_EDITING( head ) ( ( head ) & QUEUE_EDIT_STEP )
+#define QUEUE_WITH_FRONT( head, index ) ( ( ( head ) & ~0xFFFFFFFFULL ) | (unsigned int) ( index ) )
 
-  inputData_.userCallback = callback;
-  inputData_.userData = userData;
-  inputData_.usingCallback = true;
+// Wait for the input thread to finish editing the queue.  The edit
+// is a short scan, so giving up the processor is enough.
+static inline void queuePause( void )
+{
+  std::this_thread::yield();
 }
 
-void MidiInApi :: cancelCallback()
+void MidiInApi::MidiQueue :: allocate( unsigned int nBytes )
 {
-  if ( !inputData_.usingCallback ) {
-    errorString_ = "RtMidiIn::cancelCallback: no callback function was set!";
-    error( RtMidiError::WARNING, errorString_ );
-    return;
-  }
+  // Round up to a power of two so that indices can be masked.
+  ringSize = 1;
+  while ( ringSize < nBytes ) ringSize <<= 1;
+  ring = new unsigned char[ ringSize ];
+  limit = ringSize;
+  maxLimit = ringSize;
+  head.store( 0 );
+  back.store( 0 );
+}
 
-  inputData_.userCallback = 0;
-  inputData_.userData = 0;
-  inputData_.usingCallback = false;
+void MidiInApi::MidiQueue :: write( unsigned int index, const unsigned char *src, unsigned int nBytes )
+{
+  // Copy into the ring, wrapping around its end if necessary.
+  unsigned int offset = index & ( ringSize - 1 );
+  unsigned int first = ringSize - offset;
+  if ( first > nBytes ) first = nBytes;
+  memcpy( ring + offset, src, first );
+  memcpy( ring, src + first, nBytes - first );
 }
 
-void MidiInApi :: ignoreTypes( bool midiSysex, bool midiTime, bool midiSense )
+void MidiInApi::MidiQueue :: read( unsigned int index, unsigned char *dst, unsigned int nBytes ) const
 {
-  inputData_.ignoreFlags = 0;
-  if ( midiSysex ) inputData_.ignoreFlags = 0x01;
-  if ( midiTime ) inputData_.ignoreFlags |= 0x02;
-  if ( midiSense ) inputData_.ignoreFlags |= 0x04;
+  unsigned int offset = index & ( ringSize - 1 );
+  unsigned int first = ringSize - offset;
+  if ( first > nBytes ) first = nBytes;
+  memcpy( dst, ring + offset, first );
+  memcpy( dst + first, ring, nBytes - first );
 }
 
-double MidiInApi :: getMessage( std::vector<unsigned char> *message )
+bool MidiInApi::MidiQueue :: push( const unsigned char *bytes, unsigned int nBytes, double timeStamp )
 {
-  message->clear();
+  // Called only from the input thread.  Returns false, leaving the
+  // queue untouched, if the record does not fit.
+  unsigned int tail = back.load( std::memory_order_relaxed );
+  if ( nBytes == 0 || headerSize + nBytes > limit - used() ) return false;
+
+  unsigned char header[headerSize];
+  memcpy( header, &nBytes, sizeof(nBytes) );
+  memcpy( header + sizeof(nBytes), &timeStamp, sizeof(timeStamp) );
+  write( tail, header, headerSize );
+  write( tail + headerSize, bytes, nBytes );
+
+  // Publish the record only once its bytes are in place.
+  back.store( tail + headerSize + nBytes, std::memory_order_release );
+  return true;
+}
 
-  if ( inputData_.usingCallback ) {
-    errorString_ = "RtMidiIn::getNextMessage: a user callback is currently set for this port.";
-    error( RtMidiError::WARNING, errorString_ );
-    return 0.0;
+template <class Bytes>
+bool MidiInApi::MidiQueue :: pop( Bytes *bytes, double *timeStamp )
+{
+  // Called only from the reading thread.  The copy is only kept if
+  // the input thread did not discard or change the record meanwhile;
+  // otherwise it is read again.
+  for ( ;; ) {
+    unsigned long long start = head.load( std::memory_order_acquire );
+    if ( QUEUE_EDITING( start ) ) {
+      queuePause();
+      continue;
+    }
+    unsigned int index = (unsigned int) start;
+    if ( index == back.load( std::memory_order_acquire ) ) return false;
+
+    unsigned int nBytes;
+    unsigned char header[headerSize];
+    read( index, header, headerSize );
+    memcpy( &nBytes, header, sizeof(nBytes) );
+    if ( nBytes == 0 || nBytes > ringSize - headerSize ) continue;
+    memcpy( timeStamp, header + sizeof(nBytes), sizeof(*timeStamp) );
+    bytes->resize( nBytes );
+    read( index + headerSize, &(*bytes)[0], nBytes );
+
+    // Release the space back to the input thread.
+    if ( head.compare_exchange_weak( start, QUEUE_WITH_FRONT( start, index + headerSize + nBytes ),
+                                     std::memory_order_acq_rel, std::memory_order_relaxed ) )
+      return true;
   }
+}
 
-  if ( inputData_.queue.size == 0 ) return 0.0;
+bool MidiInApi::MidiQueue :: peek( double *timeStamp ) const
+{
+  // Called only from the reading thread.  Returns the time stamp of
+  // the oldest record without removing it.
+  unsigned int index = (unsigned int) head.load( std::memory_order_acquire );
+  if ( index == back.load( std::memory_order_acquire ) ) return false;
+
+  unsigned char header[headerSize];
+  read( index, header, headerSize );
+  memcpy( timeStamp, header + sizeof(unsigned int), sizeof(*timeStamp) );
+  return true;
+}
 
-  // Copy queued message to the vector pointer argument and then "pop" it.
-  std::vector<unsigned char> *bytes = &(inputData_.queue.ring[inputData_.queue.front].bytes);
-  message->assign( bytes->begin(), bytes->end() );
-  double deltaTime = inputData_.queue.ring[inputData_.queue.front].timeStamp;
-  inputData_.queue.size--;
-  inputData_.queue.front++;
-  if ( inputData_.queue.front == inputData_.queue.ringSize )
-    inputData_.queue.front = 0;
+unsigned int MidiInApi::MidiQueue :: nextSize( void ) const
+{
+  // Called only from the reading thread.  The size is only returned
+  // if the input thread did not discard the record while it was read.
+  for ( ;; ) {
+    unsigned long long start = head.load( std::memory_order_acquire );
+    if ( QUEUE_EDITING( start ) ) {
+      queuePause();
+      continue;
+    }
+    unsigned int index = (unsigned int) start;
+    if ( index == back.load( std::memory_order_acquire ) ) return 0;
 
-  return deltaTime;
+    unsigned int nBytes;
+    read( index, (unsigned char *) &nBytes, sizeof(nBytes) );
+    if ( head.load( std::memory_order_acquire ) == start ) return nBytes;
+  }
+}
+
+unsigned int MidiInApi::MidiQueue :: popAll( unsigned char *buffer, size_t capacity, RtMidiIn::MessageRecord *records, unsigned int maxRecords )
+{
+  // Called only from the reading thread.  Walks the records published
+  // so far and releases all of them with a single compare-and-swap,
+  // starting over if the input thread discarded or changed any.
+  for ( ;; ) {
+    unsigned long long start = head.load( std::memory_order_acquire );
+    if ( QUEUE_EDITING( start ) ) {
+      queuePause();
+      continue;
+    }
+    unsigned int index = (unsigned int) start;
+    unsigned int tail = back.load( std::memory_order_acquire );
+    unsigned int count = 0;
+    size_t offset = 0;
+
+    while ( index != tail && count < maxRecords ) {
+      unsigned int nBytes;
+      unsigned char header[headerSize];
+      read( index, header, headerSize );
+      memcpy( &nBytes, header, sizeof(nBytes) );
+      if ( nBytes > ringSize - headerSize || nBytes > capacity - offset ) break;
+
+      records[count].offset = offset;
+      records[count].size = nBytes;
+      memcpy( &records[count].timeStamp, header + sizeof(nBytes), sizeof(double) );
+      read( index + headerSize, buffer + offset, nBytes );
+      offset += nBytes;
+      index += headerSize + nBytes;
+      count++;
+    }
+
+    if ( count == 0 ) return 0;
+    if ( head.compare_exchange_weak( start, QUEUE_WITH_FRONT( start, index ),
+                                     std::memory_order_acq_rel, std::memory_order_relaxed ) )
+      return count;
+  }
+}
+
+bool MidiInApi::MidiQueue :: dropOldest( void )
+{
+  // Called only from the input thread.  Returns false if the queue
+  // is empty.
+  unsigned long long start = head.load( std::memory_order_acquire );
+  for ( ;; ) {
+    unsigned int index = (unsigned int) start, nBytes;
+    if ( index == back.load( std::memory_order_relaxed ) ) return false;
+
+    read( index, (unsigned char *) &nBytes, sizeof(nBytes) );
+    if ( head.compare_exchange_weak( start, QUEUE_WITH_FRONT( start, index + headerSize + nBytes ),
+                                     std::memory_order_acq_rel, std::memory_order_acquire ) )
+      return true;
+  }
+}
+
+bool MidiInApi::MidiQueue :: coalesce( const unsigned char *bytes )
+{
+  // Called only from the input thread with a three-byte control
+  // change.  An odd edit sequence keeps the reader from releasing
+  // records while they are searched; if the reader gets there first,
+  // nothing is changed.
+  unsigned long long start = head.load( std::memory_order_acquire );
+  if ( !head.compare_exchange_strong( start, start + QUEUE_EDIT_STEP, std::memory_order_acq_rel ) )
+    return false;
+
+  unsigned int index = (unsigned int) start, tail = back.load( std::memory_order_relaxed );
+  unsigned int match = tail, nBytes;
+  unsigned char queued[2];
+  while ( index != tail ) {
+    read( index, (unsigned char *) &nBytes, sizeof(nBytes) );
+    if ( nBytes == 3 ) {
+      read( index + headerSize, queued, 2 );
+      if ( queued[0] == bytes[0] && queued[1] == bytes[1] ) match = index;
+    }
+    index += headerSize + nBytes;
+  }
+  if ( match != tail ) write( match + headerSize + 2, &bytes[2], 1 );
+
+  head.store( start + 2 * QUEUE_EDIT_STEP, std::memory_order_release );
+  return match != tail;
+}
+
+bool MidiInApi::MidiQueue :: grow( unsigned int nBytes )
+{
+  // Called only from the input thread.  Doubles the usable part of
+  // the ring, up to maxLimit, until a record of nBytes fits; returns
+  // false if it cannot.
+  unsigned int needed = used() + headerSize + nBytes;
+  unsigned int newLimit = limit > 0 ? limit : 1;
+  while ( newLimit < needed && newLimit < maxLimit ) newLimit <<= 1;
+  if ( newLimit > maxLimit ) newLimit = maxLimit;
+  if ( newLimit < needed ) return false;
+  limit = newLimit;
+  return true;
+}
+
+void MidiInApi :: setCallback( RtMidiIn::RtMidiCallback callback, void *userData )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.userCallback = callback;
+  inputData_.userData = userData;
+  inputData_.usingCallback = true;
+}
+
+void MidiInApi :: setCallback( RtMidiIn::RtMidiSpanCallback callback, void *userData, unsigned int portTag )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.spanCallback = callback;
+  inputData_.portTag = portTag;
+  inputData_.userData = userData;
+  inputData_.usingCallback = true;
+}
+
+void MidiInApi :: setCallback( RtMidiIn::RtMidiBatchCallback callback, void *userData, unsigned int portTag )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.batchCallback = callback;
+  inputData_.portTag = portTag;
+  inputData_.userData = userData;
+  inputData_.usingCallback = true;
+}
+
+void MidiInApi :: setCallback( RtMidiIn::RtMidiMessageCallback callback, void *userData, unsigned int portTag )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.messageCallback = callback;
+  inputData_.portTag = portTag;
+  inputData_.userData = userData;
+  inputData_.usingCallback = true;
+}
+
+void MidiInApi :: setCallback( RtMidiIn::RtMidiUmpCallback callback, void *userData, unsigned int portTag,
+                               RtMidiUmp::Protocol protocol, unsigned int group )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.umpCallback = callback;
+  inputData_.umpProtocol = protocol;
+  inputData_.umpGroup = group & 0x0F;
+  inputData_.portTag = portTag;
+  inputData_.userData = userData;
+  inputData_.usingCallback = true;
+}
+
+void MidiInApi :: cancelCallback()
+{
+  if ( !inputData_.usingCallback ) {
+    errorString_ = "RtMidiIn::cancelCallback: no callback function was set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.userCallback = 0;
+  inputData_.spanCallback = 0;
+  inputData_.batchCallback = 0;
+  inputData_.messageCallback = 0;
+  inputData_.umpCallback = 0;
+  inputData_.portTag = 0;
+  inputData_.userData = 0;
+  inputData_.usingCallback = false;
+}
+
+MidiInApi::ErrorEvents :: ErrorEvents()
+  : tail(0), enabled(false), interval(1.0), head(0), deferred(0)
+{
+  for ( unsigned int i=0; i<RtMidiErrorEvent::CODE_COUNT; i++ ) {
+    counts[i].store( 0 );
+    messages[i].store( "" );
+    pending[i].store( false );
+    lastPrinted[i].store( -1.0e9 );
+    lastEvent[i] = -1.0e9;
+  }
+  for ( unsigned int i=0; i<ringSize; i++ ) ring[i].store( 0 );
+}
+
+void MidiInApi::ErrorEvents :: report( RtMidiErrorEvent::Code code, const char *message, unsigned long long count )
+{
+  counts[code].fetch_add( count, std::memory_order_relaxed );
+  messages[code].store( message, std::memory_order_relaxed );
+
+  if ( enabled.load( std::memory_order_relaxed ) ) {
+    // Ring entries are codes plus one, so that zero marks a free slot.
+    // A code is queued once until the reader takes it.
+    if ( !pending[code].exchange( true ) )
+      ring[ tail.fetch_add( 1 ) & ( ringSize - 1 ) ].store( code + 1, std::memory_order_release );
+    return;
+  }
+
+  // Only the thread that moves the print time on prints, and it
+  // reports every occurrence since the last print.
+  double now = statsNow(), last = lastPrinted[code].load( std::memory_order_relaxed );
+  if ( now - last < interval.load( std::memory_order_relaxed ) ||
+       !lastPrinted[code].compare_exchange_strong( last, now ) ) return;
+  unsigned long long total = counts[code].exchange( 0 );
+  std::cerr << '\n' << message;
+  if ( total > 1 ) std::cerr << " (" << total << " times)";
+  std::cerr << "\n\n";
+}
+
+unsigned int MidiInApi::ErrorEvents :: take( RtMidiErrorEvent *events, unsigned int maxEvents )
+{
+  double now = statsNow(), period = interval.load( std::memory_order_relaxed );
+  unsigned int code, nEvents = 0;
+
+  // Move newly reported codes into the deferred set.  A slot that has
+  // been claimed but not yet written ends the scan until the next call.
+  while ( ( code = ring[ head & ( ringSize - 1 ) ].exchange( 0, std::memory_order_acquire ) ) != 0 ) {
+    deferred |= 1u << ( code - 1 );
+    head++;
+  }
+
+  for ( code=0; code<RtMidiErrorEvent::CODE_COUNT && nEvents<maxEvents; code++ ) {
+    if ( !( deferred & ( 1u << code ) ) || now - lastEvent[code] < period ) continue;
+    // The pending flag is cleared before the count is taken, so that an
+    // error reported in between queues a new event instead of being lost.
+    deferred &= ~( 1u << code );
+    pending[code].store( false );
+    unsigned long long count = counts[code].exchange( 0 );
+    if ( count == 0 ) continue;
+    lastEvent[code] = now;
+    events[nEvents].code = (RtMidiErrorEvent::Code) code;
+    events[nEvents].count = count;
+    events[nEvents].message = messages[code].load( std::memory_order_relaxed );
+    nEvents++;
+  }
+
+  return nEvents;
+}
+
+static inline void notifyOverflow( MidiInApi::RtMidiInData *data, RtMidiIn::OverflowPolicy action,
+                                   const unsigned char *bytes, unsigned int nBytes )
+{
+  if ( data->overflowCallback )
+    data->overflowCallback( action, bytes, nBytes, data->overflowUserData );
+}
+
+bool MidiInApi :: deliverMessage( RtMidiInData *data, double timeStamp, const unsigned char *bytes,
+                                  unsigned int nBytes )
+{
+  MidiApi::Counters *counters = data->counters;
+  counters->countMessage( bytes, nBytes );
+
+  RtMidiRecorder *recorder = data->recorder.load( std::memory_order_acquire );
+  if ( recorder ) recorder->record( timeStamp, bytes, nBytes );
+
+  if ( data->usingCallback ) {
+    double start = statsNow();
+    if ( data->spanCallback )
+      data->spanCallback( timeStamp, bytes, nBytes, data->portTag, data->userData );
+    else if ( data->batchCallback ) {
+      RtMidiIn::MessageRecord record = { 0, nBytes, timeStamp };
+      data->batchCallback( bytes, &record, 1, data->portTag, data->userData );
+    }
+    else if ( data->messageCallback ) {
+      // Messages assembled in data->message are handed over as they are.
+      RtMidiMessage *message = &data->message;
+      if ( bytes != message->data() ) {
+        message = &data->callbackMessage;
+        message->assign( bytes, nBytes );
+      }
+      message->timeStamp = timeStamp;
+      data->messageCallback( *message, data->portTag, data->userData );
+    }
+    else if ( data->umpCallback ) {
+      // Packets are built on the stack unless the message is sysex
+      // of more than twelve bytes.
+      uint32_t packet[4];
+      uint32_t *words = packet;
+      unsigned int count = RtMidiUmp::fromBytes( bytes, nBytes, packet, 4, data->umpProtocol, data->umpGroup );
+      if ( count > 4 ) {
+        if ( data->umpWords.size() < count ) data->umpWords.resize( count );
+        words = &data->umpWords[0];
+        RtMidiUmp::fromBytes( bytes, nBytes, words, count, data->umpProtocol, data->umpGroup );
+      }
+      if ( count > 0 )
+        data->umpCallback( timeStamp, words, count, data->portTag, data->userData );
+    }
+    else {
+      // The vector keeps its capacity, so it stops allocating once it
+      // has held the largest message.
+      data->callbackVector.assign( bytes, bytes + nBytes );
+      data->userCallback( timeStamp, &data->callbackVector, data->userData );
+    }
+    counters->countCallback( statsNow() - start );
+    return true;
+  }
+
+  // The filter works on a copy, which only allocates for sysex
+  // larger than any seen before.
+  if ( data->queueFilter ) {
+    RtMidiMessage &copy = data->callbackMessage;
+    copy.assign( bytes, nBytes );
+    if ( !data->queueFilter( timeStamp, copy.data(), nBytes, data->queueFilterUserData ) ) return true;
+    bytes = copy.data();
+  }
+
+  MidiQueue &queue = data->queue;
+  RtMidiIn::OverflowPolicy policy = data->overflowPolicy;
+
+  // Control changes are merged early enough to leave room for others.
+  if ( policy == RtMidiIn::COALESCE_CC && nBytes == 3 && ( bytes[0] & 0xF0 ) == 0xB0 &&
+       queue.used() > queue.limit / 2 && queue.coalesce( bytes ) ) {
+    counters->queueCoalesced.fetch_add( 1, std::memory_order_relaxed );
+    notifyOverflow( data, RtMidiIn::COALESCE_CC, bytes, nBytes );
+    return true;
+  }
+
+  // As long as the message fits in the queue, push it.  Otherwise let
+  // the overflow policy make room, or drop it.
+  if ( !queue.push( bytes, nBytes, timeStamp ) ) {
+    bool pushed = false;
+    if ( policy == RtMidiIn::DROP_OLDEST && MidiQueue::headerSize + nBytes <= queue.limit ) {
+      while ( !pushed && queue.dropOldest() ) {
+        counters->queueDropsOldest.fetch_add( 1, std::memory_order_relaxed );
+        pushed = queue.push( bytes, nBytes, timeStamp );
+      }
+    }
+    else if ( policy == RtMidiIn::GROW && queue.grow( nBytes ) ) {
+      counters->queueGrowths.fetch_add( 1, std::memory_order_relaxed );
+      pushed = queue.push( bytes, nBytes, timeStamp );
+    }
+
+    if ( !pushed ) {
+      counters->queueDrops.fetch_add( 1, std::memory_order_relaxed );
+      notifyOverflow( data, RtMidiIn::DROP_NEWEST, bytes, nBytes );
+      return false;
+    }
+    notifyOverflow( data, policy, bytes, nBytes );
+  }
+
+  // Only this thread raises the high-water mark.
+  unsigned int used = queue.used();
+  if ( used > counters->queueHighWater.load( std::memory_order_relaxed ) )
+    counters->queueHighWater.store( used, std::memory_order_relaxed );
+  return true;
+}
+
+void MidiInApi :: ignoreTypes( bool midiSysex, bool midiTime, bool midiSense )
+{
+  inputData_.ignoreFlags = 0;
+  if ( midiSysex ) inputData_.ignoreFlags = 0x01;
+  if ( midiTime ) inputData_.ignoreFlags |= 0x02;
+  if ( midiSense ) inputData_.ignoreFlags |= 0x04;
+}
+
+void MidiInApi :: setSysexSizeHint( unsigned int nBytes )
+{
+  inputData_.sysexSizeHint = nBytes;
+}
+
+void MidiInApi :: getSysexStats( unsigned int *peakSize, unsigned int *reallocations )
+{
+  if ( peakSize ) *peakSize = inputData_.sysexPeakSize.load( std::memory_order_relaxed );
+  if ( reallocations ) *reallocations = inputData_.sysexReallocations.load( std::memory_order_relaxed );
+}
+
+void MidiInApi :: setThreadScheduling( int priority, int cpu )
+{
+  inputData_.threadPriority = priority > 0 ? priority : 0;
+  inputData_.threadCpu = cpu >= 0 ? cpu : -1;
+}
+
+void MidiInApi :: setOverflowPolicy( RtMidiIn::OverflowPolicy policy, unsigned int maxBytes,
+                                     RtMidiIn::RtMidiOverflowCallback callback, void *userData )
+{
+  MidiQueue &queue = inputData_.queue;
+
+  // Give the queue room to grow into.  The part of the ring beyond
+  // the limit is not touched until it is needed.  The ring is
+  // rounded up to a power of two, so growth stops at maxBytes itself.
+  if ( policy == RtMidiIn::GROW ) {
+    if ( maxBytes > queue.ringSize ) {
+      if ( connected_ ) {
+        errorString_ = "MidiInApi::setOverflowPolicy: the queue cannot be enlarged while a port is open!";
+        error( RtMidiError::WARNING, errorString_ );
+        return;
+      }
+      unsigned int limit = queue.limit;
+      if ( queue.ringSize > 0 ) delete [] queue.ring;
+      queue.allocate( maxBytes );
+      queue.limit = limit;
+    }
+    queue.maxLimit = std::max( queue.limit, std::min( maxBytes, queue.ringSize ) );
+  }
+
+  inputData_.overflowCallback = callback;
+  inputData_.overflowUserData = userData;
+  inputData_.overflowPolicy = policy;
+}
+
+void MidiInApi :: setRecorder( RtMidiRecorder *recorder )
+{
+  inputData_.recorder.store( recorder, std::memory_order_release );
+}
+
+void MidiInApi :: setQueueFilter( RtMidiIn::RtMidiQueueFilter filter, void *userData )
+{
+  inputData_.queueFilter = filter;
+  inputData_.queueFilterUserData = userData;
+}
+
+void MidiInApi :: enableErrorEvents( bool enable, double interval )
+{
+  inputData_.errors.interval.store( interval > 0.0 ? interval : 0.0 );
+  inputData_.errors.enabled.store( enable );
+}
+
+unsigned int MidiInApi :: getErrorEvents( RtMidiErrorEvent *events, unsigned int maxEvents )
+{
+  return inputData_.errors.take( events, maxEvents );
+}
+
+void MidiInApi :: getStats( RtMidiStats *stats )
+{
+  MidiApi::getStats( stats );
+  getSysexStats( &stats->sysexPeakSize, &stats->sysexReallocations );
+}
+
+void MidiInApi :: resetStats( void )
+{
+  MidiApi::resetStats();
+  inputData_.sysexPeakSize.store( 0 );
+  inputData_.sysexReallocations.store( 0 );
+}
+
+double MidiInApi :: getMessage( std::vector<unsigned char> *message )
+{
+  message->clear();
+
+  if ( inputData_.usingCallback ) {
+    errorString_ = "RtMidiIn::getNextMessage: a user callback is currently set for this port.";
+    error( RtMidiError::WARNING, errorString_ );
+    return 0.0;
+  }
+
+  // Copy the queued message to the vector pointer argument and "pop" it.
+  double deltaTime = 0.0;
+  if ( !inputData_.queue.pop( message, &deltaTime ) ) return 0.0;
+
+  return deltaTime;
+}
+
+double MidiInApi :: getMessage( RtMidiMessage *message )
+{
+  message->clear();
+  message->timeStamp = 0.0;
+
+  if ( inputData_.usingCallback ) {
+    errorString_ = "RtMidiIn::getNextMessage: a user callback is currently set for this port.";
+    error( RtMidiError::WARNING, errorString_ );
+    return 0.0;
+  }
+
+  if ( !inputData_.queue.pop( message, &message->timeStamp ) ) return 0.0;
+
+  return message->timeStamp;
+}
+
+unsigned int MidiInApi :: getMessages( unsigned char *buffer, size_t capacity, RtMidiIn::MessageRecord *records, unsigned int maxRecords )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "RtMidiIn::getMessages: a user callback is currently set for this port.";
+    error( RtMidiError::WARNING, errorString_ );
+    return 0;
+  }
+
+  return inputData_.queue.popAll( buffer, capacity, records, maxRecords );
+}
+
+size_t MidiInApi :: getNextMessageSize( void )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "RtMidiIn::getNextMessageSize: a user callback is currently set for this port.";
+    error( RtMidiError::WARNING, errorString_ );
+    return 0;
+  }
+
+  return inputData_.queue.nextSize();
 }
 
 //*********************************************************************//
 //  Common MidiOutApi Definitions
 //*********************************************************************//
 
-MidiOutApi :: MidiOutApi( void )
-  : MidiApi()
+MidiOutApi :: MidiOutApi( void )
+  : MidiApi()
+{
+}
+
+MidiOutApi :: ~MidiOutApi( void )
+{
+}
+
+size_t MidiOutApi :: trySendMessage( const unsigned char *message, size_t size, size_t offset )
+{
+  // Without flow control the message is sent whole.
+  if ( offset == 0 )
+    sendMessage( message, size );
+  return size;
+}
+
+void MidiOutApi :: setSysexChunking( unsigned int /*chunkSize*/, unsigned int /*poolSize*/, unsigned int /*timeout*/ )
+{
+}
+
+void MidiOutApi :: setLoopbackLink( double /*latency*/, double /*bytesPerSecond*/ )
+{
+}
+
+void MidiOutApi :: sendMessages( const unsigned char *messages, size_t size )
+{
+  size_t length;
+  for ( size_t i=0; i<size; i+=length ) {
+    length = midiMessageLength( messages + i, size - i );
+    if ( length == 0 ) {
+      errorString_ = "MidiOutApi::sendMessages: a message is invalid or incomplete, it and the rest were not sent!";
+      error( RtMidiError::WARNING, errorString_ );
+      return;
+    }
+    sendMessage( messages + i, length );
+  }
+}
+
+void MidiOutApi :: sendUmp( const uint32_t *words, unsigned int count )
+{
+  unsigned char bytes[RtMidiUmp::maxBytes];
+  unsigned int i = 0, nWords, nBytes, size;
+
+  while ( i < count ) {
+    nWords = RtMidiUmp::wordCount( words[i] );
+    if ( i + nWords > count ) {
+      errorString_ = "MidiOutApi::sendUmp: the last packet is incomplete and was not sent!";
+      error( RtMidiError::WARNING, errorString_ );
+      return;
+    }
+    nBytes = RtMidiUmp::toBytes( &words[i], bytes );
+    bool sysex = ( words[i] >> 28 ) == RtMidiUmp::DATA64;
+    i += nWords;
+    if ( nBytes == 0 ) continue;
+
+    if ( sysex ) {
+      // Gather the message until its last packet.  Packets that do
+      // not follow a start are dropped.
+      if ( bytes[0] == 0xF0 ) umpSysex_.clear();
+      else if ( umpSysex_.empty() ) continue;
+      size = umpSysex_.size();
+      umpSysex_.resize( size + nBytes );
+      memcpy( &umpSysex_[size], bytes, nBytes );
+      if ( bytes[nBytes-1] == 0xF7 ) {
+        sendMessage( umpSysex_.data(), umpSysex_.size() );
+        umpSysex_.clear();
+      }
+      continue;
+    }
+
+    // A packet may give several messages back to back.
+    for ( unsigned int j=0; j<nBytes; j+=size ) {
+      size = midiMessageSize( bytes[j] );
+      if ( size == 0 ) break;
+      sendMessage( &bytes[j], size );
+    }
+  }
+}
+
+//*********************************************************************//
+//  RtMidiRecorder and RtMidiLog Definitions
+//*********************************************************************//
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The layout of a log file, see the RtMidiRecorder class declaration.
+struct LogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t dataEnd;        // end of the last complete record
+  uint64_t messageCount;
+  uint64_t indexOffset;    // zero until the recorder is closed
+  uint64_t indexCount;
+  uint32_t indexInterval;  // messages per index entry
+  uint32_t reserved;
+  uint64_t reserved2;
+};
+
+struct LogRecord {
+  uint64_t time;           // nanoseconds since the first message
+  uint32_t size;
+  uint32_t reserved;
+};
+
+struct LogIndexEntry {
+  uint64_t time;
+  uint64_t offset;
+};
+
+static const char logMagic[8] = { 'R', 't', 'M', 'i', 'd', 'i', 'L', 'g' };
+static const uint32_t logVersion = 1;
+static const uint32_t logIndexInterval = 1024;
+
+// The file is extended in steps of this size.
+static const size_t logGrowSize = 1 << 22;
+
+static size_t logRecordSize( size_t size )
+{
+  return sizeof(LogRecord) + ( ( size + 7 ) & ~(size_t) 7 );
+}
+
+// A file mapped into memory as a whole.  When writing, map() sets
+// the file size to the size of the mapping and close() truncates the
+// file to the part actually used.
+struct LogFile {
+  unsigned char *base;
+  size_t size;
+#if defined(_WIN32)
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int fd;
+#endif
+
+  // Default constructor.
+LogFile()
+#if defined(_WIN32)
+: base(0), size(0), file(INVALID_HANDLE_VALUE), mapping(0) {}
+#else
+: base(0), size(0), fd(-1) {}
+#endif
+
+  bool create( const std::string &fileName );
+  bool openRead( const std::string &fileName );
+  bool map( size_t nBytes, bool write );
+  void unmap( void );
+  bool close( size_t finalSize, bool write );
+};
+
+#if defined(_WIN32)
+
+bool LogFile :: create( const std::string &fileName )
+{
+  file = CreateFileA( fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                      CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+  return file != INVALID_HANDLE_VALUE;
+}
+
+bool LogFile :: openRead( const std::string &fileName )
+{
+  LARGE_INTEGER fileSize;
+  file = CreateFileA( fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+  if ( file == INVALID_HANDLE_VALUE ) return false;
+  if ( !GetFileSizeEx( file, &fileSize ) || fileSize.QuadPart == 0 ) return false;
+  return map( (size_t) fileSize.QuadPart, false );
+}
+
+bool LogFile :: map( size_t nBytes, bool write )
+{
+  unmap();
+  // Mapping a writable file beyond its end extends the file.
+  mapping = CreateFileMappingA( file, NULL, write ? PAGE_READWRITE : PAGE_READONLY,
+                                (DWORD) ( (unsigned long long) nBytes >> 32 ), (DWORD) nBytes, NULL );
+  if ( mapping == NULL ) return false;
+  base = (unsigned char *) MapViewOfFile( mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, nBytes );
+  if ( base == NULL ) return false;
+  size = nBytes;
+  return true;
+}
+
+void LogFile :: unmap( void )
+{
+  if ( base ) UnmapViewOfFile( base );
+  if ( mapping ) CloseHandle( mapping );
+  base = 0;
+  mapping = 0;
+  size = 0;
+}
+
+bool LogFile :: close( size_t finalSize, bool write )
+{
+  bool ok = true;
+  unmap();
+  if ( file == INVALID_HANDLE_VALUE ) return ok;
+  if ( write ) {
+    LARGE_INTEGER end;
+    end.QuadPart = finalSize;
+    ok = SetFilePointerEx( file, end, NULL, FILE_BEGIN ) && SetEndOfFile( file );
+  }
+  CloseHandle( file );
+  file = INVALID_HANDLE_VALUE;
+  return ok;
+}
+
+#else
+
+bool LogFile :: create( const std::string &fileName )
+{
+  fd = ::open( fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+  return fd >= 0;
+}
+
+bool LogFile :: openRead( const std::string &fileName )
+{
+  struct stat info;
+  fd = ::open( fileName.c_str(), O_RDONLY );
+  if ( fd < 0 ) return false;
+  if ( fstat( fd, &info ) < 0 || info.st_size == 0 ) return false;
+  return map( (size_t) info.st_size, false );
+}
+
+bool LogFile :: map( size_t nBytes, bool write )
+{
+  unmap();
+  if ( write && ftruncate( fd, (off_t) nBytes ) < 0 ) return false;
+  void *address = mmap( NULL, nBytes, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+  if ( address == MAP_FAILED ) return false;
+  base = (unsigned char *) address;
+  size = nBytes;
+  return true;
+}
+
+void LogFile :: unmap( void )
+{
+  if ( base ) munmap( base, size );
+  base = 0;
+  size = 0;
+}
+
+bool LogFile :: close( size_t finalSize, bool write )
+{
+  bool ok = true;
+  unmap();
+  if ( fd < 0 ) return ok;
+  if ( write ) ok = ftruncate( fd, (off_t) finalSize ) == 0;
+  if ( ::close( fd ) < 0 ) ok = false;
+  fd = -1;
+  return ok;
+}
+
+#endif
+
+// The RecorderData structure holds the private data of a recorder.
+// The input thread pushes messages onto the queue with their time
+// in seconds since the first message.  The writer thread is the only
+// user of the file while the log is open.
+struct RecorderData {
+  MidiInApi::MidiQueue queue;
+  LogFile file;
+  std::thread writer;
+  std::atomic<bool> recording;
+  std::atomic<bool> writing;
+  std::atomic<unsigned int> callers;
+  std::atomic<unsigned long long> recorded;
+  std::atomic<unsigned long long> dropped;
+  double time;
+  bool firstMessage;
+  bool failed;
+  size_t end;
+  std::vector<LogIndexEntry> index;
+  std::string fileName;
+
+  // Default constructor.
+RecorderData()
+: recording(false), writing(false), callers(0), recorded(0), dropped(0),
+    time(0.0), firstMessage(true), failed(false), end(0) {}
+  ~RecorderData() { if ( queue.ringSize > 0 ) delete [] queue.ring; }
+};
+
+// Make room for nBytes more bytes at the end of the log.
+static bool logReserve( RecorderData *data, size_t nBytes )
+{
+  size_t size = data->file.size;
+  if ( data->end + nBytes <= size ) return true;
+  while ( size < data->end + nBytes ) size += logGrowSize;
+  return data->file.map( size, true );
+}
+
+static void logAppend( RecorderData *data, double time, const unsigned char *message, size_t size )
+{
+  size_t recordSize = logRecordSize( size );
+  if ( data->failed || !logReserve( data, recordSize ) ) {
+    data->failed = true;
+    data->dropped.fetch_add( 1, std::memory_order_relaxed );
+    return;
+  }
+
+  uint64_t nanoseconds = (uint64_t) ( time * 1000000000.0 + 0.5 );
+  unsigned long long count = data->recorded.load( std::memory_order_relaxed );
+  if ( count % logIndexInterval == 0 ) {
+    LogIndexEntry entry = { nanoseconds, (uint64_t) data->end };
+    data->index.push_back( entry );
+  }
+
+  LogRecord *record = (LogRecord *) ( data->file.base + data->end );
+  record->time = nanoseconds;
+  record->size = (uint32_t) size;
+  record->reserved = 0;
+  unsigned char *bytes = (unsigned char *) ( record + 1 );
+  memcpy( bytes, message, size );
+  memset( bytes + size, 0, recordSize - sizeof(LogRecord) - size );
+  data->end += recordSize;
+  data->recorded.store( count + 1, std::memory_order_relaxed );
+}
+
+// The writer thread wakes every few milliseconds and moves all
+// queued messages into the log.  The header is brought up to date
+// after each batch, so that the log can be read up to there even if
+// it is never closed.
+static void recorderWriter( RecorderData *data )
+{
+  std::vector<unsigned char> buffer( data->queue.ringSize );
+  std::vector<RtMidiIn::MessageRecord> records( 256 );
+  bool done = false;
+
+  while ( !done ) {
+    // The flag is read before the queue is drained, so the messages
+    // queued before close() cleared it are always written.
+    done = !data->writing.load( std::memory_order_acquire );
+
+    unsigned int nMessages;
+    while ( ( nMessages = data->queue.popAll( &buffer[0], buffer.size(), &records[0], records.size() ) ) > 0 ) {
+      for ( unsigned int i=0; i<nMessages; i++ )
+        logAppend( data, records[i].timeStamp, &buffer[records[i].offset], records[i].size );
+      if ( !data->failed ) {
+        LogHeader *header = (LogHeader *) data->file.base;
+        header->messageCount = data->recorded.load( std::memory_order_relaxed );
+        header->dataEnd = data->end;
+      }
+    }
+
+    if ( !done ) std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+  }
+}
+
+RtMidiRecorder :: RtMidiRecorder( void )
+{
+  data_ = (void *) new RecorderData;
+}
+
+RtMidiRecorder :: ~RtMidiRecorder( void )
+{
+  try {
+    close();
+  }
+  catch ( RtMidiError & ) {
+  }
+  delete (RecorderData *) data_;
+}
+
+void RtMidiRecorder :: open( const std::string &fileName, unsigned int queueSize )
+{
+  RecorderData *data = (RecorderData *) data_;
+  if ( isOpen() )
+    throw RtMidiError( "RtMidiRecorder::open: a log is already open!", RtMidiError::INVALID_USE );
+
+  if ( !data->file.create( fileName ) || !data->file.map( logGrowSize, true ) ) {
+    data->file.close( 0, true );
+    throw RtMidiError( "RtMidiRecorder::open: unable to create the log file " + fileName + ".", RtMidiError::SYSTEM_ERROR );
+  }
+
+  LogHeader *header = (LogHeader *) data->file.base;
+  memset( header, 0, sizeof(LogHeader) );
+  memcpy( header->magic, logMagic, sizeof(logMagic) );
+  header->version = logVersion;
+  header->headerSize = sizeof(LogHeader);
+  header->dataEnd = sizeof(LogHeader);
+  header->indexInterval = logIndexInterval;
+
+  if ( queueSize < 1024 ) queueSize = 1024;
+  if ( data->queue.ringSize > 0 ) delete [] data->queue.ring;
+  data->queue.allocate( queueSize );
+
+  data->fileName = fileName;
+  data->end = sizeof(LogHeader);
+  data->index.clear();
+  data->failed = false;
+  data->firstMessage = true;
+  data->time = 0.0;
+  data->recorded.store( 0 );
+  data->dropped.store( 0 );
+  data->writing.store( true );
+  data->writer = std::thread( recorderWriter, data );
+  data->recording.store( true );
+}
+
+void RtMidiRecorder :: close( void )
+{
+  RecorderData *data = (RecorderData *) data_;
+  if ( !isOpen() ) return;
+
+  // Once recording is cleared, a record() call that has not yet
+  // announced itself does nothing, so only the calls already counted
+  // have to finish before the queue is drained for the last time.
+  data->recording.store( false );
+  while ( data->callers.load() > 0 ) std::this_thread::yield();
+  data->writing.store( false, std::memory_order_release );
+  data->writer.join();
+
+  size_t indexSize = data->index.size() * sizeof(LogIndexEntry);
+  size_t end = data->end;
+  if ( !data->failed && logReserve( data, indexSize ) ) {
+    LogHeader *header = (LogHeader *) data->file.base;
+    if ( indexSize > 0 ) memcpy( data->file.base + data->end, &data->index[0], indexSize );
+    header->indexOffset = data->end;
+    header->indexCount = data->index.size();
+    end += indexSize;
+  }
+  bool closed = data->file.close( end, true );
+
+  if ( data->failed || !closed )
+    throw RtMidiError( "RtMidiRecorder::close: error writing the log file " + data->fileName + ", messages may have been lost.", RtMidiError::SYSTEM_ERROR );
+}
+
+bool RtMidiRecorder :: isOpen( void ) const
+{
+  return ( (RecorderData *) data_ )->recording.load();
+}
+
+bool RtMidiRecorder :: record( double deltaTime, const unsigned char *message, size_t size )
+{
+  RecorderData *data = (RecorderData *) data_;
+  bool ok = false;
+
+  // Announce the call before testing the flag, so that close() either
+  // waits for this call or this call sees the flag cleared.
+  data->callers.fetch_add( 1 );
+  if ( data->recording.load() ) {
+    if ( data->firstMessage ) data->firstMessage = false;
+    else data->time += deltaTime;
+    ok = size > 0 && data->queue.push( message, (unsigned int) size, data->time );
+    if ( !ok ) data->dropped.fetch_add( 1, std::memory_order_relaxed );
+  }
+  data->callers.fetch_sub( 1 );
+
+  return ok;
+}
+
+unsigned long long RtMidiRecorder :: getRecordedCount( void ) const
+{
+  return ( (RecorderData *) data_ )->recorded.load( std::memory_order_relaxed );
+}
+
+unsigned long long RtMidiRecorder :: getDroppedCount( void ) const
+{
+  return ( (RecorderData *) data_ )->dropped.load( std::memory_order_relaxed );
+}
+
+// The LogData structure holds the private data of a log reader.  A
+// log file is read through its mapping, while a Standard MIDI File
+// is translated into a log held in memory.
+struct LogData {
+  LogFile file;
+  std::vector<unsigned char> memory;
+  const unsigned char *base;
+  size_t size;
+  size_t begin;
+  size_t end;
+  size_t position;
+  unsigned long long messageCount;
+  uint64_t lastTime;
+  std::vector<LogIndexEntry> index;
+
+  // Default constructor.
+LogData()
+: base(0), size(0), begin(0), end(0), position(0), messageCount(0), lastTime(0) {}
+};
+
+// An event read from a Standard MIDI File.  Events are put in time
+// order across tracks, keeping the file order of events at the same
+// tick.  For tempo changes, size holds the tempo.
+struct SmfEvent {
+  uint64_t tick;
+  unsigned int order;
+  size_t offset;
+  size_t size;
+
+  bool operator<( const SmfEvent &other ) const
+  { return tick < other.tick || ( tick == other.tick && order < other.order ); }
+};
+
+static uint32_t smfReadValue( const unsigned char *bytes, unsigned int nBytes )
+{
+  uint32_t value = 0;
+  while ( nBytes-- ) value = ( value << 8 ) | *bytes++;
+  return value;
+}
+
+static bool smfReadVarLen( const unsigned char *&bytes, const unsigned char *end, uint32_t *value )
+{
+  *value = 0;
+  for ( unsigned int i=0; i<4 && bytes < end; i++ ) {
+    unsigned char byte = *bytes++;
+    *value = ( *value << 7 ) | ( byte & 0x7F );
+    if ( ( byte & 0x80 ) == 0 ) return true;
+  }
+  return false;
+}
+
+// Translate a Standard MIDI File of any format into a log.  Reading
+// stops at the first malformed event of a track, so that as much of
+// a damaged file as possible is kept.  Returns false if the file
+// header is not sound.
+static bool smfToLog( const unsigned char *smf, size_t size, std::vector<unsigned char> &log )
+{
+  if ( size < 14 ) return false;
+  uint32_t headerLength = smfReadValue( smf + 4, 4 );
+  unsigned int nTracks = smfReadValue( smf + 10, 2 );
+  unsigned int division = smfReadValue( smf + 12, 2 );
+  if ( headerLength < 6 || headerLength > size - 8 || ( division & 0x7FFF ) == 0 ) return false;
+
+  std::vector<unsigned char> bytes;
+  std::vector<SmfEvent> events, tempos;
+  const unsigned char *chunk = smf + 8 + headerLength, *fileEnd = smf + size;
+  unsigned int order = 0;
+
+  for ( unsigned int track=0; track<nTracks && fileEnd - chunk >= 8; ) {
+    const unsigned char *p = chunk + 8;
+    size_t length = std::min( (size_t) smfReadValue( chunk + 4, 4 ), (size_t) ( fileEnd - p ) );
+    const unsigned char *end = p + length;
+    bool isTrack = memcmp( chunk, "MTrk", 4 ) == 0;
+    chunk = end;
+    if ( !isTrack ) continue;
+    track++;
+
+    uint64_t tick = 0;
+    unsigned char status = 0;
+    uint32_t value;
+    while ( p < end && smfReadVarLen( p, end, &value ) && p < end ) {
+      tick += value;
+      unsigned char byte = *p;
+      if ( byte == 0xFF ) {
+        // Meta events: only tempo changes and the end of the track
+        // matter here.
+        if ( end - p < 2 ) break;
+        unsigned char type = p[1];
+        p += 2;
+        if ( !smfReadVarLen( p, end, &value ) || value > (size_t) ( end - p ) ) break;
+        if ( type == 0x51 && value == 3 ) {
+          SmfEvent tempo = { tick, order++, 0, smfReadValue( p, 3 ) };
+          tempos.push_back( tempo );
+        }
+        p += value;
+        status = 0;
+        if ( type == 0x2F ) break;
+      }
+      else if ( byte == 0xF0 || byte == 0xF7 ) {
+        // A sysex event omits the leading 0xF0, an escape gives the
+        // bytes as they are.
+        p++;
+        if ( !smfReadVarLen( p, end, &value ) || value > (size_t) ( end - p ) ) break;
+        SmfEvent event = { tick, order++, bytes.size(), 0 };
+        if ( byte == 0xF0 ) bytes.push_back( 0xF0 );
+        bytes.insert( bytes.end(), p, p + value );
+        event.size = bytes.size() - event.offset;
+        if ( event.size > 0 ) events.push_back( event );
+        p += value;
+        status = 0;
+      }
+      else {
+        if ( byte & 0x80 ) {
+          if ( byte > 0xF0 ) break;
+          status = byte;
+          p++;
+        }
+        else if ( status == 0 ) break;
+        unsigned int nData = ( ( status & 0xE0 ) == 0xC0 ) ? 1 : 2;
+        if ( (size_t) ( end - p ) < nData ) break;
+        SmfEvent event = { tick, order++, bytes.size(), nData + 1 };
+        bytes.push_back( status );
+        bytes.insert( bytes.end(), p, p + nData );
+        events.push_back( event );
+        p += nData;
+      }
+    }
+  }
+
+  std::sort( events.begin(), events.end() );
+  std::sort( tempos.begin(), tempos.end() );
+
+  // Ticks have a fixed length with SMPTE time, otherwise the length
+  // follows the tempo map, which starts at 120 beats per minute.
+  double nanosecondsPerTick;
+  if ( division & 0x8000 ) {
+    int framesPerSecond = 256 - ( division >> 8 );
+    double frameRate = ( framesPerSecond == 29 ) ? 29.97 : framesPerSecond;
+    nanosecondsPerTick = 1000000000.0 / ( frameRate * ( division & 0xFF ) );
+    tempos.clear();
+  }
+  else nanosecondsPerTick = 500000.0 * 1000.0 / division;
+
+  size_t logSize = sizeof(LogHeader);
+  for ( size_t i=0; i<events.size(); i++ ) logSize += logRecordSize( events[i].size );
+  log.assign( logSize, 0 );
+  LogHeader *header = (LogHeader *) &log[0];
+  memcpy( header->magic, logMagic, sizeof(logMagic) );
+  header->version = logVersion;
+  header->headerSize = sizeof(LogHeader);
+  header->dataEnd = logSize;
+  header->messageCount = events.size();
+  header->indexInterval = logIndexInterval;
+
+  uint64_t segmentTick = 0;
+  double segmentTime = 0.0;
+  size_t offset = sizeof(LogHeader), nextTempo = 0;
+  for ( size_t i=0; i<events.size(); i++ ) {
+    while ( nextTempo < tempos.size() && tempos[nextTempo].tick <= events[i].tick ) {
+      segmentTime += ( tempos[nextTempo].tick - segmentTick ) * nanosecondsPerTick;
+      segmentTick = tempos[nextTempo].tick;
+      nanosecondsPerTick = tempos[nextTempo].size * 1000.0 / division;
+      nextTempo++;
+    }
+    LogRecord *record = (LogRecord *) &log[offset];
+    record->time = (uint64_t) ( segmentTime + ( events[i].tick - segmentTick ) * nanosecondsPerTick + 0.5 );
+    record->size = (uint32_t) events[i].size;
+    memcpy( record + 1, &bytes[events[i].offset], events[i].size );
+    offset += logRecordSize( events[i].size );
+  }
+
+  return true;
+}
+
+RtMidiLog :: RtMidiLog( void )
+{
+  data_ = (void *) new LogData;
+}
+
+RtMidiLog :: ~RtMidiLog( void )
+{
+  close();
+  delete (LogData *) data_;
+}
+
+void RtMidiLog :: open( const std::string &fileName )
+{
+  LogData *data = (LogData *) data_;
+  close();
+
+  if ( !data->file.openRead( fileName ) ) {
+    data->file.close( 0, false );
+    throw RtMidiError( "RtMidiLog::open: unable to read the file " + fileName + ".", RtMidiError::SYSTEM_ERROR );
+  }
+  data->base = data->file.base;
+  data->size = data->file.size;
+
+  if ( data->size >= 4 && memcmp( data->base, "MThd", 4 ) == 0 ) {
+    if ( !smfToLog( data->base, data->size, data->memory ) ) {
+      close();
+      throw RtMidiError( "RtMidiLog::open: " + fileName + " is not a valid Standard MIDI File.", RtMidiError::INVALID_PARAMETER );
+    }
+    data->file.close( 0, false );
+    data->base = &data->memory[0];
+    data->size = data->memory.size();
+  }
+
+  const LogHeader *header = (const LogHeader *) data->base;
+  if ( data->size < sizeof(LogHeader) || memcmp( header->magic, logMagic, sizeof(logMagic) ) != 0 ||
+       header->version != logVersion || header->headerSize < sizeof(LogHeader) ||
+       header->headerSize > header->dataEnd || header->headerSize > data->size ) {
+    close();
+    throw RtMidiError( "RtMidiLog::open: " + fileName + " is not an RtMidi log or a Standard MIDI File.", RtMidiError::INVALID_PARAMETER );
+  }
+
+  // A log cut short, for example by a full disk, is read as far as
+  // it goes.
+  data->begin = header->headerSize;
+  data->end = std::min( (size_t) header->dataEnd, data->size );
+
+  // Use the index written when the recorder was closed if it is
+  // sound.  The records after its last entry are always scanned to
+  // find the message count and the duration, and without an index
+  // the whole log is scanned to build one.
+  size_t offset = data->begin;
+  unsigned long long count = 0;
+  bool indexed = false;
+  if ( header->indexInterval == logIndexInterval && header->indexCount > 0 &&
+       header->indexOffset >= data->end && header->indexOffset <= data->size &&
+       header->indexCount <= ( data->size - header->indexOffset ) / sizeof(LogIndexEntry) ) {
+    const LogIndexEntry *entries = (const LogIndexEntry *) ( data->base + header->indexOffset );
+    const LogIndexEntry &last = entries[header->indexCount - 1];
+    if ( entries[0].offset == data->begin && last.offset >= data->begin && last.offset < data->end ) {
+      data->index.assign( entries, entries + header->indexCount );
+      offset = last.offset;
+      count = ( header->indexCount - 1 ) * (unsigned long long) logIndexInterval;
+      indexed = true;
+    }
+  }
+
+  while ( offset + sizeof(LogRecord) <= data->end ) {
+    const LogRecord *record = (const LogRecord *) ( data->base + offset );
+    size_t recordSize = logRecordSize( record->size );
+    if ( recordSize > data->end - offset ) break;
+    if ( !indexed && count % logIndexInterval == 0 ) {
+      LogIndexEntry entry = { record->time, (uint64_t) offset };
+      data->index.push_back( entry );
+    }
+    data->lastTime = record->time;
+    count++;
+    offset += recordSize;
+  }
+
+  // A record cut short at the end of the log is left out.
+  data->end = offset;
+  data->messageCount = count;
+  data->position = data->begin;
+}
+
+void RtMidiLog :: close( void )
+{
+  LogData *data = (LogData *) data_;
+  data->file.close( 0, false );
+  std::vector<unsigned char>().swap( data->memory );
+  data->base = 0;
+  data->size = 0;
+  data->index.clear();
+  data->begin = data->end = data->position = 0;
+  data->messageCount = 0;
+  data->lastTime = 0;
+}
+
+bool RtMidiLog :: isOpen( void ) const
+{
+  return ( (LogData *) data_ )->base != 0;
+}
+
+unsigned long long RtMidiLog :: getMessageCount( void ) const
+{
+  return ( (LogData *) data_ )->messageCount;
+}
+
+double RtMidiLog :: getDuration( void ) const
+{
+  return ( (LogData *) data_ )->lastTime * 0.000000001;
+}
+
+void RtMidiLog :: seek( double time )
+{
+  LogData *data = (LogData *) data_;
+  uint64_t target = time > 0.0 ? (uint64_t) ( time * 1000000000.0 + 0.5 ) : 0;
+
+  // Start from the last index entry before the target time, so that
+  // no message at the target time is skipped, then scan forward.
+  data->position = data->begin;
+  for ( size_t low=0, high=data->index.size(); low < high; ) {
+    size_t middle = ( low + high ) / 2;
+    if ( data->index[middle].time < target ) {
+      data->position = data->index[middle].offset;
+      low = middle + 1;
+    }
+    else high = middle;
+  }
+
+  while ( data->position < data->end ) {
+    const LogRecord *record = (const LogRecord *) ( data->base + data->position );
+    if ( record->time >= target ) break;
+    data->position += logRecordSize( record->size );
+  }
+}
+
+bool RtMidiLog :: next( double *time, const unsigned char **message, size_t *size )
+{
+  LogData *data = (LogData *) data_;
+  if ( data->position >= data->end ) return false;
+
+  const LogRecord *record = (const LogRecord *) ( data->base + data->position );
+  *time = record->time * 0.000000001;
+  *message = (const unsigned char *) ( record + 1 );
+  *size = record->size;
+  data->position += logRecordSize( record->size );
+  return true;
+}
+
+// The Standard MIDI File is written at 60 beats per minute with
+// 10000 ticks per beat, so that one tick is 100 microseconds.
+static const unsigned int smfDivision = 10000;
+static const unsigned int smfTempo = 1000000;
+static const uint64_t smfNanosecondsPerTick = 100000;
+
+static void smfWriteValue( std::vector<unsigned char> &track, uint32_t value, unsigned int nBytes )
+{
+  while ( nBytes-- ) track.push_back( ( value >> ( 8 * nBytes ) ) & 0xFF );
+}
+
+static void smfWriteVarLen( std::vector<unsigned char> &track, uint32_t value )
+{
+  unsigned char bytes[4];
+  unsigned int n = 0;
+  do {
+    bytes[n++] = value & 0x7F;
+    value >>= 7;
+  } while ( value && n < 4 );
+  while ( n-- ) track.push_back( bytes[n] | ( n ? 0x80 : 0 ) );
+}
+
+void RtMidiLog :: writeSmf( const std::string &fileName )
+{
+  LogData *data = (LogData *) data_;
+  if ( !isOpen() )
+    throw RtMidiError( "RtMidiLog::writeSmf: no log is open!", RtMidiError::INVALID_USE );
+
+  std::vector<unsigned char> track;
+  track.reserve( 32 + data->messageCount * 4 );
+
+  // Set the tempo at the start of the track.
+  const unsigned char tempo[] = { 0x00, 0xFF, 0x51, 0x03 };
+  track.insert( track.end(), tempo, tempo + sizeof(tempo) );
+  smfWriteValue( track, smfTempo, 3 );
+
+  uint64_t lastTick = 0;
+  for ( size_t offset = data->begin; offset < data->end; ) {
+    const LogRecord *record = (const LogRecord *) ( data->base + offset );
+    const unsigned char *message = (const unsigned char *) ( record + 1 );
+    size_t size = record->size;
+    offset += logRecordSize( size );
+    if ( size == 0 || message[0] < 0x80 ) continue;
+
+    uint64_t tick = ( record->time + smfNanosecondsPerTick / 2 ) / smfNanosecondsPerTick;
+    uint64_t delta = tick - lastTick;
+    lastTick = tick;
+    // Gaps longer than a delta-time can express are bridged with
+    // empty text events.
+    while ( delta > 0x0FFFFFFF ) {
+      smfWriteVarLen( track, 0x0FFFFFFF );
+      track.push_back( 0xFF );
+      track.push_back( 0x01 );
+      track.push_back( 0x00 );
+      delta -= 0x0FFFFFFF;
+    }
+    smfWriteVarLen( track, (uint32_t) delta );
+
+    if ( message[0] == 0xF0 ) {
+      // A sysex event gives the length of the bytes after 0xF0.
+      track.push_back( 0xF0 );
+      smfWriteVarLen( track, (uint32_t) ( size - 1 ) );
+      track.insert( track.end(), message + 1, message + size );
+    }
+    else if ( message[0] > 0xF0 ) {
+      // Other system messages have no event of their own and are
+      // written as escaped bytes.
+      track.push_back( 0xF7 );
+      smfWriteVarLen( track, (uint32_t) size );
+      track.insert( track.end(), message, message + size );
+    }
+    else
+      track.insert( track.end(), message, message + size );
+  }
+
+  const unsigned char endOfTrack[] = { 0x00, 0xFF, 0x2F, 0x00 };
+  track.insert( track.end(), endOfTrack, endOfTrack + sizeof(endOfTrack) );
+
+  std::vector<unsigned char> head;
+  const unsigned char mthd[] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1 };
+  head.insert( head.end(), mthd, mthd + sizeof(mthd) );
+  smfWriteValue( head, smfDivision, 2 );
+  const unsigned char mtrk[] = { 'M', 'T', 'r', 'k' };
+  head.insert( head.end(), mtrk, mtrk + sizeof(mtrk) );
+  smfWriteValue( head, (uint32_t) track.size(), 4 );
+
+  std::ofstream file( fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+  file.write( (const char *) &head[0], head.size() );
+  file.write( (const char *) &track[0], track.size() );
+  file.close();
+  if ( !file )
+    throw RtMidiError( "RtMidiLog::writeSmf: unable to write the file " + fileName + ".", RtMidiError::SYSTEM_ERROR );
+}
+
+//*********************************************************************//
+//  RtMidiPlayer Definitions
+//*********************************************************************//
+
+#if defined(__linux__)
+#include <errno.h>
+#include <time.h>
+#endif
+
+// Read the monotonic clock, in nanoseconds.
+static uint64_t playerNow( void )
+{
+#if defined(__linux__)
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+
+// Sleep until the monotonic clock reaches deadline.
+static void playerSleepUntil( uint64_t deadline )
+{
+#if defined(__linux__)
+  struct timespec ts;
+  ts.tv_sec = deadline / 1000000000;
+  ts.tv_nsec = deadline % 1000000000;
+  while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR ) {}
+#else
+  std::chrono::nanoseconds time( deadline );
+  std::this_thread::sleep_until( std::chrono::steady_clock::time_point( std::chrono::duration_cast<std::chrono::steady_clock::duration>( time ) ) );
+#endif
+}
+
+// The longest the player sleeps before checking whether it has been
+// stopped, in nanoseconds.
+static const uint64_t playerMaxSleep = 20000000;
+
+// The PlayerData structure holds the private data of a player.  The
+// log is only used by the thread of the player while it runs.
+struct PlayerData {
+  RtMidiLog log;
+  RtMidiOut *output;
+  RtMidiPlayer::RtMidiPlayerCallback callback;
+  void *userData;
+  RtMidiPlayer::Mode mode;
+  double speed;
+  double from;
+  std::thread thread;
+  std::atomic<bool> playing;
+  std::atomic<bool> stopping;
+  std::atomic<unsigned long long> played;
+  std::atomic<unsigned long long> maxLateness;
+
+  // Default constructor.
+PlayerData()
+: output(0), callback(0), userData(0), mode(RtMidiPlayer::REAL_TIME), speed(1.0), from(0.0),
+    playing(false), stopping(false), played(0), maxLateness(0) {}
+};
+
+static void playerThread( PlayerData *data )
+{
+  double time, scale = ( data->mode == RtMidiPlayer::SCALED ) ? 1.0 / data->speed : 1.0;
+  const unsigned char *message;
+  size_t size;
+
+  data->log.seek( data->from );
+  uint64_t start = playerNow();
+  while ( !data->stopping.load( std::memory_order_acquire ) && data->log.next( &time, &message, &size ) ) {
+    if ( data->mode != RtMidiPlayer::AS_FAST_AS_POSSIBLE ) {
+      // Each deadline is reckoned from the start of the replay, so
+      // that lateness does not accumulate from one message to the
+      // next.
+      double offset = ( time - data->from ) * scale;
+      uint64_t deadline = start + (uint64_t) ( ( offset > 0.0 ? offset : 0.0 ) * 1000000000.0 + 0.5 );
+      uint64_t now = playerNow();
+      while ( now < deadline && !data->stopping.load( std::memory_order_acquire ) ) {
+        playerSleepUntil( std::min( deadline, now + playerMaxSleep ) );
+        now = playerNow();
+      }
+      if ( now < deadline ) break;
+      if ( now - deadline > data->maxLateness.load( std::memory_order_relaxed ) )
+        data->maxLateness.store( now - deadline, std::memory_order_relaxed );
+    }
+
+    if ( data->output ) data->output->sendMessage( message, size );
+    if ( data->callback ) data->callback( time, message, size, data->userData );
+    data->played.fetch_add( 1, std::memory_order_relaxed );
+  }
+
+  data->playing.store( false, std::memory_order_release );
+}
+
+RtMidiPlayer :: RtMidiPlayer( void )
+{
+  data_ = (void *) new PlayerData;
+}
+
+RtMidiPlayer :: ~RtMidiPlayer( void )
+{
+  stop();
+  delete (PlayerData *) data_;
+}
+
+void RtMidiPlayer :: open( const std::string &fileName )
+{
+  stop();
+  ( (PlayerData *) data_ )->log.open( fileName );
+}
+
+void RtMidiPlayer :: close( void )
+{
+  stop();
+  ( (PlayerData *) data_ )->log.close();
+}
+
+bool RtMidiPlayer :: isOpen( void ) const
+{
+  return ( (PlayerData *) data_ )->log.isOpen();
+}
+
+void RtMidiPlayer :: setOutput( RtMidiOut *midiout )
+{
+  ( (PlayerData *) data_ )->output = midiout;
+}
+
+void RtMidiPlayer :: setCallback( RtMidiPlayerCallback callback, void *userData )
+{
+  PlayerData *data = (PlayerData *) data_;
+  data->callback = callback;
+  data->userData = userData;
+}
+
+void RtMidiPlayer :: start( Mode mode, double speed, double from )
+{
+  PlayerData *data = (PlayerData *) data_;
+  if ( !data->log.isOpen() )
+    throw RtMidiError( "RtMidiPlayer::start: no file is open!", RtMidiError::INVALID_USE );
+  if ( mode == SCALED && !( speed > 0.0 ) )
+    throw RtMidiError( "RtMidiPlayer::start: the speed must be greater than zero!", RtMidiError::INVALID_PARAMETER );
+
+  stop();
+  data->mode = mode;
+  data->speed = speed;
+  data->from = from;
+  data->played.store( 0 );
+  data->maxLateness.store( 0 );
+  data->stopping.store( false );
+  data->playing.store( true );
+  data->thread = std::thread( playerThread, data );
+}
+
+void RtMidiPlayer :: stop( void )
+{
+  PlayerData *data = (PlayerData *) data_;
+  if ( !data->thread.joinable() ) return;
+  data->stopping.store( true, std::memory_order_release );
+  data->thread.join();
+}
+
+bool RtMidiPlayer :: isPlaying( void ) const
+{
+  return ( (PlayerData *) data_ )->playing.load( std::memory_order_acquire );
+}
+
+double RtMidiPlayer :: getDuration( void ) const
+{
+  return ( (PlayerData *) data_ )->log.getDuration();
+}
+
+unsigned long long RtMidiPlayer :: getPlayedCount( void ) const
 {
+  return ( (PlayerData *) data_ )->played.load( std::memory_order_relaxed );
 }
 
-MidiOutApi :: ~MidiOutApi( void )
+double RtMidiPlayer :: getMaxLateness( void ) const
 {
+  return ( (PlayerData *) data_ )->maxLateness.load( std::memory_order_relaxed ) * 0.000000001;
 }
 
 // *************************************************** //
@@ -406,7 +2748,7 @@ static void midiInputCallback( const MIDIPacketList *list, void *procRef, void *
   unsigned long long time;
 
   bool& continueSysex = data->continueSysex;
-  MidiInApi::MidiMessage& message = data->message;
+  RtMidiMessage& message = data->message;
 
   const MIDIPacket *packet = &list->packet[0];
   for ( unsigned int i=0; i<list->numPackets; ++i ) {
@@ -451,28 +2793,15 @@ static void midiInputCallback( const MIDIPacketList *list, void *procRef, void *
       if ( !( data->ignoreFlags & 0x01 ) ) {
         // If we're not ignoring sysex messages, copy the entire packet.
         for ( unsigned int j=0; j<nBytes; ++j )
-          message.bytes.push_back( packet->data[j] );
+          message.push_back( packet->data[j] );
       }
       continueSysex = packet->data[nBytes-1] != 0xF7;
 
       if ( !( data->ignoreFlags & 0x01 ) && !continueSysex ) {
         // If not a continuing sysex message, invoke the user callback function or queue the message.
-        if ( data->usingCallback ) {
-          RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-          callback( message.timeStamp, &message.bytes, data->userData );
-        }
-        else {
-          // As long as we haven't reached our queue size limit, push the message.
-          if ( data->queue.size < data->queue.ringSize ) {
-            data->queue.ring[data->queue.back++] = message;
-            if ( data->queue.back == data->queue.ringSize )
-              data->queue.back = 0;
-            data->queue.size++;
-          }
-          else
-            std::cerr << "\nMidiInCore: message queue limit reached!!\n\n";
-        }
-        message.bytes.clear();
+        if ( !MidiInApi::deliverMessage( data, message.timeStamp, message.data(), message.size() ) )
+          data->errors.report( RtMidiErrorEvent::QUEUE_FULL, "MidiInCore: message queue limit reached!!" );
+        message.clear();
       }
     }
     else {
@@ -516,27 +2845,17 @@ static void midiInputCallback( const MIDIPacketList *list, void *procRef, void *
         }
         else size = 1;
 
-        // Copy the MIDI data to our vector.
         if ( size ) {
-          message.bytes.assign( &packet->data[iByte], &packet->data[iByte+size] );
           if ( !continueSysex ) {
-            // If not a continuing sysex message, invoke the user callback function or queue the message.
-            if ( data->usingCallback ) {
-              RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-              callback( message.timeStamp, &message.bytes, data->userData );
-            }
-            else {
-              // As long as we haven't reached our queue size limit, push the message.
-              if ( data->queue.size < data->queue.ringSize ) {
-                data->queue.ring[data->queue.back++] = message;
-                if ( data->queue.back == data->queue.ringSize )
-                  data->queue.back = 0;
-                data->queue.size++;
-              }
-              else
-                std::cerr << "\nMidiInCore: message queue limit reached!!\n\n";
-            }
-            message.bytes.clear();
+            // If not a continuing sysex message, invoke the user callback function or queue the message
+            // straight from the packet data.
+            if ( !MidiInApi::deliverMessage( data, message.timeStamp, &packet->data[iByte], size ) )
+              data->errors.report( RtMidiErrorEvent::QUEUE_FULL, "MidiInCore: message queue limit reached!!" );
+            message.clear();
+          }
+          else {
+            // Copy the start of a segmented sysex to our vector.
+            message.assign( &packet->data[iByte], size );
           }
           iByte += size;
         }
@@ -989,11 +3308,11 @@ void MidiOutCore :: openVirtualPort( std::string portName )
 //  free( sreq );
 //}
 
-void MidiOutCore :: sendMessage( std::vector<unsigned char> *message )
+void MidiOutCore :: sendMessage( const unsigned char *message, size_t size )
 {
   // We use the MIDISendSysex() function to asynchronously send sysex
   // messages.  Otherwise, we use a single CoreMidi MIDIPacket.
-  unsigned int nBytes = message->size();
+  unsigned int nBytes = size;
   if ( nBytes == 0 ) {
     errorString_ = "MidiOutCore::sendMessage: no data in message argument!";      
     error( RtMidiError::WARNING, errorString_ );
@@ -1011,7 +3330,7 @@ void MidiOutCore :: sendMessage( std::vector<unsigned char> *message )
     // messages through the normal mechanism.  In addition, this avoids
     // the problem of virtual ports not receiving sysex messages.
 
-  if ( message->at(0) == 0xF0 ) {
+  if ( message[0] == 0xF0 ) {
 
     // Apple's fantastic API requires us to free the allocated data in
     // the completion callback but trashes the pointer and size before
@@ -1024,7 +3343,7 @@ void MidiOutCore :: sendMessage( std::vector<unsigned char> *message )
     char * sysexBuffer = ((char *) newRequest) + sizeof(struct MIDISysexSendRequest);
 
     // Copy data to buffer.
-    for ( unsigned int i=0; i<nBytes; ++i ) sysexBuffer[i] = message->at(i);
+    for ( unsigned int i=0; i<nBytes; ++i ) sysexBuffer[i] = message[i];
 
     newRequest->destination = data->destinationId;
     newRequest->data = (Byte *)sysexBuffer;
@@ -1051,12 +3370,13 @@ void MidiOutCore :: sendMessage( std::vector<unsigned char> *message )
 
   MIDIPacketList packetList;
   MIDIPacket *packet = MIDIPacketListInit( &packetList );
-  packet = MIDIPacketListAdd( &packetList, sizeof(packetList), packet, timeStamp, nBytes, (const Byte *) &message->at( 0 ) );
+  packet = MIDIPacketListAdd( &packetList, sizeof(packetList), packet, timeStamp, nBytes, (const Byte *) message );
   if ( !packet ) {
     errorString_ = "MidiOutCore::sendMessage: could not allocate packet list";      
     error( RtMidiError::DRIVER_ERROR, errorString_ );
     return;
   }
+  counters_.countMessage( message, nBytes );
 
   // Send to any destinations that may have connected to us.
   if ( data->endpoint ) {
@@ -1100,7 +3420,9 @@ void MidiOutCore :: sendMessage( std::vector<unsigned char> *message )
 // associated with the ALSA sequencer queues.
 
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
+#include <sys/eventfd.h>
 
 // ALSA header file.
 #include <alsa/asoundlib.h>
@@ -1119,7 +3441,9 @@ struct AlsaMidiData {
   pthread_t dummy_thread_id;
   unsigned long long lastTime;
   int queue_id; // an input queue is needed to get timestamped events
-  int trigger_fds[2];
+  int trigger_fd; // eventfd used to wake the input thread
+  unsigned int chunkSize; // largest sysex event written on output
+  unsigned int sendTimeout; // milliseconds sendMessage() waits for room
 };
 
 #define PORT_TYPE( pinfo, bits ) ((snd_seq_port_info_get_capability(pinfo) & (bits)) == (bits))
@@ -1129,34 +3453,155 @@ struct AlsaMidiData {
 //  Class Definitions: MidiInAlsa
 //*********************************************************************//
 
+// Build the bytes of a channel-voice event straight from the event
+// data, which is much cheaper than going through the generic
+// snd_midi_event_decode() parser.  Returns the number of bytes
+// written to buffer (which must hold at least three), or 0 if the
+// event is not a channel-voice type handled here.  Define
+// RTMIDI_ALSA_GENERIC_DECODE to send every event through the generic
+// parser instead.
+static inline long alsaDecodeChannelEvent( const snd_seq_event_t *ev, unsigned char *buffer )
+{
+  int value;
+  switch ( ev->type ) {
+
+  case SND_SEQ_EVENT_NOTEON:
+    buffer[0] = 0x90 | ( ev->data.note.channel & 0x0F );
+    buffer[1] = ev->data.note.note & 0x7F;
+    buffer[2] = ev->data.note.velocity & 0x7F;
+    return 3;
+
+  case SND_SEQ_EVENT_NOTEOFF:
+    buffer[0] = 0x80 | ( ev->data.note.channel & 0x0F );
+    buffer[1] = ev->data.note.note & 0x7F;
+    buffer[2] = ev->data.note.velocity & 0x7F;
+    return 3;
+
+  case SND_SEQ_EVENT_KEYPRESS:
+    buffer[0] = 0xA0 | ( ev->data.note.channel & 0x0F );
+    buffer[1] = ev->data.note.note & 0x7F;
+    buffer[2] = ev->data.note.velocity & 0x7F;
+    return 3;
+
+  case SND_SEQ_EVENT_CONTROLLER:
+    buffer[0] = 0xB0 | ( ev->data.control.channel & 0x0F );
+    buffer[1] = ev->data.control.param & 0x7F;
+    buffer[2] = ev->data.control.value & 0x7F;
+    return 3;
+
+  case SND_SEQ_EVENT_PGMCHANGE:
+    buffer[0] = 0xC0 | ( ev->data.control.channel & 0x0F );
+    buffer[1] = ev->data.control.value & 0x7F;
+    return 2;
+
+  case SND_SEQ_EVENT_CHANPRESS:
+    buffer[0] = 0xD0 | ( ev->data.control.channel & 0x0F );
+    buffer[1] = ev->data.control.value & 0x7F;
+    return 2;
+
+  case SND_SEQ_EVENT_PITCHBEND:
+    // ALSA stores the bend centred on zero (-8192 to 8191).
+    value = ev->data.control.value + 8192;
+    buffer[0] = 0xE0 | ( ev->data.control.channel & 0x0F );
+    buffer[1] = value & 0x7F;
+    buffer[2] = ( value >> 7 ) & 0x7F;
+    return 3;
+  }
+
+  return 0;
+}
+
+// Largest number of messages gathered before they are handed on,
+// even if more events are still pending, so that a continuous stream
+// cannot delay delivery indefinitely.
+#define RTMIDI_ALSA_BATCH_SIZE 128
+
+// Hand on the messages gathered for a batch callback during one
+// wakeup of the input thread in a single call.  Should the callback
+// have been cancelled meanwhile, they are delivered one at a time.
+static void alsaFlushBatch( MidiInApi::RtMidiInData *data, std::vector<unsigned char> &bytes,
+                            std::vector<RtMidiIn::MessageRecord> &records )
+{
+  if ( data->batchCallback ) {
+    RtMidiRecorder *recorder = data->recorder.load( std::memory_order_acquire );
+    for ( unsigned int i=0; i<records.size(); i++ ) {
+      data->counters->countMessage( &bytes[records[i].offset], records[i].size );
+      if ( recorder ) recorder->record( records[i].timeStamp, &bytes[records[i].offset], records[i].size );
+    }
+    double start = statsNow();
+    data->batchCallback( &bytes[0], &records[0], records.size(), data->portTag, data->userData );
+    data->counters->countCallback( statsNow() - start );
+  }
+  else {
+    for ( unsigned int i=0; i<records.size(); i++ ) {
+      if ( !MidiInApi::deliverMessage( data, records[i].timeStamp, &bytes[records[i].offset], records[i].size ) )
+        data->errors.report( RtMidiErrorEvent::QUEUE_FULL, "MidiInAlsa: message queue limit reached!!" );
+    }
+  }
+
+  bytes.clear();
+  records.clear();
+}
+
+// Make room for nBytes more bytes after the first used bytes of the
+// input thread's decode buffer, in which segmented sysex messages are
+// also reassembled in place.  The buffer doubles in size as needed
+// and is kept for the lifetime of the port, so that it only grows
+// when a message larger than any before it arrives.
+static bool alsaReserveInput( MidiInApi::RtMidiInData *data, AlsaMidiData *apiData,
+                              unsigned int used, unsigned int nBytes )
+{
+  if ( apiData->buffer && used + nBytes <= apiData->bufferSize ) return true;
+
+  unsigned int size = apiData->bufferSize ? apiData->bufferSize : 32;
+  while ( size < used + nBytes ) size *= 2;
+  unsigned char *buffer = (unsigned char *) realloc( apiData->buffer, size );
+  if ( buffer == NULL ) return false;
+
+  if ( apiData->buffer ) data->sysexReallocations.fetch_add( 1, std::memory_order_relaxed );
+  apiData->buffer = buffer;
+  apiData->bufferSize = size;
+  return true;
+}
+
 static void *alsaMidiHandler( void *ptr )
 {
   MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
   AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
 
   long nBytes;
+  const unsigned char *bytes;
+  unsigned char *buffer;
+  unsigned int used = 0;
   unsigned long long time, lastTime;
   bool continueSysex = false;
   bool doDecode = false;
-  MidiInApi::MidiMessage message;
+  RtMidiMessage message;
+  std::vector<unsigned char> batchBytes;
+  std::vector<RtMidiIn::MessageRecord> batchRecords;
+  RtMidiIn::MessageRecord record;
   int poll_fd_count;
   struct pollfd *poll_fds;
 
+  // Reserve the batch storage up front so that typical bursts do not
+  // allocate on the input thread.
+  batchBytes.reserve( RTMIDI_ALSA_BATCH_SIZE * 3 );
+  batchRecords.reserve( RTMIDI_ALSA_BATCH_SIZE );
+
   snd_seq_event_t *ev;
   int result;
-  apiData->bufferSize = 32;
   result = snd_midi_event_new( 0, &apiData->coder );
   if ( result < 0 ) {
     data->doInput = false;
-    std::cerr << "\nMidiInAlsa::alsaMidiHandler: error initializing MIDI event parser!\n\n";
+    data->errors.report( RtMidiErrorEvent::INPUT_ERROR, "MidiInAlsa::alsaMidiHandler: error initializing MIDI event parser!" );
     return 0;
   }
-  unsigned char *buffer = (unsigned char *) malloc( apiData->bufferSize );
-  if ( buffer == NULL ) {
+  // Preallocate for the largest sysex message expected.
+  if ( !alsaReserveInput( data, apiData, 0, data->sysexSizeHint ) ) {
     data->doInput = false;
     snd_midi_event_free( apiData->coder );
     apiData->coder = 0;
-    std::cerr << "\nMidiInAlsa::alsaMidiHandler: error initializing buffer memory!\n\n";
+    data->errors.report( RtMidiErrorEvent::MEMORY_ERROR, "MidiInAlsa::alsaMidiHandler: error initializing buffer memory!" );
     return 0;
   }
   snd_midi_event_init( apiData->coder );
@@ -1165,18 +3610,22 @@ static void *alsaMidiHandler( void *ptr )
   poll_fd_count = snd_seq_poll_descriptors_count( apiData->seq, POLLIN ) + 1;
   poll_fds = (struct pollfd*)alloca( poll_fd_count * sizeof( struct pollfd ));
   snd_seq_poll_descriptors( apiData->seq, poll_fds + 1, poll_fd_count - 1, POLLIN );
-  poll_fds[0].fd = apiData->trigger_fds[0];
+  poll_fds[0].fd = apiData->trigger_fd;
   poll_fds[0].events = POLLIN;
 
   while ( data->doInput ) {
 
     if ( snd_seq_event_input_pending( apiData->seq, 1 ) == 0 ) {
+      // Every pending event has been read, so hand on what was
+      // gathered since the last wakeup before waiting again.
+      if ( !batchRecords.empty() )
+        alsaFlushBatch( data, batchBytes, batchRecords );
+
       // No data pending
       if ( poll( poll_fds, poll_fd_count, -1) >= 0 ) {
         if ( poll_fds[0].revents & POLLIN ) {
-          bool dummy;
-          int res = read( poll_fds[0].fd, &dummy, sizeof(dummy) );
-          (void) res;
+          eventfd_t value;
+          eventfd_read( poll_fds[0].fd, &value );
         }
       }
       continue;
@@ -1185,18 +3634,27 @@ static void *alsaMidiHandler( void *ptr )
     // If here, there should be data.
     result = snd_seq_event_input( apiData->seq, &ev );
     if ( result == -ENOSPC ) {
-      std::cerr << "\nMidiInAlsa::alsaMidiHandler: MIDI input buffer overrun!\n\n";
+      data->counters->overruns.fetch_add( 1, std::memory_order_relaxed );
+      data->errors.report( RtMidiErrorEvent::INPUT_OVERRUN, "MidiInAlsa::alsaMidiHandler: MIDI input buffer overrun!" );
       continue;
     }
     else if ( result <= 0 ) {
-      std::cerr << "\nMidiInAlsa::alsaMidiHandler: unknown MIDI input error!\n";
-      perror("System reports");
+      data->errors.report( RtMidiErrorEvent::INPUT_ERROR, "MidiInAlsa::alsaMidiHandler: unknown MIDI input error!" );
       continue;
     }
 
     // This is a bit weird, but we now have to decode an ALSA MIDI
     // event (back) into MIDI bytes.  We'll ignore non-MIDI types.
-    if ( !continueSysex ) message.bytes.clear();
+    // Events are decoded after any sysex segments received so far.
+    if ( !continueSysex ) used = 0;
+    if ( !alsaReserveInput( data, apiData, used, 32 ) ) {
+      data->doInput = false;
+      data->errors.report( RtMidiErrorEvent::MEMORY_ERROR, "MidiInAlsa::alsaMidiHandler: error resizing buffer memory!" );
+      snd_seq_free_event( ev );
+      break;
+    }
+    buffer = apiData->buffer + used;
+    nBytes = 0;
 
     doDecode = false;
     switch ( ev->type ) {
@@ -1232,95 +3690,155 @@ static void *alsaMidiHandler( void *ptr )
 
     case SND_SEQ_EVENT_SENSING: // Active sensing
       if ( !( data->ignoreFlags & 0x04 ) ) doDecode = true;
+      break;
+
+    case SND_SEQ_EVENT_NOTEON: // Channel-voice messages take the fast path
+    case SND_SEQ_EVENT_NOTEOFF:
+    case SND_SEQ_EVENT_KEYPRESS:
+    case SND_SEQ_EVENT_CONTROLLER:
+    case SND_SEQ_EVENT_PGMCHANGE:
+    case SND_SEQ_EVENT_CHANPRESS:
+    case SND_SEQ_EVENT_PITCHBEND:
+#if !defined(RTMIDI_ALSA_GENERIC_DECODE)
+      nBytes = alsaDecodeChannelEvent( ev, buffer );
+#else
+      doDecode = true;
+#endif
       break;
 
 		case SND_SEQ_EVENT_SYSEX:
       if ( (data->ignoreFlags & 0x01) ) break;
-      if ( ev->data.ext.len > apiData->bufferSize ) {
-        apiData->bufferSize = ev->data.ext.len;
-        free( buffer );
-        buffer = (unsigned char *) malloc( apiData->bufferSize );
-        if ( buffer == NULL ) {
-          data->doInput = false;
-          std::cerr << "\nMidiInAlsa::alsaMidiHandler: error resizing buffer memory!\n\n";
-          break;
-        }
+      if ( !alsaReserveInput( data, apiData, used, ev->data.ext.len ) ) {
+        data->doInput = false;
+        data->errors.report( RtMidiErrorEvent::MEMORY_ERROR, "MidiInAlsa::alsaMidiHandler: error resizing buffer memory!" );
+        break;
       }
+      buffer = apiData->buffer + used;
 
     default:
       doDecode = true;
     }
 
-    if ( doDecode ) {
-
-      nBytes = snd_midi_event_decode( apiData->coder, buffer, apiData->bufferSize, ev );
-      if ( nBytes > 0 ) {
-        // The ALSA sequencer has a maximum buffer size for MIDI sysex
-        // events of 256 bytes.  If a device sends sysex messages larger
-        // than this, they are segmented into 256 byte chunks.  So,
-        // we'll watch for this and concatenate sysex chunks into a
-        // single sysex message if necessary.
-        if ( !continueSysex )
-          message.bytes.assign( buffer, &buffer[nBytes] );
+    if ( doDecode )
+      nBytes = snd_midi_event_decode( apiData->coder, buffer, apiData->bufferSize - used, ev );
+
+    if ( nBytes > 0 ) {
+      // The ALSA sequencer has a maximum buffer size for MIDI sysex
+      // events of 256 bytes.  If a device sends sysex messages larger
+      // than this, they are segmented into 256 byte chunks.  So,
+      // we'll watch for this and concatenate sysex chunks into a
+      // single sysex message if necessary.  Each chunk is decoded
+      // right after the previous ones, so the message is complete in
+      // the buffer once the last chunk arrives.
+      bytes = apiData->buffer;
+      nBytes += used;
+
+      continueSysex = ( ( ev->type == SND_SEQ_EVENT_SYSEX ) && ( bytes[nBytes-1] != 0xF7 ) );
+      if ( !continueSysex ) {
+        if ( bytes[0] == 0xF0 && (unsigned int) nBytes > data->sysexPeakSize.load( std::memory_order_relaxed ) )
+          data->sysexPeakSize.store( nBytes, std::memory_order_relaxed );
+
+        // Calculate the time stamp:
+        message.timeStamp = 0.0;
+
+        // Method 1: Use the system time.
+        //(void)gettimeofday(&tv, (struct timezone *)NULL);
+        //time = (tv.tv_sec * 1000000) + tv.tv_usec;
+
+        // Method 2: Use the ALSA sequencer event time data.
+        // (thanks to Pedro Lopez-Cabanillas!).
+        time = ( ev->time.time.tv_sec * 1000000 ) + ( ev->time.time.tv_nsec/1000 );
+        lastTime = time;
+        time -= apiData->lastTime;
+        apiData->lastTime = lastTime;
+        if ( data->firstMessage == true )
+          data->firstMessage = false;
         else
-          message.bytes.insert( message.bytes.end(), buffer, &buffer[nBytes] );
-
-        continueSysex = ( ( ev->type == SND_SEQ_EVENT_SYSEX ) && ( message.bytes.back() != 0xF7 ) );
-        if ( !continueSysex ) {
-
-          // Calculate the time stamp:
-          message.timeStamp = 0.0;
-
-          // Method 1: Use the system time.
-          //(void)gettimeofday(&tv, (struct timezone *)NULL);
-          //time = (tv.tv_sec * 1000000) + tv.tv_usec;
-
-          // Method 2: Use the ALSA sequencer event time data.
-          // (thanks to Pedro Lopez-Cabanillas!).
-          time = ( ev->time.time.tv_sec * 1000000 ) + ( ev->time.time.tv_nsec/1000 );
-          lastTime = time;
-          time -= apiData->lastTime;
-          apiData->lastTime = lastTime;
-          if ( data->firstMessage == true )
-            data->firstMessage = false;
-          else
-            message.timeStamp = time * 0.000001;
-        }
-        else {
+          message.timeStamp = time * 0.000001;
+      }
+      else {
+        used = nBytes;
 #if defined(__RTMIDI_DEBUG__)
-          std::cerr << "\nMidiInAlsa::alsaMidiHandler: event parsing error or not a MIDI event!\n\n";
+        std::cerr << "\nMidiInAlsa::alsaMidiHandler: event parsing error or not a MIDI event!\n\n";
 #endif
-        }
       }
     }
 
     snd_seq_free_event( ev );
-    if ( message.bytes.size() == 0 || continueSysex ) continue;
+    if ( nBytes <= 0 || continueSysex ) continue;
 
-    if ( data->usingCallback ) {
-      RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-      callback( message.timeStamp, &message.bytes, data->userData );
-    }
-    else {
-      // As long as we haven't reached our queue size limit, push the message.
-      if ( data->queue.size < data->queue.ringSize ) {
-        data->queue.ring[data->queue.back++] = message;
-        if ( data->queue.back == data->queue.ringSize )
-          data->queue.back = 0;
-        data->queue.size++;
-      }
-      else
-        std::cerr << "\nMidiInAlsa: message queue limit reached!!\n\n";
+    // Only a batch callback waits for the rest of the wakeup.
+    if ( !data->batchCallback ) {
+      if ( !MidiInApi::deliverMessage( data, message.timeStamp, bytes, nBytes ) )
+        data->errors.report( RtMidiErrorEvent::QUEUE_FULL, "MidiInAlsa: message queue limit reached!!" );
+      continue;
     }
+
+    record.offset = batchBytes.size();
+    record.size = nBytes;
+    record.timeStamp = message.timeStamp;
+    batchBytes.insert( batchBytes.end(), bytes, bytes + nBytes );
+    batchRecords.push_back( record );
+    if ( batchRecords.size() >= RTMIDI_ALSA_BATCH_SIZE )
+      alsaFlushBatch( data, batchBytes, batchRecords );
   }
 
-  if ( buffer ) free( buffer );
+  // Hand on what was gathered before the thread was told to stop.
+  if ( !batchRecords.empty() )
+    alsaFlushBatch( data, batchBytes, batchRecords );
+
   snd_midi_event_free( apiData->coder );
   apiData->coder = 0;
   apiData->thread = apiData->dummy_thread_id;
   return 0;
 }
 
+// Start the input thread, with the SCHED_FIFO priority and CPU
+// affinity requested through RtMidiIn::setThreadScheduling(), if any.
+// Should the thread not start with those settings (typically for lack
+// of privilege), it is started with default scheduling and *degraded
+// is set.  Returns the pthread_create() result.
+static int alsaStartInputThread( AlsaMidiData *apiData, MidiInApi::RtMidiInData *data, bool *degraded )
+{
+  pthread_attr_t attr;
+  int err;
+
+  *degraded = false;
+  if ( data->threadPriority > 0 || data->threadCpu >= 0 ) {
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    if ( data->threadPriority > 0 ) {
+      struct sched_param param;
+      int maxPriority = sched_get_priority_max( SCHED_FIFO );
+      param.sched_priority = data->threadPriority < maxPriority ? data->threadPriority : maxPriority;
+      pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+      pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+      pthread_attr_setschedparam(&attr, &param);
+    }
+    else
+      pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    if ( data->threadCpu >= 0 && data->threadCpu < CPU_SETSIZE ) {
+      cpu_set_t cpus;
+      CPU_ZERO( &cpus );
+      CPU_SET( data->threadCpu, &cpus );
+      pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+
+    err = pthread_create(&apiData->thread, &attr, alsaMidiHandler, data);
+    pthread_attr_destroy(&attr);
+    if ( err == 0 ) return 0;
+    *degraded = true;
+  }
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+
+  err = pthread_create(&apiData->thread, &attr, alsaMidiHandler, data);
+  pthread_attr_destroy(&attr);
+  return err;
+}
+
 MidiInAlsa :: MidiInAlsa( const std::string clientName, unsigned int queueSizeLimit ) : MidiInApi( queueSizeLimit )
 {
   initialize( clientName );
@@ -1335,15 +3853,14 @@ MidiInAlsa :: ~MidiInAlsa()
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
   if ( inputData_.doInput ) {
     inputData_.doInput = false;
-    int res = write( data->trigger_fds[1], &inputData_.doInput, sizeof(inputData_.doInput) );
-    (void) res;
+    eventfd_write( data->trigger_fd, 1 );
     if ( !pthread_equal(data->thread, data->dummy_thread_id) )
       pthread_join( data->thread, NULL );
   }
 
   // Cleanup.
-  close ( data->trigger_fds[0] );
-  close ( data->trigger_fds[1] );
+  if ( data->trigger_fd >= 0 ) close ( data->trigger_fd );
+  if ( data->buffer ) free( data->buffer );
   if ( data->vport >= 0 ) snd_seq_delete_port( data->seq, data->vport );
 #ifndef AVOID_TIMESTAMPING
   snd_seq_free_queue( data->seq, data->queue_id );
@@ -1374,13 +3891,15 @@ void MidiInAlsa :: initialize( const std::string& clientName )
   data->subscription = 0;
   data->dummy_thread_id = pthread_self();
   data->thread = data->dummy_thread_id;
-  data->trigger_fds[0] = -1;
-  data->trigger_fds[1] = -1;
+  data->trigger_fd = -1;
+  data->buffer = 0;
+  data->bufferSize = 0;
   apiData_ = (void *) data;
   inputData_.apiData = (void *) data;
 
-   if ( pipe(data->trigger_fds) == -1 ) {
-    errorString_ = "MidiInAlsa::initialize: error creating pipe objects.";
+  data->trigger_fd = eventfd( 0, 0 );
+  if ( data->trigger_fd == -1 ) {
+    errorString_ = "MidiInAlsa::initialize: error creating eventfd object.";
     error( RtMidiError::DRIVER_ERROR, errorString_ );
     return;
   }
@@ -1551,14 +4070,9 @@ void MidiInAlsa :: openPort( unsigned int portNumber, const std::string portName
     snd_seq_drain_output( data->seq );
 #endif
     // Start our MIDI input thread.
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
-
+    bool degraded;
     inputData_.doInput = true;
-    int err = pthread_create(&data->thread, &attr, alsaMidiHandler, &inputData_);
-    pthread_attr_destroy(&attr);
+    int err = alsaStartInputThread( data, &inputData_, &degraded );
     if ( err ) {
       snd_seq_unsubscribe_port( data->seq, data->subscription );
       snd_seq_port_subscribe_free( data->subscription );
@@ -1568,6 +4082,10 @@ void MidiInAlsa :: openPort( unsigned int portNumber, const std::string portName
       error( RtMidiError::THREAD_ERROR, errorString_ );
       return;
     }
+    if ( degraded ) {
+      errorString_ = "MidiInAlsa::openPort: unable to apply the requested input thread scheduling, using the default.";
+      error( RtMidiError::WARNING, errorString_ );
+    }
   }
 
   connected_ = true;
@@ -1613,14 +4131,9 @@ void MidiInAlsa :: openVirtualPort( std::string portName )
     snd_seq_drain_output( data->seq );
 #endif
     // Start our MIDI input thread.
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
-
+    bool degraded;
     inputData_.doInput = true;
-    int err = pthread_create(&data->thread, &attr, alsaMidiHandler, &inputData_);
-    pthread_attr_destroy(&attr);
+    int err = alsaStartInputThread( data, &inputData_, &degraded );
     if ( err ) {
       if ( data->subscription ) {
         snd_seq_unsubscribe_port( data->seq, data->subscription );
@@ -1632,6 +4145,10 @@ void MidiInAlsa :: openVirtualPort( std::string portName )
       error( RtMidiError::THREAD_ERROR, errorString_ );
       return;
     }
+    if ( degraded ) {
+      errorString_ = "MidiInAlsa::openPort: unable to apply the requested input thread scheduling, using the default.";
+      error( RtMidiError::WARNING, errorString_ );
+    }
   }
 }
 
@@ -1656,8 +4173,7 @@ void MidiInAlsa :: closePort( void )
   // Stop thread to avoid triggering the callback, while the port is intended to be closed
   if ( inputData_.doInput ) {
     inputData_.doInput = false;
-    int res = write( data->trigger_fds[1], &inputData_.doInput, sizeof(inputData_.doInput) );
-    (void) res;
+    eventfd_write( data->trigger_fd, 1 );
     if ( !pthread_equal(data->thread, data->dummy_thread_id) )
       pthread_join( data->thread, NULL );
   }
@@ -1668,6 +4184,80 @@ void MidiInAlsa :: closePort( void )
 //  Class Definitions: MidiOutAlsa
 //*********************************************************************//
 
+// Default time, in milliseconds, that MidiOutAlsa::sendMessage()
+// waits for room in a full output pool before giving up.
+#if !defined(RTMIDI_ALSA_OUTPUT_TIMEOUT)
+#define RTMIDI_ALSA_OUTPUT_TIMEOUT 1000
+#endif
+
+// Tell whether the free part of the output pool can hold all the
+// events of a sysex message of nBytes.  The sequencer takes one cell
+// for each event and one more for each event's worth of its data.  A
+// message too large for even an empty pool is let through, to be
+// written as the pool drains.
+static bool alsaOutputRoom( snd_seq_t *seq, unsigned int nBytes, unsigned int chunkSize )
+{
+  snd_seq_client_pool_t *pool;
+  snd_seq_client_pool_alloca( &pool );
+  if ( snd_seq_get_client_pool( seq, pool ) < 0 ) return true;
+
+  size_t nChunks = ( nBytes + chunkSize - 1 ) / chunkSize;
+  size_t nCells = 2 * nChunks + nBytes / sizeof(snd_seq_event_t);
+  return nCells <= snd_seq_client_pool_get_output_free( pool ) ||
+    nCells > snd_seq_client_pool_get_output_pool( pool );
+}
+
+// Build the sequencer event for a complete channel-voice message
+// directly, which avoids the buffer copy and byte-by-byte parsing of
+// snd_midi_event_encode().  Returns false if the message is not a
+// channel-voice message of the expected length, in which case the
+// generic encoder is used.  Define RTMIDI_ALSA_GENERIC_ENCODE to send
+// every message but sysex through the generic encoder instead.
+static inline bool alsaEncodeChannelMessage( const unsigned char *bytes, unsigned int nBytes, snd_seq_event_t *ev )
+{
+  unsigned char channel = bytes[0] & 0x0F;
+  switch ( bytes[0] & 0xF0 ) {
+
+  case 0x80:
+    if ( nBytes != 3 ) return false;
+    snd_seq_ev_set_noteoff( ev, channel, bytes[1], bytes[2] );
+    return true;
+
+  case 0x90:
+    if ( nBytes != 3 ) return false;
+    snd_seq_ev_set_noteon( ev, channel, bytes[1], bytes[2] );
+    return true;
+
+  case 0xA0:
+    if ( nBytes != 3 ) return false;
+    snd_seq_ev_set_keypress( ev, channel, bytes[1], bytes[2] );
+    return true;
+
+  case 0xB0:
+    if ( nBytes != 3 ) return false;
+    snd_seq_ev_set_controller( ev, channel, bytes[1], bytes[2] );
+    return true;
+
+  case 0xC0:
+    if ( nBytes != 2 ) return false;
+    snd_seq_ev_set_pgmchange( ev, channel, bytes[1] );
+    return true;
+
+  case 0xD0:
+    if ( nBytes != 2 ) return false;
+    snd_seq_ev_set_chanpress( ev, channel, bytes[1] );
+    return true;
+
+  case 0xE0:
+    // ALSA stores the bend centred on zero (-8192 to 8191).
+    if ( nBytes != 3 ) return false;
+    snd_seq_ev_set_pitchbend( ev, channel, ( ( bytes[2] << 7 ) | bytes[1] ) - 8192 );
+    return true;
+  }
+
+  return false;
+}
+
 MidiOutAlsa :: MidiOutAlsa( const std::string clientName ) : MidiOutApi()
 {
   initialize( clientName );
@@ -1707,6 +4297,8 @@ void MidiOutAlsa :: initialize( const std::string& clientName )
   data->portNum = -1;
   data->vport = -1;
   data->bufferSize = 32;
+  data->chunkSize = 256;
+  data->sendTimeout = RTMIDI_ALSA_OUTPUT_TIMEOUT;
   data->coder = 0;
   data->buffer = 0;
   int result = snd_midi_event_new( data->bufferSize, &data->coder );
@@ -1854,49 +4446,223 @@ void MidiOutAlsa :: openVirtualPort( std::string portName )
   }
 }
 
-void MidiOutAlsa :: sendMessage( std::vector<unsigned char> *message )
+void MidiOutAlsa :: setSysexChunking( unsigned int chunkSize, unsigned int poolSize, unsigned int timeout )
 {
-  int result;
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  unsigned int nBytes = message->size();
-  if ( nBytes > data->bufferSize ) {
-    data->bufferSize = nBytes;
-    result = snd_midi_event_resize_buffer ( data->coder, nBytes);
-    if ( result != 0 ) {
-      errorString_ = "MidiOutAlsa::sendMessage: ALSA error resizing MIDI event buffer.";
-      error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
-    }
-    free (data->buffer);
-    data->buffer = (unsigned char *) malloc( data->bufferSize );
-    if ( data->buffer == NULL ) {
-    errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
-    error( RtMidiError::MEMORY_ERROR, errorString_ );
-    return;
-    }
+  data->chunkSize = chunkSize > 0 ? chunkSize : 256;
+  data->sendTimeout = timeout;
+  if ( poolSize > 0 && snd_seq_set_client_pool_output( data->seq, poolSize ) < 0 ) {
+    errorString_ = "MidiOutAlsa::setSysexChunking: error setting the output pool size.";
+    error( RtMidiError::WARNING, errorString_ );
   }
+}
+
+// Write as much of a message as the sequencer accepts without
+// blocking, starting at *offset and advancing it past what was sent.
+// Events are written straight to the kernel, so each one is either
+// taken whole or refused with -EAGAIN when the output pool is full.
+// Sysex messages are written in chunks that the receiver sees as one
+// continuous stream.  Unless direct is set, a short message is only
+// added to the client's output buffer, to be written with the others
+// when it is drained; sysex is always written straight away.  Returns
+// 0 once the whole message has been sent, -EAGAIN if the output is
+// congested, or another negative value after reporting an error.
+int MidiOutAlsa :: outputMessage( const unsigned char *bytes, unsigned int nBytes, unsigned int *offset, bool direct )
+{
+  int result = 0;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
 
   snd_seq_event_t ev;
   snd_seq_ev_clear(&ev);
   snd_seq_ev_set_source(&ev, data->vport);
   snd_seq_ev_set_subs(&ev);
   snd_seq_ev_set_direct(&ev);
-  for ( unsigned int i=0; i<nBytes; ++i ) data->buffer[i] = message->at(i);
-  result = snd_midi_event_encode( data->coder, data->buffer, (long)nBytes, &ev );
-  if ( result < (int)nBytes ) {
-    errorString_ = "MidiOutAlsa::sendMessage: event parsing error!";
-    error( RtMidiError::WARNING, errorString_ );
-    return;
+
+  if ( bytes[0] == 0xF0 ) {
+    // The sequencer copies the data of variable-length events when
+    // they are output, so sysex can point straight at the message.
+    while ( *offset < nBytes ) {
+      unsigned int chunk = nBytes - *offset;
+      if ( chunk > data->chunkSize ) chunk = data->chunkSize;
+      snd_seq_ev_set_sysex( &ev, chunk, (void *) ( bytes + *offset ) );
+      result = snd_seq_event_output_direct( data->seq, &ev );
+      if ( result < 0 ) break;
+      *offset += chunk;
+    }
+  }
+  else {
+    bool encoded = false;
+#if !defined(RTMIDI_ALSA_GENERIC_ENCODE)
+    encoded = alsaEncodeChannelMessage( bytes, nBytes, &ev );
+#endif
+
+    if ( !encoded ) {
+      if ( nBytes > data->bufferSize ) {
+        data->bufferSize = nBytes;
+        result = snd_midi_event_resize_buffer ( data->coder, nBytes);
+        if ( result != 0 ) {
+          errorString_ = "MidiOutAlsa::sendMessage: ALSA error resizing MIDI event buffer.";
+          error( RtMidiError::DRIVER_ERROR, errorString_ );
+          return -ENOMEM;
+        }
+        free (data->buffer);
+        data->buffer = (unsigned char *) malloc( data->bufferSize );
+        if ( data->buffer == NULL ) {
+        errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
+        error( RtMidiError::MEMORY_ERROR, errorString_ );
+        return -ENOMEM;
+        }
+      }
+
+      memcpy( data->buffer, bytes, nBytes );
+      result = snd_midi_event_encode( data->coder, data->buffer, (long)nBytes, &ev );
+      if ( result < (int)nBytes ) {
+        errorString_ = "MidiOutAlsa::sendMessage: event parsing error!";
+        error( RtMidiError::WARNING, errorString_ );
+        return -EINVAL;
+      }
+    }
+
+    // Send the event.
+    if ( direct ) result = snd_seq_event_output_direct( data->seq, &ev );
+    else result = snd_seq_event_output( data->seq, &ev );
+    if ( result >= 0 ) *offset = nBytes;
   }
 
-  // Send the event.
-  result = snd_seq_event_output(data->seq, &ev);
+  if ( result == -EAGAIN ) return result;
   if ( result < 0 ) {
     errorString_ = "MidiOutAlsa::sendMessage: error sending MIDI message to port.";
     error( RtMidiError::WARNING, errorString_ );
+    return result;
+  }
+  return 0;
+}
+
+size_t MidiOutAlsa :: trySendMessage( const unsigned char *message, size_t size, size_t offset )
+{
+  unsigned int sent = offset;
+  if ( sent < size ) {
+    outputMessage( message, size, &sent );
+    if ( sent == size ) counters_.countMessage( message, sent );
+  }
+  return sent;
+}
+
+void MidiOutAlsa :: sendMessage( const unsigned char *message, size_t size )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  unsigned int nBytes = size;
+  if ( nBytes == 0 ) {
+    errorString_ = "MidiOutAlsa::sendMessage: message argument is empty!";
+    error( RtMidiError::WARNING, errorString_ );
     return;
   }
-  snd_seq_drain_output(data->seq);
+
+  // When the output pool is full, wait for the sequencer to make room
+  // rather than failing.  A sysex message is only started once the
+  // pool can hold all of it, so that the receiver never sees it cut
+  // short: the timeout only applies while nothing has been sent, and
+  // drops the whole message.
+  int count = snd_seq_poll_descriptors_count( data->seq, POLLOUT );
+  struct pollfd *fds = (struct pollfd *) alloca( count * sizeof( struct pollfd ) );
+  snd_seq_poll_descriptors( data->seq, fds, count, POLLOUT );
+  unsigned int offset = 0;
+  double start = statsNow();
+  for ( ;; ) {
+    bool room = offset > 0 || message[0] != 0xF0 || alsaOutputRoom( data->seq, nBytes, data->chunkSize );
+    if ( room && outputMessage( message, nBytes, &offset ) != -EAGAIN ) break;
+
+    if ( offset == 0 && data->sendTimeout > 0 && statsNow() - start >= data->sendTimeout * 0.001 ) {
+      counters_.queueDrops.fetch_add( 1, std::memory_order_relaxed );
+      errorString_ = "MidiOutAlsa::sendMessage: timed out waiting for room in the output pool, message dropped!";
+      error( RtMidiError::WARNING, errorString_ );
+      return;
+    }
+
+    // The pool may already have some room, just not enough for the
+    // whole message, so poll() cannot tell when to try again.
+    if ( !room ) {
+      std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+      continue;
+    }
+    poll( fds, count, 10 );
+  }
+  if ( offset == nBytes ) counters_.countMessage( message, nBytes );
+}
+
+// Write out the events gathered in the client's output buffer,
+// waiting while the output pool is full until the deadline (zero for
+// none).  Returns 0 once they have all been written, or a negative
+// value, -EAGAIN on timeout, after which the events left are dropped.
+static int alsaDrainOutput( snd_seq_t *seq, struct pollfd *fds, int count, double deadline )
+{
+  int result;
+  while ( ( result = snd_seq_drain_output( seq ) ) != 0 ) {
+    if ( ( result < 0 && result != -EAGAIN ) ||
+         ( deadline > 0 && statsNow() >= deadline ) ) {
+      snd_seq_drop_output( seq );
+      return result < 0 ? result : -EAGAIN;
+    }
+    poll( fds, count, 10 );
+  }
+  return 0;
+}
+
+void MidiOutAlsa :: sendMessages( const unsigned char *messages, size_t size )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+
+  // Short messages are gathered in the client's output buffer, which
+  // the library writes to the sequencer in one go when it is drained
+  // or fills up.  A sysex message is sent on its own, after what was
+  // gathered before it.
+  int count = snd_seq_poll_descriptors_count( data->seq, POLLOUT );
+  struct pollfd *fds = (struct pollfd *) alloca( count * sizeof( struct pollfd ) );
+  snd_seq_poll_descriptors( data->seq, fds, count, POLLOUT );
+  double deadline = data->sendTimeout > 0 ? statsNow() + data->sendTimeout * 0.001 : 0;
+  size_t i = 0, length;
+  int result = 0;
+  while ( i < size ) {
+    length = midiMessageLength( messages + i, size - i );
+    if ( length == 0 ) {
+      errorString_ = "MidiOutAlsa::sendMessages: a message is invalid or incomplete, it and the rest were not sent!";
+      error( RtMidiError::WARNING, errorString_ );
+      break;
+    }
+
+    if ( messages[i] == 0xF0 ) {
+      if ( ( result = alsaDrainOutput( data->seq, fds, count, deadline ) ) < 0 ) break;
+      sendMessage( messages + i, length );
+      i += length;
+      continue;
+    }
+
+    // Messages the sequencer rejects are reported and skipped.
+    unsigned int offset = 0;
+    if ( outputMessage( messages + i, length, &offset, false ) == -EAGAIN ) {
+      // The buffer is full and the pool cannot take it yet.
+      if ( deadline > 0 && statsNow() >= deadline ) {
+        snd_seq_drop_output( data->seq );
+        result = -EAGAIN;
+        break;
+      }
+      poll( fds, count, 10 );
+      continue;
+    }
+    if ( offset == length ) counters_.countMessage( messages + i, length );
+    i += length;
+  }
+
+  if ( result == 0 ) result = alsaDrainOutput( data->seq, fds, count, deadline );
+  if ( result == -EAGAIN ) {
+    counters_.queueDrops.fetch_add( 1, std::memory_order_relaxed );
+    errorString_ = "MidiOutAlsa::sendMessages: timed out waiting for room in the output pool, messages dropped!";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+  else if ( result < 0 ) {
+    errorString_ = "MidiOutAlsa::sendMessages: error sending MIDI messages to port.";
+    error( RtMidiError::WARNING, errorString_ );
+  }
 }
 
 #endif // __LINUX_ALSA__
@@ -1930,7 +4696,7 @@ struct WinMidiData {
   HMIDIIN inHandle;    // Handle to Midi Input Device
   HMIDIOUT outHandle;  // Handle to Midi Output Device
   DWORD lastTime;
-  MidiInApi::MidiMessage message;
+  RtMidiMessage message;
   LPMIDIHDR sysexBuffer[RT_SYSEX_BUFFER_COUNT];
   CRITICAL_SECTION _mutex; // [Patrice] see https://groups.google.com/forum/#!topic/mididev/6OUjHutMpEo
 };
@@ -1986,16 +4752,18 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
       return;
     }
 
-    // Copy bytes to our MIDI message.
-    unsigned char *ptr = (unsigned char *) &midiMessage;
-    for ( int i=0; i<nBytes; ++i ) apiData->message.bytes.push_back( *ptr++ );
+    // Deliver the bytes straight from the packed message.
+    if ( !MidiInApi::deliverMessage( data, apiData->message.timeStamp, (unsigned char *) &midiMessage, nBytes ) )
+      data->errors.report( RtMidiErrorEvent::QUEUE_FULL, "MidiInWinMM: message queue limit reached!!" );
+    apiData->message.clear();
+    return;
   }
   else { // Sysex message ( MIM_LONGDATA or MIM_LONGERROR )
     MIDIHDR *sysex = ( MIDIHDR *) midiMessage; 
     if ( !( data->ignoreFlags & 0x01 ) && inputStatus != MIM_LONGERROR ) {  
       // Sysex message and we're not ignoring it
       for ( int i=0; i<(int)sysex->dwBytesRecorded; ++i )
-        apiData->message.bytes.push_back( sysex->lpData[i] );
+        apiData->message.push_back( sysex->lpData[i] );
     }
 
     // The WinMM API requires that the sysex buffer be requeued after
@@ -2012,31 +4780,20 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
       MMRESULT result = midiInAddBuffer( apiData->inHandle, apiData->sysexBuffer[sysex->dwUser], sizeof(MIDIHDR) );
       LeaveCriticalSection( &(apiData->_mutex) );
       if ( result != MMSYSERR_NOERROR )
-        std::cerr << "\nRtMidiIn::midiInputCallback: error sending sysex to Midi device!!\n\n";
+        data->errors.report( RtMidiErrorEvent::SYSEX_ERROR, "MidiInWinMM::midiInputCallback: error sending sysex to Midi device!!" );
 
       if ( data->ignoreFlags & 0x01 ) return;
     }
     else return;
   }
 
-  if ( data->usingCallback ) {
-    RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-    callback( apiData->message.timeStamp, &apiData->message.bytes, data->userData );
-  }
-  else {
-    // As long as we haven't reached our queue size limit, push the message.
-    if ( data->queue.size < data->queue.ringSize ) {
-      data->queue.ring[data->queue.back++] = apiData->message;
-      if ( data->queue.back == data->queue.ringSize )
-        data->queue.back = 0;
-      data->queue.size++;
-    }
-    else
-      std::cerr << "\nRtMidiIn: message queue limit reached!!\n\n";
-  }
+  if ( !apiData->message.empty() &&
+       !MidiInApi::deliverMessage( data, apiData->message.timeStamp, apiData->message.data(),
+                                   apiData->message.size() ) )
+    data->errors.report( RtMidiErrorEvent::QUEUE_FULL, "MidiInWinMM: message queue limit reached!!" );
 
   // Clear the vector for the next input message.
-  apiData->message.bytes.clear();
+  apiData->message.clear();
 }
 
 MidiInWinMM :: MidiInWinMM( const std::string clientName, unsigned int queueSizeLimit ) : MidiInApi( queueSizeLimit )
@@ -2070,7 +4827,7 @@ void MidiInWinMM :: initialize( const std::string& /*clientName*/ )
   WinMidiData *data = (WinMidiData *) new WinMidiData;
   apiData_ = (void *) data;
   inputData_.apiData = (void *) data;
-  data->message.bytes.clear();  // needs to be empty for first input message
+  data->message.clear();  // needs to be empty for first input message
 
   if ( !InitializeCriticalSectionAndSpinCount(&(data->_mutex), 0x00000400) ) {
     errorString_ = "MidiInWinMM::initialize: InitializeCriticalSectionAndSpinCount failed.";
@@ -2343,11 +5100,11 @@ void MidiOutWinMM :: openVirtualPort( std::string /*portName*/ )
   error( RtMidiError::WARNING, errorString_ );
 }
 
-void MidiOutWinMM :: sendMessage( std::vector<unsigned char> *message )
+void MidiOutWinMM :: sendMessage( const unsigned char *message, size_t size )
 {
   if ( !connected_ ) return;
 
-  unsigned int nBytes = static_cast<unsigned int>(message->size());
+  unsigned int nBytes = static_cast<unsigned int>(size);
   if ( nBytes == 0 ) {
     errorString_ = "MidiOutWinMM::sendMessage: message argument is empty!";
     error( RtMidiError::WARNING, errorString_ );
@@ -2356,7 +5113,7 @@ void MidiOutWinMM :: sendMessage( std::vector<unsigned char> *message )
 
   MMRESULT result;
   WinMidiData *data = static_cast<WinMidiData *> (apiData_);
-  if ( message->at(0) == 0xF0 ) { // Sysex message
+  if ( message[0] == 0xF0 ) { // Sysex message
 
     // Allocate buffer for sysex data.
     char *buffer = (char *) malloc( nBytes );
@@ -2367,7 +5124,7 @@ void MidiOutWinMM :: sendMessage( std::vector<unsigned char> *message )
     }
 
     // Copy data to buffer.
-    for ( unsigned int i=0; i<nBytes; ++i ) buffer[i] = message->at(i);
+    for ( unsigned int i=0; i<nBytes; ++i ) buffer[i] = message[i];
 
     // Create and prepare MIDIHDR structure.
     MIDIHDR sysex;
@@ -2394,6 +5151,7 @@ void MidiOutWinMM :: sendMessage( std::vector<unsigned char> *message )
     // Unprepare the buffer and MIDIHDR.
     while ( MIDIERR_STILLPLAYING == midiOutUnprepareHeader( data->outHandle, &sysex, sizeof (MIDIHDR) ) ) Sleep( 1 );
     free( buffer );
+    counters_.countMessage( message, nBytes );
   }
   else { // Channel or system message.
 
@@ -2408,7 +5166,7 @@ void MidiOutWinMM :: sendMessage( std::vector<unsigned char> *message )
     DWORD packet;
     unsigned char *ptr = (unsigned char *) &packet;
     for ( unsigned int i=0; i<nBytes; ++i ) {
-      *ptr = message->at(i);
+      *ptr = message[i];
       ++ptr;
     }
 
@@ -2418,6 +5176,7 @@ void MidiOutWinMM :: sendMessage( std::vector<unsigned char> *message )
       errorString_ = "MidiOutWinMM::sendMessage: error sending MIDI message.";
       error( RtMidiError::DRIVER_ERROR, errorString_ );
     }
+    counters_.countMessage( message, nBytes );
   }
 }
 
@@ -2438,16 +5197,54 @@ void MidiOutWinMM :: sendMessage( std::vector<unsigned char> *message )
 #include <jack/jack.h>
 #include <jack/midiport.h>
 #include <jack/ringbuffer.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #define JACK_RINGBUFFER_SIZE 16384 // Default size for ringbuffer
 
+// A counting semaphore wakes the input dispatcher thread.  Posting it
+// takes no lock, so the process callback can do it in JACK's
+// real-time thread, and a post made while the dispatcher is busy is
+// kept until it waits again.  OS-X has no unnamed POSIX semaphores,
+// so Mach semaphores are used there.
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/semaphore.h>
+
+typedef semaphore_t JackSemaphore;
+
+static void jackSemaphoreInit( JackSemaphore *sem ) { semaphore_create( mach_task_self(), sem, SYNC_POLICY_FIFO, 0 ); }
+static void jackSemaphoreDestroy( JackSemaphore *sem ) { semaphore_destroy( mach_task_self(), *sem ); }
+static void jackSemaphorePost( JackSemaphore *sem ) { semaphore_signal( *sem ); }
+static void jackSemaphoreWait( JackSemaphore *sem ) { while ( semaphore_wait( *sem ) == KERN_ABORTED ) {} }
+#else
+#include <errno.h>
+#include <semaphore.h>
+
+typedef sem_t JackSemaphore;
+
+static void jackSemaphoreInit( JackSemaphore *sem ) { sem_init( sem, 0, 0 ); }
+static void jackSemaphoreDestroy( JackSemaphore *sem ) { sem_destroy( sem ); }
+static void jackSemaphorePost( JackSemaphore *sem ) { sem_post( sem ); }
+static void jackSemaphoreWait( JackSemaphore *sem ) { while ( sem_wait( sem ) != 0 && errno == EINTR ) {} }
+#endif
+
 struct JackMidiData {
   jack_client_t *client;
-  jack_port_t *port;
-  jack_ringbuffer_t *buffSize;
-  jack_ringbuffer_t *buffMessage;
+  std::atomic<jack_port_t *> port; // read by the process callback
+  jack_ringbuffer_t *buffMessage; // output records, see jackProcessOut
+  std::vector<char> batch; // output only: records of sendMessages()
+  unsigned int reportedDrops;
   jack_time_t lastTime;
   MidiInApi :: RtMidiInData *rtMidiIn;
+
+  // Input only: raw events handed from the process callback to the
+  // dispatcher thread, which decodes them and calls the user.
+  jack_ringbuffer_t *buffIn;
+  pthread_t dispatcher;
+  JackSemaphore dispatchReady;
+  std::atomic<bool> dispatching;
+  std::atomic<unsigned int> droppedEvents;
   };
 
 //*********************************************************************//
@@ -2455,59 +5252,259 @@ struct JackMidiData {
 //  Class Definitions: MidiInJack
 //*********************************************************************//
 
+// Header of each event record in the input and output ringbuffers,
+// followed by the event bytes.
+struct JackEventHeader {
+  jack_nframes_t frame;
+  jack_nframes_t size;
+};
+
+// The process callback runs in JACK's real-time thread, so it only
+// copies the raw events and their frame times into a ringbuffer and
+// wakes the dispatcher thread.  It never allocates, blocks or calls
+// user code; events that do not fit are counted and dropped.
 static int jackProcessIn( jack_nframes_t nframes, void *arg )
 {
   JackMidiData *jData = (JackMidiData *) arg;
-  MidiInApi :: RtMidiInData *rtData = jData->rtMidiIn;
   jack_midi_event_t event;
-  jack_time_t time;
+  JackEventHeader header;
 
   // Is port created?
-  if ( jData->port == NULL ) return 0;
-  void *buff = jack_port_get_buffer( jData->port, nframes );
+  jack_port_t *port = jData->port.load( std::memory_order_acquire );
+  if ( port == NULL ) return 0;
+  void *buff = jack_port_get_buffer( port, nframes );
+  jack_nframes_t cycleStart = jack_last_frame_time( jData->client );
 
   // We have midi events in buffer
   int evCount = jack_midi_get_event_count( buff );
+  if ( evCount == 0 ) return 0;
   for (int j = 0; j < evCount; j++) {
-    MidiInApi::MidiMessage message;
-    message.bytes.clear();
-
     jack_midi_event_get( &event, buff, j );
+    if ( event.size == 0 ) continue;
+
+    if ( jack_ringbuffer_write_space( jData->buffIn ) < sizeof(header) + event.size ) {
+      jData->droppedEvents.fetch_add( 1, std::memory_order_relaxed );
+      continue;
+    }
+    header.frame = cycleStart + event.time;
+    header.size = event.size;
+    jack_ringbuffer_write( jData->buffIn, (const char *) &header, sizeof(header) );
+    jack_ringbuffer_write( jData->buffIn, (const char *) event.buffer, event.size );
+  }
 
-    for ( unsigned int i = 0; i < event.size; i++ )
-      message.bytes.push_back( event.buffer[i] );
+  // Posted after the events are written, so that the dispatcher
+  // always wakes once more after reading the ringbuffer.
+  jackSemaphorePost( &jData->dispatchReady );
 
-    // Compute the delta time.
-    time = jack_get_time();
-    if ( rtData->firstMessage == true )
-      rtData->firstMessage = false;
-    else
-      message.timeStamp = ( time - jData->lastTime ) * 0.000001;
+  return 0;
+}
 
-    jData->lastTime = time;
+// Dispatcher thread: decode the events queued by jackProcessIn and
+// hand them to the user callback or the input queue.
+static void *jackDispatchIn( void *ptr )
+{
+  JackMidiData *jData = (JackMidiData *) ptr;
+  MidiInApi :: RtMidiInData *rtData = jData->rtMidiIn;
+  std::vector<unsigned char> bytes( 1024 );
+  JackEventHeader header;
+  unsigned int dropped, reported = 0;
+  jack_time_t time;
+  double timeStamp;
+
+  while ( jData->dispatching.load( std::memory_order_acquire ) ) {
+
+    while ( jack_ringbuffer_read_space( jData->buffIn ) >= sizeof(header) ) {
+      jack_ringbuffer_peek( jData->buffIn, (char *) &header, sizeof(header) );
+      // The payload follows its header in the same cycle.
+      if ( jack_ringbuffer_read_space( jData->buffIn ) < sizeof(header) + header.size ) break;
+      jack_ringbuffer_read_advance( jData->buffIn, sizeof(header) );
+      if ( header.size > bytes.size() ) bytes.resize( header.size );
+      jack_ringbuffer_read( jData->buffIn, (char *) &bytes[0], header.size );
+
+      // Compute the delta time from the event's frame time.
+      timeStamp = 0.0;
+      time = jack_frames_to_time( jData->client, header.frame );
+      if ( rtData->firstMessage == true )
+        rtData->firstMessage = false;
+      else
+        timeStamp = ( time - jData->lastTime ) * 0.000001;
+      jData->lastTime = time;
 
-    if ( !rtData->continueSysex ) {
-      if ( rtData->usingCallback ) {
-        RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) rtData->userCallback;
-        callback( message.timeStamp, &message.bytes, rtData->userData );
-      }
-      else {
-        // As long as we haven't reached our queue size limit, push the message.
-        if ( rtData->queue.size < rtData->queue.ringSize ) {
-          rtData->queue.ring[rtData->queue.back++] = message;
-          if ( rtData->queue.back == rtData->queue.ringSize )
-            rtData->queue.back = 0;
-          rtData->queue.size++;
-        }
-        else
-          std::cerr << "\nMidiInJack: message queue limit reached!!\n\n";
-      }
+      if ( !MidiInApi::deliverMessage( rtData, timeStamp, &bytes[0], header.size ) )
+        rtData->errors.report( RtMidiErrorEvent::QUEUE_FULL, "MidiInJack: message queue limit reached!!" );
+    }
+
+    dropped = jData->droppedEvents.load( std::memory_order_relaxed );
+    if ( dropped != reported ) {
+      rtData->counters->overruns.fetch_add( dropped - reported, std::memory_order_relaxed );
+      rtData->errors.report( RtMidiErrorEvent::INPUT_OVERRUN, "MidiInJack: input ringbuffer full, events dropped!!", dropped - reported );
+      reported = dropped;
     }
+
+    // Events written since the ringbuffer was read, including the
+    // rest of a record that was only partly there, come with a post
+    // that has not been waited for yet.
+    jackSemaphoreWait( &jData->dispatchReady );
+  }
+
+  return 0;
+}
+
+//*********************************************************************//
+//  API: JACK
+//  Shared client
+//*********************************************************************//
+
+// All RtMidi ports in a process belong to a single JACK client, so
+// that the graph runs one process callback per cycle however many
+// ports are open.  The client is opened, with the name given by the
+// first object, when the first object connects and closed when the
+// last one is destroyed.  Each object's data occupies a slot that the
+// process callback reads without locking; slots are only changed with
+// jackSharedLock held.
+
+#define JACK_MAX_PORTS 256
+
+static int jackProcessOut( jack_nframes_t nframes, void *arg );
+
+struct JackSharedClient {
+  jack_client_t *client;
+  unsigned int users;
+  std::atomic<unsigned int> nSlots; // slots in use are all below this index
+  std::atomic<JackMidiData *> inputs[JACK_MAX_PORTS];
+  std::atomic<JackMidiData *> outputs[JACK_MAX_PORTS];
+  std::atomic<unsigned int> cycles;
+  std::atomic<bool> active; // cleared when the server shuts the client down
+};
+
+static JackSharedClient jackShared;
+static pthread_mutex_t jackSharedLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int jackProcessShared( jack_nframes_t nframes, void * /*arg*/ )
+{
+  JackMidiData *data;
+  unsigned int nSlots = jackShared.nSlots.load( std::memory_order_acquire );
+
+  for ( unsigned int i=0; i<nSlots; i++ ) {
+    if ( ( data = jackShared.inputs[i].load( std::memory_order_acquire ) ) )
+      jackProcessIn( nframes, data );
+    if ( ( data = jackShared.outputs[i].load( std::memory_order_acquire ) ) )
+      jackProcessOut( nframes, data );
   }
 
+  jackShared.cycles.fetch_add( 1, std::memory_order_release );
   return 0;
 }
 
+static void jackShutdownShared( void * /*arg*/ )
+{
+  jackShared.active.store( false, std::memory_order_release );
+}
+
+// Wait until the process callback has finished any cycle that started
+// before the call, so that it no longer uses data that was detached.
+// Giving up any earlier could free data still in use, so the wait
+// only ends early if the client is not running at all.
+static void jackWaitForCycle( void )
+{
+  unsigned int cycle = jackShared.cycles.load( std::memory_order_acquire );
+  while ( jackShared.active.load( std::memory_order_acquire ) &&
+          jackShared.cycles.load( std::memory_order_acquire ) == cycle )
+    usleep( 1000 );
+}
+
+// Give data a slot in the shared client's process callback, opening
+// the client if this is its first user.  Returns the client, or NULL
+// if the client cannot be opened or all slots are taken.
+static jack_client_t *jackAttach( JackMidiData *data, bool isInput, const std::string& clientName )
+{
+  jack_client_t *client = NULL;
+  unsigned int i;
+
+  pthread_mutex_lock( &jackSharedLock );
+  if ( jackShared.client == NULL ) {
+    jackShared.client = jack_client_open( clientName.c_str(), JackNoStartServer, NULL );
+    if ( jackShared.client ) {
+      jack_set_process_callback( jackShared.client, jackProcessShared, NULL );
+      jack_on_shutdown( jackShared.client, jackShutdownShared, NULL );
+      jackShared.active.store( jack_activate( jackShared.client ) == 0, std::memory_order_release );
+    }
+  }
+
+  if ( jackShared.client ) {
+    std::atomic<JackMidiData *> *slots = isInput ? jackShared.inputs : jackShared.outputs;
+    for ( i=0; i<JACK_MAX_PORTS; i++ ) {
+      if ( slots[i].load( std::memory_order_relaxed ) == NULL ) break;
+    }
+    if ( i < JACK_MAX_PORTS ) {
+      if ( i >= jackShared.nSlots.load( std::memory_order_relaxed ) )
+        jackShared.nSlots.store( i + 1, std::memory_order_release );
+      slots[i].store( data, std::memory_order_release );
+      jackShared.users++;
+      client = jackShared.client;
+    }
+    else if ( jackShared.users == 0 ) {
+      jack_client_close( jackShared.client );
+      jackShared.client = NULL;
+      jackShared.active.store( false, std::memory_order_release );
+    }
+  }
+  pthread_mutex_unlock( &jackSharedLock );
+
+  return client;
+}
+
+// Remove data from the shared client's process callback, closing the
+// client once its last user has gone.
+static void jackDetach( JackMidiData *data )
+{
+  pthread_mutex_lock( &jackSharedLock );
+  for ( unsigned int i=0; i<jackShared.nSlots.load( std::memory_order_relaxed ); i++ ) {
+    if ( jackShared.inputs[i].load( std::memory_order_relaxed ) == data )
+      jackShared.inputs[i].store( NULL, std::memory_order_release );
+    if ( jackShared.outputs[i].load( std::memory_order_relaxed ) == data )
+      jackShared.outputs[i].store( NULL, std::memory_order_release );
+  }
+
+  if ( --jackShared.users == 0 ) {
+    jack_client_close( jackShared.client );
+    jackShared.client = NULL;
+    jackShared.active.store( false, std::memory_order_release );
+    jackShared.nSlots.store( 0, std::memory_order_release );
+  }
+  else
+    jackWaitForCycle();
+  pthread_mutex_unlock( &jackSharedLock );
+}
+
+// Register a port on the shared client.  Several objects may ask for
+// the same name, so a number is appended to it if it is taken.
+static jack_port_t *jackRegisterPort( jack_client_t *client, const std::string& portName, unsigned long flags )
+{
+  if ( client == NULL ) return NULL;
+  jack_port_t *port = jack_port_register( client, portName.c_str(), JACK_DEFAULT_MIDI_TYPE, flags, 0 );
+  for ( int i=2; port == NULL && i<=JACK_MAX_PORTS; i++ ) {
+    std::ostringstream ost;
+    ost << portName << " " << i;
+    port = jack_port_register( client, ost.str().c_str(), JACK_DEFAULT_MIDI_TYPE, flags, 0 );
+  }
+  return port;
+}
+
+// Unregister an object's port once the process callback has stopped
+// using it.
+static void jackUnregisterPort( JackMidiData *data )
+{
+  jack_port_t *port = data->port.exchange( NULL );
+  jackWaitForCycle();
+  jack_port_unregister( data->client, port );
+}
+
+//*********************************************************************//
+//  API: JACK
+//  Class Definitions: MidiInJack
+//*********************************************************************//
+
 MidiInJack :: MidiInJack( const std::string clientName, unsigned int queueSizeLimit ) : MidiInApi( queueSizeLimit )
 {
   initialize( clientName );
@@ -2521,6 +5518,10 @@ void MidiInJack :: initialize( const std::string& clientName )
   data->rtMidiIn = &inputData_;
   data->port = NULL;
   data->client = NULL;
+  data->buffIn = NULL;
+  data->dispatching = false;
+  data->droppedEvents = 0;
+  jackSemaphoreInit( &data->dispatchReady );
   this->clientName = clientName;
 
   connect();
@@ -2532,15 +5533,27 @@ void MidiInJack :: connect()
   if ( data->client )
     return;
 
-  // Initialize JACK client
-  if (( data->client = jack_client_open( clientName.c_str(), JackNoStartServer, NULL )) == 0) {
+  // Start the dispatcher before any events can arrive.
+  if ( data->buffIn == NULL ) {
+    data->buffIn = jack_ringbuffer_create( JACK_RINGBUFFER_SIZE );
+    jack_ringbuffer_mlock( data->buffIn );
+  }
+  if ( !data->dispatching ) {
+    data->dispatching = true;
+    if ( pthread_create( &data->dispatcher, NULL, jackDispatchIn, data ) ) {
+      data->dispatching = false;
+      errorString_ = "MidiInJack::initialize: error starting MIDI input thread!";
+      error( RtMidiError::THREAD_ERROR, errorString_ );
+      return;
+    }
+  }
+
+  // Join the shared JACK client
+  if (( data->client = jackAttach( data, true, clientName )) == 0) {
     errorString_ = "MidiInJack::initialize: JACK server not running?";
     error( RtMidiError::WARNING, errorString_ );
     return;
   }
-
-  jack_set_process_callback( data->client, jackProcessIn, data );
-  jack_activate( data->client );
 }
 
 MidiInJack :: ~MidiInJack()
@@ -2548,8 +5561,22 @@ MidiInJack :: ~MidiInJack()
   JackMidiData *data = static_cast<JackMidiData *> (apiData_);
   closePort();
 
+  // Stop the dispatcher while the client is still open, since it reads
+  // the client's times for the events it drains.  The process callback
+  // only touches the ringbuffer and the semaphore, which are freed
+  // once it can no longer run.
+  if ( data->dispatching ) {
+    data->dispatching.store( false, std::memory_order_release );
+    jackSemaphorePost( &data->dispatchReady );
+    pthread_join( data->dispatcher, NULL );
+  }
+
   if ( data->client )
-    jack_client_close( data->client );
+    jackDetach( data );
+
+  if ( data->buffIn )
+    jack_ringbuffer_free( data->buffIn );
+  jackSemaphoreDestroy( &data->dispatchReady );
   delete data;
 }
 
@@ -2561,8 +5588,7 @@ void MidiInJack :: openPort( unsigned int portNumber, const std::string portName
 
   // Creating new port
   if ( data->port == NULL)
-    data->port = jack_port_register( data->client, portName.c_str(),
-                                     JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0 );
+    data->port = jackRegisterPort( data->client, portName, JackPortIsInput );
 
   if ( data->port == NULL) {
     errorString_ = "MidiInJack::openPort: JACK error creating port";
@@ -2581,8 +5607,7 @@ void MidiInJack :: openVirtualPort( const std::string portName )
 
   connect();
   if ( data->port == NULL )
-    data->port = jack_port_register( data->client, portName.c_str(),
-                                     JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0 );
+    data->port = jackRegisterPort( data->client, portName, JackPortIsInput );
 
   if ( data->port == NULL ) {
     errorString_ = "MidiInJack::openVirtualPort: JACK error creating virtual port";
@@ -2645,8 +5670,7 @@ void MidiInJack :: closePort()
   JackMidiData *data = static_cast<JackMidiData *> (apiData_);
 
   if ( data->port == NULL ) return;
-  jack_port_unregister( data->client, data->port );
-  data->port = NULL;
+  jackUnregisterPort( data );
 }
 
 //*********************************************************************//
@@ -2654,24 +5678,47 @@ void MidiInJack :: closePort()
 //  Class Definitions: MidiOutJack
 //*********************************************************************//
 
-// Jack process callback
+// Jack process callback.  Messages are queued by sendMessage() as
+// records holding the frame time at which they were sent.  Each is
+// played one period later at the same position within the period,
+// which keeps the spacing between messages; late ones are played at
+// the start of the cycle.  Events the port buffer cannot hold are
+// counted and dropped.
 static int jackProcessOut( jack_nframes_t nframes, void *arg )
 {
   JackMidiData *data = (JackMidiData *) arg;
   jack_midi_data_t *midiData;
-  int space;
+  JackEventHeader header;
+  jack_nframes_t cycleStart, offset, lastOffset = 0;
+  int32_t delta;
 
   // Is port created?
-  if ( data->port == NULL ) return 0;
+  jack_port_t *port = data->port.load( std::memory_order_acquire );
+  if ( port == NULL ) return 0;
 
-  void *buff = jack_port_get_buffer( data->port, nframes );
+  void *buff = jack_port_get_buffer( port, nframes );
   jack_midi_clear_buffer( buff );
-
-  while ( jack_ringbuffer_read_space( data->buffSize ) > 0 ) {
-    jack_ringbuffer_read( data->buffSize, (char *) &space, (size_t) sizeof(space) );
-    midiData = jack_midi_event_reserve( buff, 0, space );
-
-    jack_ringbuffer_read( data->buffMessage, (char *) midiData, (size_t) space );
+  cycleStart = jack_last_frame_time( data->client );
+
+  while ( jack_ringbuffer_read_space( data->buffMessage ) >= sizeof(header) ) {
+    jack_ringbuffer_peek( data->buffMessage, (char *) &header, sizeof(header) );
+    if ( jack_ringbuffer_read_space( data->buffMessage ) < sizeof(header) + header.size ) break;
+
+    // Messages sent since this cycle started belong to the next one.
+    delta = (int32_t) ( header.frame - cycleStart );
+    if ( delta >= 0 ) break;
+    offset = ( delta + (int32_t) nframes > 0 ) ? delta + nframes : 0;
+    if ( offset < lastOffset ) offset = lastOffset;
+    lastOffset = offset;
+
+    jack_ringbuffer_read_advance( data->buffMessage, sizeof(header) );
+    midiData = jack_midi_event_reserve( buff, offset, header.size );
+    if ( midiData )
+      jack_ringbuffer_read( data->buffMessage, (char *) midiData, header.size );
+    else {
+      jack_ringbuffer_read_advance( data->buffMessage, header.size );
+      data->droppedEvents.fetch_add( 1, std::memory_order_relaxed );
+    }
   }
 
   return 0;
@@ -2689,6 +5736,9 @@ void MidiOutJack :: initialize( const std::string& clientName )
 
   data->port = NULL;
   data->client = NULL;
+  data->buffMessage = NULL;
+  data->reportedDrops = 0;
+  data->droppedEvents = 0;
   this->clientName = clientName;
 
   connect();
@@ -2700,17 +5750,17 @@ void MidiOutJack :: connect()
   if ( data->client )
     return;
 
-  // Initialize JACK client
-  if (( data->client = jack_client_open( clientName.c_str(), JackNoStartServer, NULL )) == 0) {
+  if ( data->buffMessage == NULL ) {
+    data->buffMessage = jack_ringbuffer_create( JACK_RINGBUFFER_SIZE );
+    jack_ringbuffer_mlock( data->buffMessage );
+  }
+
+  // Join the shared JACK client
+  if (( data->client = jackAttach( data, false, clientName )) == 0) {
     errorString_ = "MidiOutJack::initialize: JACK server not running?";
     error( RtMidiError::WARNING, errorString_ );
     return;
   }
-
-  jack_set_process_callback( data->client, jackProcessOut, data );
-  data->buffSize = jack_ringbuffer_create( JACK_RINGBUFFER_SIZE );
-  data->buffMessage = jack_ringbuffer_create( JACK_RINGBUFFER_SIZE );
-  jack_activate( data->client );
 }
 
 MidiOutJack :: ~MidiOutJack()
@@ -2718,12 +5768,11 @@ MidiOutJack :: ~MidiOutJack()
   JackMidiData *data = static_cast<JackMidiData *> (apiData_);
   closePort();
 
-  if ( data->client ) {
-    // Cleanup
-    jack_client_close( data->client );
-    jack_ringbuffer_free( data->buffSize );
+  // Cleanup
+  if ( data->client )
+    jackDetach( data );
+  if ( data->buffMessage )
     jack_ringbuffer_free( data->buffMessage );
-  }
 
   delete data;
 }
@@ -2736,8 +5785,7 @@ void MidiOutJack :: openPort( unsigned int portNumber, const std::string portNam
 
   // Creating new port
   if ( data->port == NULL )
-    data->port = jack_port_register( data->client, portName.c_str(),
-      JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0 );
+    data->port = jackRegisterPort( data->client, portName, JackPortIsOutput );
 
   if ( data->port == NULL ) {
     errorString_ = "MidiOutJack::openPort: JACK error creating port";
@@ -2756,8 +5804,7 @@ void MidiOutJack :: openVirtualPort( const std::string portName )
 
   connect();
   if ( data->port == NULL )
-    data->port = jack_port_register( data->client, portName.c_str(),
-      JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0 );
+    data->port = jackRegisterPort( data->client, portName, JackPortIsOutput );
 
   if ( data->port == NULL ) {
     errorString_ = "MidiOutJack::openVirtualPort: JACK error creating virtual port";
@@ -2821,19 +5868,565 @@ void MidiOutJack :: closePort()
   JackMidiData *data = static_cast<JackMidiData *> (apiData_);
 
   if ( data->port == NULL ) return;
-  jack_port_unregister( data->client, data->port );
-  data->port = NULL;
+  jackUnregisterPort( data );
+}
+
+void MidiOutJack :: sendMessage( const unsigned char *message, size_t size )
+{
+  JackMidiData *data = static_cast<JackMidiData *> (apiData_);
+  JackEventHeader header;
+
+  if ( data->client == NULL ) {
+    errorString_ = "MidiOutJack::sendMessage: JACK client not connected!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( size == 0 ) {
+    errorString_ = "MidiOutJack::sendMessage: message argument is empty!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  reportDrops();
+
+  // Write the whole record or nothing, so that the process callback
+  // never reads a partial one.
+  header.frame = jack_frame_time( data->client );
+  header.size = size;
+  if ( jack_ringbuffer_write_space( data->buffMessage ) < sizeof(header) + header.size ) {
+    data->reportedDrops = data->droppedEvents.fetch_add( 1, std::memory_order_relaxed ) + 1;
+    counters_.queueDrops.fetch_add( 1, std::memory_order_relaxed );
+    errorString_ = "MidiOutJack::sendMessage: output ringbuffer full, message dropped!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  jack_ringbuffer_write( data->buffMessage, (const char *) &header, sizeof(header) );
+  jack_ringbuffer_write( data->buffMessage, (const char *) message, header.size );
+  counters_.countMessage( message, header.size );
 }
 
-void MidiOutJack :: sendMessage( std::vector<unsigned char> *message )
+void MidiOutJack :: sendMessages( const unsigned char *messages, size_t size )
 {
-  int nBytes = message->size();
   JackMidiData *data = static_cast<JackMidiData *> (apiData_);
+  JackEventHeader header;
+
+  if ( data->client == NULL ) {
+    errorString_ = "MidiOutJack::sendMessages: JACK client not connected!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  reportDrops();
+
+  // The records that fit are put together first and written to the
+  // ringbuffer in one go, so the process callback sees all of them or
+  // none and plays them in the same cycle.  Those after the first one
+  // that does not fit are dropped, keeping the order.
+  size_t space = jack_ringbuffer_write_space( data->buffMessage );
+  header.frame = jack_frame_time( data->client );
+  data->batch.clear();
+  size_t i = 0, sent = 0, length;
+  unsigned int nDropped = 0;
+  while ( i < size ) {
+    length = midiMessageLength( messages + i, size - i );
+    if ( length == 0 ) {
+      errorString_ = "MidiOutJack::sendMessages: a message is invalid or incomplete, it and the rest were not sent!";
+      error( RtMidiError::WARNING, errorString_ );
+      break;
+    }
+    if ( nDropped == 0 && data->batch.size() + sizeof(header) + length <= space ) {
+      header.size = length;
+      data->batch.insert( data->batch.end(), (const char *) &header, (const char *) &header + sizeof(header) );
+      data->batch.insert( data->batch.end(), messages + i, messages + i + length );
+      sent = i + length;
+    }
+    else nDropped++;
+    i += length;
+  }
+
+  if ( !data->batch.empty() )
+    jack_ringbuffer_write( data->buffMessage, &data->batch[0], data->batch.size() );
+  for ( i=0; i<sent; i+=length ) {
+    length = midiMessageLength( messages + i, sent - i );
+    counters_.countMessage( messages + i, length );
+  }
+
+  if ( nDropped > 0 ) {
+    data->reportedDrops = data->droppedEvents.fetch_add( nDropped, std::memory_order_relaxed ) + nDropped;
+    counters_.queueDrops.fetch_add( nDropped, std::memory_order_relaxed );
+    errorString_ = "MidiOutJack::sendMessages: output ringbuffer full, messages dropped!";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
 
-  // Write full message to buffer
-  jack_ringbuffer_write( data->buffMessage, ( const char * ) &( *message )[0],
-                         message->size() );
-  jack_ringbuffer_write( data->buffSize, ( char * ) &nBytes, sizeof( nBytes ) );
+// Report messages the process callback could not place.
+void MidiOutJack :: reportDrops( void )
+{
+  JackMidiData *data = static_cast<JackMidiData *> (apiData_);
+  unsigned int dropped = data->droppedEvents.load( std::memory_order_relaxed );
+  if ( dropped != data->reportedDrops ) {
+    counters_.overruns.fetch_add( dropped - data->reportedDrops, std::memory_order_relaxed );
+    std::ostringstream ost;
+    ost << "MidiOutJack::sendMessage: " << dropped - data->reportedDrops << " message(s) did not fit in the JACK port buffer and were dropped.";
+    data->reportedDrops = dropped;
+    errorString_ = ost.str();
+    error( RtMidiError::WARNING, errorString_ );
+  }
 }
 
 #endif  // __UNIX_JACK__
+
+
+//*********************************************************************//
+//  API: LOOPBACK
+//
+//  In-process virtual cables, so that RtMidi and the programs using
+//  it can be exercised without MIDI hardware or a MIDI server.
+//
+//  *********************************************************************//
+
+#if defined(__RTMIDI_LOOPBACK__)
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define LOOPBACK_CABLE_SIZE 65536 // Bytes of messages held by each cable
+
+struct LoopbackPort;
+
+// A connection from one output to one input.  Messages travel through
+// a lock-free single-producer / single-consumer queue, each record
+// stamped with the time at which it is due at the input.
+struct LoopbackCable {
+  LoopbackPort *source;
+  LoopbackPort *destination;
+  MidiInApi::MidiQueue queue;
+  double busyUntil; // end of the last simulated transmission, sender only
+  bool attached;    // false once removed from both ends
+
+  LoopbackCable() : source(0), destination(0), busyUntil(0.0), attached(true) {}
+  ~LoopbackCable() { if ( queue.ringSize > 0 ) delete [] queue.ring; }
+};
+
+// Data of one RtMidi object of either direction.
+struct LoopbackPort {
+  bool isInput;
+  bool isVirtual;
+  std::string name;
+  std::mutex cableLock; // guards cables
+  std::vector< std::shared_ptr<LoopbackCable> > cables;
+  std::shared_ptr<LoopbackCable> connection; // made by openPort()
+
+  // Output only: the simulated link.
+  double latency;
+  double bytesPerSecond;
+
+  // Input only: the delivery thread and its wakeup.
+  MidiInApi :: RtMidiInData *rtMidiIn;
+  std::thread thread;
+  std::mutex wakeLock;
+  std::condition_variable wake;
+  std::atomic<bool> signalled;
+  std::atomic<bool> running;
+  double lastTime;
+
+  LoopbackPort( bool input )
+  : isInput(input), isVirtual(false), latency(0.0), bytesPerSecond(0.0),
+    rtMidiIn(0), signalled(false), running(false), lastTime(0.0) {}
+};
+
+// Ports opened with openVirtualPort(), which objects of the other
+// direction list and connect to.  The list and all connections are
+// changed only with loopbackLock held.
+static std::mutex loopbackLock;
+static std::vector<LoopbackPort *> loopbackPorts;
+
+static double loopbackNow( void )
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Find the n-th virtual port of the given direction.
+static LoopbackPort *loopbackFind( bool isInput, unsigned int portNumber )
+{
+  for ( unsigned int i=0; i<loopbackPorts.size(); i++ ) {
+    if ( loopbackPorts[i]->isInput != isInput ) continue;
+    if ( portNumber-- == 0 ) return loopbackPorts[i];
+  }
+  return 0;
+}
+
+static unsigned int loopbackCount( bool isInput )
+{
+  std::lock_guard<std::mutex> lock( loopbackLock );
+  unsigned int nPorts = 0;
+  for ( unsigned int i=0; i<loopbackPorts.size(); i++ )
+    if ( loopbackPorts[i]->isInput == isInput ) nPorts++;
+  return nPorts;
+}
+
+static std::string loopbackName( bool isInput, unsigned int portNumber )
+{
+  std::lock_guard<std::mutex> lock( loopbackLock );
+  LoopbackPort *port = loopbackFind( isInput, portNumber );
+  return port ? port->name : std::string();
+}
+
+static void loopbackRegister( LoopbackPort *port, const std::string &portName )
+{
+  std::lock_guard<std::mutex> lock( loopbackLock );
+  port->name = portName;
+  if ( !port->isVirtual ) loopbackPorts.push_back( port );
+  port->isVirtual = true;
+}
+
+// Called with loopbackLock held.
+static std::shared_ptr<LoopbackCable> loopbackConnect( LoopbackPort *source, LoopbackPort *destination )
+{
+  std::shared_ptr<LoopbackCable> cable( new LoopbackCable );
+  cable->source = source;
+  cable->destination = destination;
+  cable->queue.allocate( LOOPBACK_CABLE_SIZE );
+
+  // Take the two locks in turn: the delivery thread may hold the
+  // input's while a callback sends to an output.
+  {
+    std::lock_guard<std::mutex> lock( source->cableLock );
+    source->cables.push_back( cable );
+  }
+  {
+    std::lock_guard<std::mutex> lock( destination->cableLock );
+    destination->cables.push_back( cable );
+  }
+  return cable;
+}
+
+// Remove a cable from both of its ends.  Called with loopbackLock
+// held; a sender or the delivery thread still using the cable keeps
+// it alive until done.
+static void loopbackDisconnect( std::shared_ptr<LoopbackCable> cable )
+{
+  if ( !cable->attached ) return;
+  cable->attached = false;
+
+  LoopbackPort *ends[2] = { cable->source, cable->destination };
+  for ( unsigned int i=0; i<2; i++ ) {
+    std::lock_guard<std::mutex> lock( ends[i]->cableLock );
+    std::vector< std::shared_ptr<LoopbackCable> > &cables = ends[i]->cables;
+    cables.erase( std::remove( cables.begin(), cables.end(), cable ), cables.end() );
+  }
+}
+
+// Disconnect every cable of a port and withdraw its virtual port.
+static void loopbackRelease( LoopbackPort *port )
+{
+  std::lock_guard<std::mutex> lock( loopbackLock );
+  while ( !port->cables.empty() )
+    loopbackDisconnect( port->cables.back() );
+  port->connection.reset();
+  loopbackPorts.erase( std::remove( loopbackPorts.begin(), loopbackPorts.end(), port ), loopbackPorts.end() );
+  port->isVirtual = false;
+}
+
+static void loopbackWake( LoopbackPort *port )
+{
+  port->signalled.store( true, std::memory_order_release );
+  { std::lock_guard<std::mutex> lock( port->wakeLock ); }
+  port->wake.notify_one();
+}
+
+// The input's filters, as set by ignoreTypes().
+static bool loopbackIgnored( unsigned char ignoreFlags, unsigned char status )
+{
+  if ( status == 0xF0 ) return ( ignoreFlags & 0x01 ) != 0;
+  if ( status == 0xF1 || status == 0xF8 ) return ( ignoreFlags & 0x02 ) != 0;
+  if ( status == 0xFE ) return ( ignoreFlags & 0x04 ) != 0;
+  return false;
+}
+
+// Each input has a thread that sleeps until the next message is due,
+// or a sender wakes it, and then delivers all messages that are due.
+// Delta times are taken from the due times rather than the clock, so
+// simulated timing is reported exactly.
+static void loopbackDeliver( LoopbackPort *data )
+{
+  MidiInApi::RtMidiInData *rtData = data->rtMidiIn;
+  RtMidiMessage message;
+  double now, next, due, timeStamp;
+
+  while ( data->running.load( std::memory_order_acquire ) ) {
+    next = 0.0;
+    {
+      std::lock_guard<std::mutex> lock( data->cableLock );
+      now = loopbackNow();
+      for ( unsigned int i=0; i<data->cables.size(); i++ ) {
+        MidiInApi::MidiQueue &queue = data->cables[i]->queue;
+        while ( queue.peek( &due ) ) {
+          if ( due > now ) {
+            if ( next == 0.0 || due < next ) next = due;
+            break;
+          }
+          queue.pop( &message, &due );
+          if ( loopbackIgnored( rtData->ignoreFlags, message[0] ) ) continue;
+
+          timeStamp = 0.0;
+          if ( rtData->firstMessage == true )
+            rtData->firstMessage = false;
+          else if ( due > data->lastTime )
+            timeStamp = due - data->lastTime;
+          if ( due > data->lastTime ) data->lastTime = due;
+
+          if ( !MidiInApi::deliverMessage( rtData, timeStamp, message.data(), message.size() ) )
+            rtData->errors.report( RtMidiErrorEvent::QUEUE_FULL, "MidiInLoopback: message queue limit reached!!" );
+        }
+      }
+    }
+
+    std::unique_lock<std::mutex> lock( data->wakeLock );
+    while ( !data->signalled.exchange( false, std::memory_order_acquire ) &&
+            data->running.load( std::memory_order_acquire ) ) {
+      if ( next == 0.0 )
+        data->wake.wait( lock );
+      else if ( data->wake.wait_for( lock, std::chrono::duration<double>( next - loopbackNow() ) ) == std::cv_status::timeout )
+        break;
+    }
+  }
+}
+
+//*********************************************************************//
+//  API: LOOPBACK
+//  Class Definitions: MidiInLoopback
+//*********************************************************************//
+
+MidiInLoopback :: MidiInLoopback( const std::string clientName, unsigned int queueSizeLimit )
+  : MidiInApi( queueSizeLimit )
+{
+  initialize( clientName );
+}
+
+void MidiInLoopback :: initialize( const std::string& /*clientName*/ )
+{
+  LoopbackPort *data = new LoopbackPort( true );
+  apiData_ = (void *) data;
+  inputData_.apiData = (void *) data;
+  data->rtMidiIn = &inputData_;
+
+  data->running = true;
+  data->thread = std::thread( loopbackDeliver, data );
+}
+
+MidiInLoopback :: ~MidiInLoopback()
+{
+  LoopbackPort *data = static_cast<LoopbackPort *> (apiData_);
+  loopbackRelease( data );
+
+  data->running.store( false, std::memory_order_release );
+  loopbackWake( data );
+  data->thread.join();
+
+  delete data;
+}
+
+void MidiInLoopback :: openPort( unsigned int portNumber, const std::string /*portName*/ )
+{
+  LoopbackPort *data = static_cast<LoopbackPort *> (apiData_);
+
+  if ( connected_ ) {
+    errorString_ = "MidiInLoopback::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( loopbackLock );
+    LoopbackPort *source = loopbackFind( false, portNumber );
+    if ( source ) data->connection = loopbackConnect( source, data );
+  }
+
+  if ( !data->connection ) {
+    std::ostringstream ost;
+    ost << "MidiInLoopback::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+
+  connected_ = true;
+}
+
+void MidiInLoopback :: openVirtualPort( const std::string portName )
+{
+  loopbackRegister( static_cast<LoopbackPort *> (apiData_), portName );
+}
+
+void MidiInLoopback :: closePort( void )
+{
+  LoopbackPort *data = static_cast<LoopbackPort *> (apiData_);
+
+  if ( connected_ ) {
+    std::lock_guard<std::mutex> lock( loopbackLock );
+    if ( data->connection ) loopbackDisconnect( data->connection );
+    data->connection.reset();
+  }
+  connected_ = false;
+}
+
+unsigned int MidiInLoopback :: getPortCount()
+{
+  return loopbackCount( false );
+}
+
+std::string MidiInLoopback :: getPortName( unsigned int portNumber )
+{
+  std::string name = loopbackName( false, portNumber );
+  if ( name.empty() && portNumber >= getPortCount() ) {
+    std::ostringstream ost;
+    ost << "MidiInLoopback::getPortName: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::WARNING, errorString_ );
+  }
+  return name;
+}
+
+//*********************************************************************//
+//  API: LOOPBACK
+//  Class Definitions: MidiOutLoopback
+//*********************************************************************//
+
+MidiOutLoopback :: MidiOutLoopback( const std::string clientName ) : MidiOutApi()
+{
+  initialize( clientName );
+}
+
+void MidiOutLoopback :: initialize( const std::string& /*clientName*/ )
+{
+  LoopbackPort *data = new LoopbackPort( false );
+  apiData_ = (void *) data;
+}
+
+MidiOutLoopback :: ~MidiOutLoopback()
+{
+  LoopbackPort *data = static_cast<LoopbackPort *> (apiData_);
+  loopbackRelease( data );
+  delete data;
+}
+
+void MidiOutLoopback :: openPort( unsigned int portNumber, const std::string /*portName*/ )
+{
+  LoopbackPort *data = static_cast<LoopbackPort *> (apiData_);
+
+  if ( connected_ ) {
+    errorString_ = "MidiOutLoopback::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( loopbackLock );
+    LoopbackPort *destination = loopbackFind( true, portNumber );
+    if ( destination ) data->connection = loopbackConnect( data, destination );
+  }
+
+  if ( !data->connection ) {
+    std::ostringstream ost;
+    ost << "MidiOutLoopback::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+
+  connected_ = true;
+}
+
+void MidiOutLoopback :: openVirtualPort( const std::string portName )
+{
+  loopbackRegister( static_cast<LoopbackPort *> (apiData_), portName );
+}
+
+void MidiOutLoopback :: closePort( void )
+{
+  LoopbackPort *data = static_cast<LoopbackPort *> (apiData_);
+
+  if ( connected_ ) {
+    std::lock_guard<std::mutex> lock( loopbackLock );
+    if ( data->connection ) loopbackDisconnect( data->connection );
+    data->connection.reset();
+  }
+  connected_ = false;
+}
+
+unsigned int MidiOutLoopback :: getPortCount()
+{
+  return loopbackCount( true );
+}
+
+std::string MidiOutLoopback :: getPortName( unsigned int portNumber )
+{
+  std::string name = loopbackName( true, portNumber );
+  if ( name.empty() && portNumber >= getPortCount() ) {
+    std::ostringstream ost;
+    ost << "MidiOutLoopback::getPortName: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::WARNING, errorString_ );
+  }
+  return name;
+}
+
+void MidiOutLoopback :: setLoopbackLink( double latency, double bytesPerSecond )
+{
+  LoopbackPort *data = static_cast<LoopbackPort *> (apiData_);
+  std::lock_guard<std::mutex> lock( data->cableLock );
+  data->latency = latency > 0.0 ? latency : 0.0;
+  data->bytesPerSecond = bytesPerSecond > 0.0 ? bytesPerSecond : 0.0;
+}
+
+// Messages are copied into every cable of the port, the connection
+// made by openPort() as well as those made to its virtual port.  The
+// simulated link serializes messages on each cable: a message starts
+// once the previous one has been transmitted.
+void MidiOutLoopback :: sendMessage( const unsigned char *message, size_t size )
+{
+  LoopbackPort *data = static_cast<LoopbackPort *> (apiData_);
+  unsigned int nBytes = static_cast<unsigned int> (size);
+  unsigned int dropped = 0;
+  double now, done;
+
+  if ( nBytes == 0 ) {
+    errorString_ = "MidiOutLoopback::sendMessage: message argument is empty!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock( data->cableLock );
+    now = loopbackNow();
+    for ( unsigned int i=0; i<data->cables.size(); i++ ) {
+      LoopbackCable *cable = data->cables[i].get();
+      done = ( cable->busyUntil > now ) ? cable->busyUntil : now;
+      if ( data->bytesPerSecond > 0.0 ) done += nBytes / data->bytesPerSecond;
+
+      if ( !cable->queue.push( message, nBytes, done + data->latency ) ) {
+        dropped++;
+        continue;
+      }
+      cable->busyUntil = done;
+      loopbackWake( cable->destination );
+    }
+  }
+
+  if ( dropped ) {
+    counters_.queueDrops.fetch_add( 1, std::memory_order_relaxed );
+    errorString_ = "MidiOutLoopback::sendMessage: cable full, message dropped!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+  counters_.countMessage( message, nBytes );
+}
+
+#endif  // __RTMIDI_LOOPBACK__
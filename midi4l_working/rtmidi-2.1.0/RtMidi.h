@@ -45,8 +45,11 @@
 
 #define RTMIDI_VERSION "2.1.0"
 
+#include <atomic>
+#include <cstring>
 #include <exception>
 #include <iostream>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -111,7 +114,473 @@ class RtMidiError : public std::exception
  */
 typedef void (*RtMidiErrorCallback)( RtMidiError::Type type, const std::string &errorText );
 
+//! Counters kept by each RtMidiIn and RtMidiOut object.
+/*!
+    Filled in by RtMidiIn::getStats() and RtMidiOut::getStats().  The
+    counts accumulate from the creation of the object or the last call
+    to resetStats().  Fields marked input or output are zero for the
+    other direction.
+*/
+struct RtMidiStats {
+  //! Number of bins in the callback time histogram.
+  static const unsigned int callbackBins = 16;
+
+  unsigned long long messages;       //!< Messages received, including dropped ones, or sent.
+  unsigned long long bytes;          //!< Bytes in those messages.
+  unsigned long long overruns;       //!< Messages lost below RtMidi: ALSA input buffer overruns (each may lose several events), JACK input ringbuffer and output port buffer drops.
+  unsigned long long queueDrops;     //!< Input: incoming messages dropped because the queue was full.  Output: messages the API had no room for.
+  unsigned long long queueDropsOldest; //!< Input: queued messages discarded by the DROP_OLDEST policy.
+  unsigned long long queueCoalesced; //!< Input: control changes merged by the COALESCE_CC policy.
+  unsigned long long queueGrowths;   //!< Input: times the GROW policy enlarged the queue.
+  unsigned long long sysexMessages;  //!< Sysex messages received, or sent.
+  unsigned int sysexPeakSize;        //!< Input (ALSA): size of the largest sysex message, see RtMidiIn::setSysexSizeHint().
+  unsigned int sysexReallocations;   //!< Input (ALSA): times the sysex buffer had to grow.
+  unsigned int queueHighWater;       //!< Input: most bytes held in the queue at once.
+
+  //! Input: histogram of the time spent in the user callback.
+  /*!
+      Bin 0 counts calls shorter than 1 microsecond, bin \e i calls
+      from 2^(i-1) up to 2^i microseconds and the last bin all longer
+      ones.  A batch callback counts once per call.
+  */
+  unsigned long long callbackTime[callbackBins];
+};
+
+//! An error reported by the input thread of an API, see RtMidiIn::enableErrorEvents().
+/*!
+    Each event stands for all occurrences of one kind of error since
+    the previous event of that kind.
+*/
+struct RtMidiErrorEvent {
+  //! The kinds of errors reported.
+  enum Code {
+    QUEUE_FULL,     /*!< Messages were dropped because the input queue was full. */
+    INPUT_OVERRUN,  /*!< Input was lost below RtMidi, in a driver or RtMidi's own ring buffer. */
+    PARSE_ERROR,    /*!< Incoming events could not be decoded. */
+    MEMORY_ERROR,   /*!< An input buffer could not be allocated or enlarged. */
+    SYSEX_ERROR,    /*!< A sysex buffer could not be handed back to the driver. */
+    PORT_CLOSED,    /*!< The connection to the port was closed. */
+    INPUT_ERROR,    /*!< Any other error while reading input. */
+    CODE_COUNT      /*!< The number of codes. */
+  };
+
+  Code code;                 //!< The kind of error.
+  unsigned long long count;  //!< Number of occurrences since the previous event of this kind.
+  const char *message;       //!< Description of the error, a string literal.
+};
+
+/************************************************************************/
+/*! \class RtMidiMessage
+    \brief A MIDI message that keeps short messages inline.
+
+    Channel and system messages (at most inlineCapacity bytes) are
+    stored inside the object itself, so creating, copying or queueing
+    them never touches the heap.  Longer messages, in practice sysex,
+    are kept in a heap block that is reused as long as it is large
+    enough: clear() and assign() keep it, so a message object reused
+    for a stream of messages stops allocating once it has seen the
+    largest one.  The interface follows std::vector<unsigned char> for
+    the operations RtMidi clients commonly use.
+*/
+/************************************************************************/
+
+class RtMidiMessage
+{
+ public:
+  //! Largest message size stored without a heap allocation.
+  static const unsigned int inlineCapacity = 16;
+
+  //! Delta-time of the message in seconds, filled in on input.
+  double timeStamp;
+
+  //! Create an empty message.
+  RtMidiMessage( void ) : timeStamp( 0.0 ), size_( 0 ), capacity_( inlineCapacity ) {}
+
+  //! Create a message holding a copy of \e nBytes bytes.
+  RtMidiMessage( const unsigned char *bytes, size_t nBytes, double deltaTime = 0.0 )
+    : timeStamp( deltaTime ), size_( 0 ), capacity_( inlineCapacity ) { assign( bytes, nBytes ); }
+
+  //! Create a one, two or three byte message.
+  RtMidiMessage( unsigned char status, int data1 = -1, int data2 = -1 )
+    : timeStamp( 0.0 ), size_( 1 ), capacity_( inlineCapacity )
+  {
+    storage_.bytes[0] = status;
+    if ( data1 >= 0 ) storage_.bytes[size_++] = (unsigned char) data1;
+    if ( data2 >= 0 ) storage_.bytes[size_++] = (unsigned char) data2;
+  }
+
+  RtMidiMessage( const RtMidiMessage &other )
+    : timeStamp( other.timeStamp ), size_( 0 ), capacity_( inlineCapacity ) { assign( other.data(), other.size_ ); }
+
+  RtMidiMessage& operator=( const RtMidiMessage &other )
+  {
+    if ( this != &other ) {
+      assign( other.data(), other.size_ );
+      timeStamp = other.timeStamp;
+    }
+    return *this;
+  }
+
+  ~RtMidiMessage( void ) { if ( !isInline() ) delete [] storage_.heap; }
+
+  //! Return true if the bytes are stored inside the object.
+  bool isInline( void ) const { return capacity_ == inlineCapacity; }
+
+  unsigned char *data( void ) { return isInline() ? storage_.bytes : storage_.heap; }
+  const unsigned char *data( void ) const { return isInline() ? storage_.bytes : storage_.heap; }
+  size_t size( void ) const { return size_; }
+  size_t capacity( void ) const { return capacity_; }
+  bool empty( void ) const { return size_ == 0; }
+  unsigned char& operator[]( size_t i ) { return data()[i]; }
+  const unsigned char& operator[]( size_t i ) const { return data()[i]; }
+
+  //! Remove all bytes, keeping any storage.
+  void clear( void ) { size_ = 0; }
+
+  //! Make room for \e nBytes bytes without changing the size.
+  void reserve( size_t nBytes ) { if ( nBytes > capacity_ ) reallocate( nBytes ); }
+
+  //! Change the size; new bytes are left uninitialised.
+  void resize( size_t nBytes ) { reserve( nBytes ); size_ = (unsigned int) nBytes; }
+
+  void assign( const unsigned char *bytes, size_t nBytes )
+  {
+    resize( nBytes );
+    if ( nBytes ) memcpy( data(), bytes, nBytes );
+  }
+
+  void push_back( unsigned char byte )
+  {
+    if ( size_ == capacity_ ) reallocate( 2 * capacity_ );
+    data()[size_++] = byte;
+  }
+
+  //! Exchange contents with another message without copying the bytes of long ones.
+  void swap( RtMidiMessage &other );
+
+ private:
+  void reallocate( size_t nBytes );
+
+  unsigned int size_;
+  unsigned int capacity_;
+  union {
+    unsigned char bytes[inlineCapacity];
+    unsigned char *heap;
+  } storage_;
+};
+
+/************************************************************************/
+/*! \class RtMidiUmp
+    \brief Translation between MIDI 1.0 bytes and Universal MIDI Packets.
+
+    A Universal MIDI Packet (UMP) is one, two or four 32-bit words;
+    the message type in the top four bits of the first word gives the
+    size.  Channel voice messages become a single word in the MIDI 1.0
+    protocol (message type 2) or two words with 16 and 32-bit values
+    in the MIDI 2.0 protocol (message type 4).  System messages become
+    one word (type 1) and sysex is split into two-word packets of up
+    to six bytes (type 3).  Values are converted with the min-center-max
+    scaling of the MIDI 2.0 specification, so a MIDI 1.0 value scaled
+    up and back down is unchanged.
+
+    The RtMidi APIs exchange MIDI 1.0 bytes with the system; packets
+    are translated at the edges, see RtMidiIn::setCallback() with an
+    RtMidiUmpCallback and RtMidiOut::sendUmp().
+*/
+/************************************************************************/
+
+class RtMidiUmp
+{
+ public:
+  //! UMP message types handled by RtMidi.
+  enum MessageType {
+    UTILITY = 0x0,        /*!< 32-bit utility messages (ignored). */
+    SYSTEM = 0x1,         /*!< 32-bit system common and real-time messages. */
+    MIDI1_CHANNEL = 0x2,  /*!< 32-bit MIDI 1.0 channel voice messages. */
+    DATA64 = 0x3,         /*!< 64-bit sysex (7-bit data) packets. */
+    MIDI2_CHANNEL = 0x4   /*!< 64-bit MIDI 2.0 channel voice messages. */
+  };
+
+  //! Representation of channel voice messages.
+  enum Protocol {
+    MIDI1,  /*!< One word per message, MIDI 1.0 resolution. */
+    MIDI2   /*!< Two words per message, MIDI 2.0 resolution. */
+  };
+
+  //! Return the number of words in the packet starting with \e word.
+  static unsigned int wordCount( uint32_t word );
+
+  //! Translate one MIDI 1.0 message into packets.
+  /*!
+    The packets are written to \e words if all of them fit in
+    \e maxWords words; otherwise nothing is written.  Messages other
+    than sysex take a single packet.
+
+    \return The number of words needed, or zero for an empty message.
+  */
+  static unsigned int fromBytes( const unsigned char *bytes, size_t size, uint32_t *words,
+                                 unsigned int maxWords, Protocol protocol = MIDI1, unsigned int group = 0 );
+
+  //! Translate one packet into MIDI 1.0 bytes.
+  /*!
+    At most maxBytes bytes are written to \e bytes.  A sysex packet
+    gives its data bytes, preceded by 0xF0 if it starts a message and
+    followed by 0xF7 if it ends one.  A MIDI 2.0 program change with a
+    bank, or a registered or non-registered controller, gives several
+    complete messages back to back.  Packets without a MIDI 1.0
+    equivalent, such as utility messages and per-note controllers,
+    give no bytes.
+
+    \return The number of bytes written.
+  */
+  static unsigned int toBytes( const uint32_t *packet, unsigned char *bytes );
+
+  //! Largest number of bytes written by toBytes().
+  static const unsigned int maxBytes = 12;
+
+  //! Scale a value of \e srcBits bits up to \e dstBits bits.
+  static uint32_t scaleUp( uint32_t value, unsigned int srcBits, unsigned int dstBits );
+
+  //! Scale a value of \e srcBits bits down to \e dstBits bits.
+  static uint32_t scaleDown( uint32_t value, unsigned int srcBits, unsigned int dstBits )
+  { return value >> ( srcBits - dstBits ); }
+};
+
+/************************************************************************/
+/*! \class RtMidiTransform
+    \brief Remaps channels, notes, velocities and controllers with lookup tables.
+
+    The mapping is set up with the set functions, which work on a
+    staging copy, and takes effect when commit() is called.  apply()
+    then transforms a channel message with a single lookup in each of
+    a 16 by 128 note map, a 128-entry velocity table, a 128-entry
+    controller table and a 16-entry channel table, so it takes the
+    same short time for any mapping and may be called from an input
+    thread while another thread commits a new mapping.
+
+    Channels are numbered from 0 to 15.  A negative output channel,
+    note or controller drops the matching messages.  The note map
+    applies to note on, note off and polyphonic key pressure, so a
+    note off follows its note on as long as the mapping does not
+    change in between.  Other channel messages are only moved to the
+    mapped channel, and system messages are never changed.
+*/
+/************************************************************************/
+
+class RtMidiTransform
+{
+ public:
+  //! The default constructor sets up and commits the identity mapping.
+  RtMidiTransform( void );
+
+  //! The destructor must not be called while apply() is in progress.
+  ~RtMidiTransform( void );
+
+  //! Reset the staged mapping to the identity.
+  void reset( void );
+
+  //! Send the messages of \e channel to \e outChannel.
+  /*!
+    This also resets the note map of \e channel, so it should come
+    before any transposition or split of the same channel.
+  */
+  void setChannel( unsigned int channel, int outChannel );
+
+  //! Transpose all notes of \e channel by \e semitones, dropping the notes that fall out of range.
+  void setTranspose( unsigned int channel, int semitones );
+
+  //! Send the notes of \e channel from \e lowNote to \e highNote to \e outChannel, transposed by \e semitones.
+  /*!
+    Splits are set in order, so a later split overrides an earlier
+    one where their ranges overlap.
+  */
+  void setSplit( unsigned int channel, unsigned int lowNote, unsigned int highNote,
+                 int outChannel, int semitones = 0 );
+
+  //! Map a single note of \e channel to \e outNote on \e outChannel.
+  void setNote( unsigned int channel, unsigned int note, int outChannel, int outNote );
+
+  //! Map the note on velocity \e velocity, from 1 to 127, to \e outVelocity, which is kept from 1 to 127.
+  void setVelocity( unsigned int velocity, unsigned int outVelocity );
+
+  //! Map velocities along a curve from \e minVelocity to \e maxVelocity.
+  /*!
+    An \e exponent of 1 gives a straight line, larger values soften
+    and smaller values harden the response.
+  */
+  void setVelocityCurve( double exponent, unsigned int minVelocity = 1, unsigned int maxVelocity = 127 );
+
+  //! Renumber control change \e control, on all channels, to \e outControl.
+  void setControl( unsigned int control, int outControl );
+
+  //! Make the staged mapping the one used by apply().
+  /*!
+    Waits for calls to apply() in progress with the previous mapping
+    to return, which takes no longer than one call.
+  */
+  void commit( void );
+
+  //! Transform \e message in place, returning false if it is dropped.
+  /*!
+    This function never blocks or allocates.  Only one thread may
+    apply at a time.
+  */
+  bool apply( unsigned char *message, size_t size ) const;
+
+ private:
+  RtMidiTransform( const RtMidiTransform & );
+  RtMidiTransform &operator=( const RtMidiTransform & );
+
+  void *data_;
+};
+
+/************************************************************************/
+/*! \class RtMidiControlAssembler
+    \brief Joins controller sequences into 14-bit controller and parameter changes.
+
+    A 14-bit controller change is sent as a controller from 0 to 31
+    with the high seven bits followed by the controller 32 higher
+    with the low seven bits.  A registered (RPN) or non-registered
+    (NRPN) parameter change selects the parameter with controllers
+    101 and 100, or 99 and 98, then sends its value with data entry
+    controllers 6 and 38.  process() follows these sequences for each
+    channel and returns one event once a value is complete, so a
+    consumer sees a single message instead of up to four.
+
+    14-bit controllers are only joined for the controllers set with
+    setCc14(), since most devices send 7-bit controllers on the same
+    numbers.  As with parameters, a 14-bit value is either complete
+    when its LSB arrives or, for controllers that may move only their
+    MSB, complete with the MSB and refined by an LSB.  Data increment and decrement controllers are passed on
+    unchanged.  The settings may be changed while another thread
+    processes messages; the sequence state belongs to that thread.
+*/
+/************************************************************************/
+
+class RtMidiControlAssembler
+{
+ public:
+  //! What process() did with a message.
+  enum Result {
+    PASS,   /*!< The message is not part of a sequence and is left for the caller. */
+    HOLD,   /*!< The message was taken as part of a sequence that is not complete yet. */
+    EVENT   /*!< The message completed a value, given in the event. */
+  };
+
+  //! The kinds of events.
+  enum Type {
+    CC14,   /*!< A 14-bit controller change; the number is the controller from 0 to 31. */
+    RPN,    /*!< A registered parameter change. */
+    NRPN    /*!< A non-registered parameter change. */
+  };
+
+  //! How parameter changes are joined.
+  enum ParameterMode {
+    PARAMETERS_OFF,     /*!< Parameter controllers are passed on unchanged (the default). */
+    PARAMETERS_FINE,    /*!< A value is complete when its data entry LSB arrives. */
+    PARAMETERS_COARSE   /*!< A value is complete with its data entry MSB; an LSB that follows refines it. */
+  };
+
+  //! A complete value.  Parameter numbers and values have 14 bits.
+  struct Event {
+    Type type;
+    unsigned int channel;
+    unsigned int number;
+    unsigned int value;
+  };
+
+  //! The default constructor joins nothing.
+  RtMidiControlAssembler( void );
+
+  //! Forget all sequences in progress and the parameters selected.
+  void reset( void );
+
+  //! Set how parameter changes are joined.
+  void setParameterMode( ParameterMode mode );
+
+  //! Join controller \e control, from 0 to 31, with controller \e control + 32, on all channels.
+  /*!
+    By default the MSB is held until its LSB arrives.  If \e coarse
+    is true, the MSB gives a value at once, with the LSB taken as
+    zero as MIDI requires, and an LSB that follows refines it.
+  */
+  void setCc14( unsigned int control, bool enable = true, bool coarse = false );
+
+  //! Returns true if any joining is enabled.
+  bool isActive( void ) const;
+
+  //! Follow one message, writing \e event if it completes a value.
+  /*!
+    This function never blocks or allocates.  Only one thread may
+    process at a time.
+  */
+  Result process( const unsigned char *message, size_t size, Event *event );
+
+ private:
+  struct ChannelState {
+    int parameterType;             // -1 when no parameter is selected
+    unsigned char parameter[2];    // MSB and LSB of the parameter number
+    unsigned char dataMsb;
+    unsigned char ccMsb[32];
+  };
+
+  ChannelState channels_[16];
+  std::atomic<int> parameterMode_;
+  std::atomic<uint32_t> cc14_;
+  std::atomic<uint32_t> cc14Coarse_;
+};
+
+/************************************************************************/
+/*! \class RtMidiNoteTracker
+    \brief Remembers which notes are sounding, to release them later.
+
+    Messages sent to a port are passed to track(), which keeps one
+    bit per note and channel.  release() then gives exactly one note
+    off for each note still on, for example before the port is
+    closed or switched, so that no note is left hanging and no note
+    off is sent for nothing.  A tracker is not thread-safe; it should
+    be used by the thread that sends.
+*/
+/************************************************************************/
+
+class RtMidiNoteTracker
+{
+ public:
+  //! The default constructor starts with no notes on.
+  RtMidiNoteTracker( void );
+
+  //! Follow one message sent.
+  /*!
+    A note on sets the bit of its note and a note off, or a note on
+    with zero velocity, clears it.  The all sound off and all notes
+    off controllers clear their channel and a system reset clears
+    every channel.
+  */
+  void track( const unsigned char *message, size_t size );
+
+  //! Return the number of notes on.
+  unsigned int getCount( void ) const;
+
+  //! Add the notes on in \e other to those of this tracker.
+  void merge( const RtMidiNoteTracker &other );
+
+  //! Forget all notes without releasing them.
+  void clear( void );
+
+  //! Append a note off for each note on to \e messages, three bytes each, and forget the notes.
+  /*!
+    Returns the number of note offs appended.  They are ordered by
+    channel and then by note.
+  */
+  unsigned int release( std::vector<unsigned char> *messages );
+
+ private:
+  uint64_t notes_[16][2];
+  unsigned int count_;
+};
+
 class MidiApi;
+class RtMidiRecorder;
 
 class RtMidi
 {
@@ -124,7 +593,8 @@ class RtMidi
     LINUX_ALSA,     /*!< The Advanced Linux Sound Architecture API. */
     UNIX_JACK,      /*!< The JACK Low-Latency MIDI Server API. */
     WINDOWS_MM,     /*!< The Microsoft Multimedia MIDI API. */
-    RTMIDI_DUMMY    /*!< A compilable but non-functional API. */
+    RTMIDI_LOOPBACK, /*!< In-process virtual cables between RtMidi ports. */
+    RTMIDI_DUMMY = RTMIDI_LOOPBACK /*!< Former name of RTMIDI_LOOPBACK. */
   };
 
   //! A static function to determine the current RtMidi version.
@@ -210,23 +680,100 @@ class RtMidiIn : public RtMidi
   //! User callback function type definition.
   typedef void (*RtMidiCallback)( double timeStamp, std::vector<unsigned char> *message, void *userData);
 
+  //! User callback function type definition for zero-copy delivery.
+  /*!
+    The message bytes are only valid for the duration of the call;
+    they point straight into the API's decode buffer so no vector is
+    built for each message.  The port tag is the value given to
+    setCallback() and can be used to tell ports apart when one
+    function serves several RtMidiIn instances.
+  */
+  typedef void (*RtMidiSpanCallback)( double timeStamp, const unsigned char *message, size_t size, unsigned int portTag, void *userData );
+
+  //! Location of one message in the buffer filled by getMessages().
+  struct MessageRecord {
+    size_t offset;     /*!< Offset of the first message byte in the buffer. */
+    size_t size;       /*!< Number of message bytes. */
+    double timeStamp;  /*!< Delta-time of the message in seconds. */
+  };
+
+  //! User callback function type definition for batched delivery.
+  /*!
+    Backends that gather several messages per wakeup of their input
+    thread (currently ALSA) hand all of them over in one call, laid
+    out like the output of getMessages(); the others call it with a
+    single record.  The buffer and records are only valid for the
+    duration of the call.
+  */
+  typedef void (*RtMidiBatchCallback)( const unsigned char *buffer, const MessageRecord *records, unsigned int count, unsigned int portTag, void *userData );
+
+  //! User callback function type definition for RtMidiMessage delivery.
+  /*!
+    The message, with its delta-time in \e timeStamp, is only valid
+    for the duration of the call.  Unlike the vector callback, no
+    heap memory is touched for messages of up to
+    RtMidiMessage::inlineCapacity bytes.
+  */
+  typedef void (*RtMidiMessageCallback)( const RtMidiMessage &message, unsigned int portTag, void *userData );
+
+  //! User callback function type definition for Universal MIDI Packet delivery.
+  /*!
+    Each incoming message is translated with RtMidiUmp::fromBytes()
+    and handed over as \e count words holding one packet, or several
+    for sysex.  The words are only valid for the duration of the call.
+  */
+  typedef void (*RtMidiUmpCallback)( double timeStamp, const uint32_t *words, unsigned int count, unsigned int portTag, void *userData );
+
+  //! Ways of handling a message that does not fit in the input queue, see setOverflowPolicy().
+  enum OverflowPolicy {
+    DROP_NEWEST,  /*!< Discard the incoming message (the default). */
+    DROP_OLDEST,  /*!< Discard the oldest queued messages until the incoming one fits. */
+    GROW,         /*!< Enlarge the queue, up to a byte cap, then discard the incoming message. */
+    COALESCE_CC   /*!< Merge control changes into a queued one for the same controller, otherwise discard the incoming message. */
+  };
+
+  //! Queue overflow notification function type definition.
+  /*!
+    Called on the input thread with the message that overflowed the
+    queue and the action taken for it: DROP_NEWEST if it was
+    discarded, or the policy that made room for it.  It should return
+    quickly and must not call back into the RtMidiIn object.
+  */
+  typedef void (*RtMidiOverflowCallback)( OverflowPolicy action, const unsigned char *message, size_t size, void *userData );
+
+  //! Filter function type definition for messages about to be queued.
+  /*!
+    Called on the input thread with each message before it is pushed
+    onto the queue.  The bytes are a copy that the filter may change
+    in place, keeping the size; returning false keeps the message out
+    of the queue.  It should return quickly and must not call back
+    into the RtMidiIn object.
+  */
+  typedef bool (*RtMidiQueueFilter)( double timeStamp, unsigned char *message, size_t size, void *userData );
+
   //! Default constructor that allows an optional api, client name and queue size.
   /*!
     An exception will be thrown if a MIDI system initialization
-    error occurs.  The queue size defines the maximum number of
-    messages that can be held in the MIDI queue (when not using a
-    callback function).  If the queue size limit is reached,
-    incoming messages will be ignored.
+    error occurs.  The queue size determines how many messages can
+    be held in the MIDI queue (when not using a callback function).
+    If the queue is full, incoming messages will be ignored unless
+    another policy is chosen with setOverflowPolicy().
 
     If no API argument is specified and multiple API support has been
     compiled, the default order of use is ALSA, JACK (Linux) and CORE,
-    JACK (OS-X).
+    JACK (OS-X).  The loopback API is only chosen when it is the only
+    one compiled or when asked for explicitly.
 
     \param api        An optional API id can be specified.
     \param clientName An optional client name can be specified. This
                       will be used to group the ports that are created
                       by the application.
     \param queueSizeLimit An optional size of the MIDI input queue can be specified.
+                          The queue is a ring of bytes sized to hold at least
+                          this many three-byte messages, and never less than
+                          64 KB so that a sysex message of up to that size
+                          can be queued whole; sysex messages take
+                          proportionally more of it.
   */
   RtMidiIn( RtMidi::Api api=UNSPECIFIED,
             const std::string clientName = std::string( "RtMidi Input Client"),
@@ -271,6 +818,47 @@ class RtMidiIn : public RtMidi
   */
   void setCallback( RtMidiCallback callback, void *userData = 0 );
 
+  //! Set a zero-copy callback function to be invoked for incoming MIDI messages.
+  /*!
+    This behaves like the vector version of setCallback() but hands
+    the callback a pointer and length into the API's own buffer.  Only
+    one callback of either kind can be set at a time.
+
+    \param callback A callback function must be given.
+    \param userData Optionally, a pointer to additional data can be
+                    passed to the callback function whenever it is called.
+    \param portTag   Optionally, a value passed back to the callback to
+                    identify this port.
+  */
+  void setCallback( RtMidiSpanCallback callback, void *userData = 0, unsigned int portTag = 0 );
+
+  //! Set a callback function to be invoked with batches of incoming MIDI messages.
+  /*!
+    This behaves like the zero-copy version of setCallback() but is
+    invoked once per group of messages received together, which
+    saves per-message overhead and synchronisation in the callback
+    during bursts.  Only one callback of any kind can be set at a time.
+  */
+  void setCallback( RtMidiBatchCallback callback, void *userData = 0, unsigned int portTag = 0 );
+
+  //! Set a callback function to be invoked with each incoming message as an RtMidiMessage.
+  /*!
+    This behaves like the zero-copy version of setCallback() but
+    hands over a message object, which can be copied or kept by the
+    callback without allocating for channel messages.  Only one
+    callback of any kind can be set at a time.
+  */
+  void setCallback( RtMidiMessageCallback callback, void *userData = 0, unsigned int portTag = 0 );
+
+  //! Set a callback function to be invoked with incoming messages as Universal MIDI Packets.
+  /*!
+    Channel voice messages are given in the chosen \e protocol and
+    all packets carry the UMP \e group (0-15).  Only one callback of
+    any kind can be set at a time.
+  */
+  void setCallback( RtMidiUmpCallback callback, void *userData = 0, unsigned int portTag = 0,
+                    RtMidiUmp::Protocol protocol = RtMidiUmp::MIDI1, unsigned int group = 0 );
+
   //! Cancel use of the current callback function (if one exists).
   /*!
     Subsequent incoming MIDI messages will be written to the queue
@@ -307,6 +895,104 @@ class RtMidiIn : public RtMidi
   */
   void ignoreTypes( bool midiSysex = true, bool midiTime = true, bool midiSense = true );
 
+  //! Set the size, in bytes, of the largest sysex message expected on input (default = 1024).
+  /*!
+    APIs that reassemble segmented sysex messages themselves
+    (currently ALSA) preallocate their buffer to this size when a
+    port is opened, so that messages up to this size are received
+    without allocating on the input thread.  Larger messages are
+    still received; the buffer then doubles in size as needed and
+    keeps the extra memory for later messages.
+  */
+  void setSysexSizeHint( unsigned int nBytes );
+
+  //! Report the size of the largest sysex message received and the number of times the sysex buffer had to grow.
+  /*!
+    Either pointer may be NULL.  The counts accumulate for the life
+    of the object and can be compared against the value given to
+    setSysexSizeHint().
+  */
+  void getSysexStats( unsigned int *peakSize, unsigned int *reallocations );
+
+  //! Set the scheduling of the input thread used by the API, if it has one.
+  /*!
+    A \e priority greater than zero requests the SCHED_FIFO real-time
+    policy at that priority (clamped to the system maximum); zero
+    keeps the default time-sharing policy.  A \e cpu of zero or more
+    pins the thread to that processor.  The setting takes effect the
+    next time a port is opened.  Only the ALSA API runs its own input
+    thread, so the other APIs ignore it.  If the thread cannot be
+    started with the requested settings, usually for lack of
+    privilege, a warning is issued and default scheduling is used.
+  */
+  void setThreadScheduling( int priority, int cpu = -1 );
+
+  //! Choose what happens when a message does not fit in the input queue.
+  /*!
+    The queue only holds messages while no callback is set.  With
+    DROP_OLDEST, queued messages are discarded from the front to make
+    room.  With GROW, the queue doubles in size as often as needed up
+    to \e maxBytes; set this policy before opening a port, since the
+    queue is reallocated (and emptied) when \e maxBytes exceeds its
+    current allocation.  With COALESCE_CC, once the queue is more than
+    half full an incoming control change updates the value of the
+    latest queued one for the same channel and controller instead of
+    taking more room, which keeps space for note messages.  Each
+    action is counted in RtMidiStats and reported to the optional
+    \e callback.
+  */
+  void setOverflowPolicy( OverflowPolicy policy, unsigned int maxBytes = 0,
+                          RtMidiOverflowCallback callback = 0, void *userData = 0 );
+
+  //! Copy every message delivered by this port into \e recorder, or stop copying if \e recorder is NULL.
+  /*!
+    Messages are recorded on the input thread before they are handed
+    to the callback or the queue, whatever kind of callback is set.
+    The recorder is not owned by the port and must not be destroyed
+    while it is set on an open port.
+  */
+  void setRecorder( RtMidiRecorder *recorder );
+
+  //! Run \e filter on the input thread for every message before it is queued, or stop if \e filter is NULL.
+  /*!
+    This lets work that must not wait for getMessage(), such as
+    forwarding to an output port, happen as messages arrive while the
+    queue and its overflow policy still serve the application.  The
+    filter is not called while a callback is set.  Set it while no
+    port is open.
+  */
+  void setQueueFilter( RtMidiQueueFilter filter, void *userData = 0 );
+
+  //! Queue the errors reported by the input thread as events instead of printing them.
+  /*!
+    Errors that happen while input is received, such as a full queue
+    or a driver overrun, are counted and queued without blocking the
+    input thread, to be collected with getErrorEvents().  At most one
+    event of each kind is produced per \e interval seconds, giving
+    the number of times the error happened meanwhile.  When events are
+    disabled, which is the default, such errors are printed to
+    std::cerr on the input thread, with the same limit.
+  */
+  void enableErrorEvents( bool enable = true, double interval = 1.0 );
+
+  //! Collect up to \e maxEvents error events and return the number written to \e events.
+  /*!
+    Only one thread may collect events.  Events of a kind that was
+    reported less than the interval after its previous event are held
+    back until the interval has passed.
+  */
+  unsigned int getErrorEvents( RtMidiErrorEvent *events, unsigned int maxEvents );
+
+  //! Copy the counters of this port into \e stats.
+  /*!
+    The counters are updated with relaxed atomic operations from the
+    input thread and can be read at any time.
+  */
+  void getStats( RtMidiStats *stats );
+
+  //! Set all counters, including the sysex statistics, back to zero.
+  void resetStats( void );
+
   //! Fill the user-provided vector with the data bytes for the next available MIDI message in the input queue and return the event delta-time in seconds.
   /*!
     This function returns immediately whether a new message is
@@ -317,6 +1003,43 @@ class RtMidiIn : public RtMidi
   */
   double getMessage( std::vector<unsigned char> *message );
 
+  //! Fill the user-provided RtMidiMessage with the next available MIDI message in the input queue.
+  /*!
+    This behaves like the vector version of getMessage() and also
+    stores the delta-time in the message.  Reusing one message object
+    for every call keeps retrieval free of heap allocation.
+  */
+  double getMessage( RtMidiMessage *message );
+
+  //! Drain all pending messages from the input queue into a user-provided buffer in one call.
+  /*!
+    The message bytes are packed back to back into \e buffer and one
+    record per message, giving its offset, size and delta-time, is
+    written to \e records.  Draining stops when the queue is empty,
+    \e maxRecords records have been written, or the next message does
+    not fit in the remaining buffer space; that message is left in
+    the queue for the next call.  Like getMessage(), this function
+    returns immediately and issues a warning if a user callback is
+    set.
+
+    A message larger than \e capacity, such as a long sysex dump,
+    can never be copied, so every call returns zero while it waits at
+    the front of the queue and the messages behind it pile up.  When
+    zero is returned, getNextMessageSize() tells whether this is the
+    case and how large the buffer must be.
+
+    \return The number of messages copied.
+  */
+  unsigned int getMessages( unsigned char *buffer, size_t capacity, MessageRecord *records, unsigned int maxRecords );
+
+  //! Return the size in bytes of the oldest message in the input queue, or zero if the queue is empty.
+  /*!
+    Use this to grow the buffer given to getMessages() when a message
+    does not fit in it.  Like getMessage(), this function returns
+    immediately and issues a warning if a user callback is set.
+  */
+  size_t getNextMessageSize( void );
+
   //! Set an error callback function to be invoked when an error has occured.
   /*!
     The callback function will be called whenever an error has occured. It is best
@@ -355,7 +1078,8 @@ class RtMidiOut : public RtMidi
 
     If no API argument is specified and multiple API support has been
     compiled, the default order of use is ALSA, JACK (Linux) and CORE,
-    JACK (OS-X).
+    JACK (OS-X).  The loopback API is only chosen when it is the only
+    one compiled or when asked for explicitly.
   */
   RtMidiOut( RtMidi::Api api=UNSPECIFIED,
              const std::string clientName = std::string( "RtMidi Output Client") );
@@ -404,10 +1128,96 @@ class RtMidiOut : public RtMidi
   //! Immediately send a single message out an open MIDI output port.
   /*!
       An exception is thrown if an error occurs during output or an
-      output connection was not previously established.
+      output connection was not previously established.  With the
+      ALSA API, long sysex messages are written in chunks and this
+      function waits while the output pool is full.  A sysex message
+      is only started once the pool has room for all of it, and is
+      then never cut short; if no room becomes available within the
+      timeout set with setSysexChunking() (default = one second),
+      the whole message is dropped with a warning.  Callers that
+      must not block should use trySendMessage() instead.
   */
   void sendMessage( std::vector<unsigned char> *message );
 
+  //! Immediately send a single message held in an RtMidiMessage.
+  void sendMessage( const RtMidiMessage *message );
+
+  //! Immediately send a single message of \e size bytes.
+  /*!
+      The vector and RtMidiMessage versions of sendMessage() forward
+      to this one, which the APIs implement directly.
+  */
+  void sendMessage( const unsigned char *message, size_t size );
+
+  //! Send several complete messages, packed back to back in \e size bytes, in one go.
+  /*!
+      Each message must start with its status byte; running status is
+      not supported.  With the ALSA API short messages are gathered in
+      the client's output buffer and reach the sequencer together, and
+      with JACK the messages are queued at once for the same cycle,
+      dropping those that do not fit.  The other APIs send them one
+      at a time.  Blocking and
+      timeouts are as for sendMessage().  A warning is issued, and
+      nothing more is sent, at the first message that is invalid or
+      cut short.
+  */
+  void sendMessages( const unsigned char *messages, size_t size );
+
+  //! Send as much of a message as can be accepted without blocking.
+  /*!
+      Starting at byte \e offset, the message is written until it is
+      complete or the output is congested.  Sysex messages are
+      written in chunks (see setSysexChunking()) and may be accepted
+      in part; call again later with the returned offset to continue.
+      Other messages are accepted whole or not at all.  APIs without
+      flow control (all but ALSA) send the whole message at once.
+
+      \return The offset of the first byte not yet sent, which equals
+      the message size once the message has been sent completely.
+  */
+  size_t trySendMessage( const std::vector<unsigned char> *message, size_t offset = 0 );
+
+  //! Send as much of an RtMidiMessage as can be accepted without blocking.
+  size_t trySendMessage( const RtMidiMessage *message, size_t offset = 0 );
+
+  //! Send \e count words of Universal MIDI Packets.
+  /*!
+      Each packet is translated with RtMidiUmp::toBytes() and sent as
+      MIDI 1.0 messages, so MIDI 2.0 values are scaled down.  Sysex
+      packets are gathered until the message is complete, which may
+      take several calls.  Packets without a MIDI 1.0 equivalent are
+      skipped, and a warning is issued if \e count ends inside a
+      packet.
+  */
+  void sendUmp( const uint32_t *words, unsigned int count );
+
+  //! Set the chunk size used for long sysex messages, the size of the output pool and the send timeout.
+  /*!
+      Used by the ALSA API only.  Sysex messages longer than \e chunkSize
+      bytes (default = 256) are written as several events.  A \e poolSize
+      greater than zero sets the number of cells in the sequencer's
+      output pool for this client, allowing more data in flight.
+      sendMessage() waits up to \e timeout milliseconds (default =
+      1000) for room in the pool before dropping a message; zero
+      makes it wait as long as it takes.
+  */
+  void setSysexChunking( unsigned int chunkSize, unsigned int poolSize = 0, unsigned int timeout = 1000 );
+
+  //! Simulate the link characteristics of a loopback output port.
+  /*!
+      Used by the RTMIDI_LOOPBACK API only.  Each message sent is
+      delivered \e latency seconds after it has been fully transmitted
+      at \e bytesPerSecond (default = 0, unlimited).  A DIN MIDI cable
+      carries 3125 bytes per second.  Takes effect for the next message.
+  */
+  void setLoopbackLink( double latency, double bytesPerSecond = 0.0 );
+
+  //! Copy the counters of this port into \e stats.
+  void getStats( RtMidiStats *stats );
+
+  //! Set all counters back to zero.
+  void resetStats( void );
+
   //! Set an error callback function to be invoked when an error has occured.
   /*!
     The callback function will be called whenever an error has occured. It is best
@@ -419,6 +1229,254 @@ class RtMidiOut : public RtMidi
   void openMidiApi( RtMidi::Api api, const std::string clientName );
 };
 
+// **************************************************************** //
+//
+// RtMidiRecorder, RtMidiLog and RtMidiPlayer class declarations.
+//
+// An RtMidiRecorder writes the messages delivered by an RtMidiIn
+// port to a log file, an RtMidiLog reads such a log back and an
+// RtMidiPlayer replays it with its original timing.  The
+// log starts with a 64-byte header, followed by one record per
+// message: the time in nanoseconds since the first message, the
+// message size and the message bytes, padded to a multiple of eight
+// bytes.  When the recorder is closed, an index giving the time and
+// file offset of every 1024th message is appended.  All values are
+// in the byte order of the machine that wrote the log.
+//
+// **************************************************************** //
+
+/**********************************************************************/
+/*! \class RtMidiRecorder
+    \brief Records incoming MIDI messages to an append-only log file.
+
+    Once set on a port with RtMidiIn::setRecorder(), every message
+    the port delivers is copied, with its time, into a lock-free queue
+    on the input thread.  A background thread moves the messages into
+    the log file, which is memory-mapped and extended in large steps,
+    so that the input thread never waits for the disk.  If the queue
+    is full, the message is not recorded and is counted as dropped.
+    A log that was not closed, for example after a crash, can still
+    be read up to the last message written.
+*/
+/**********************************************************************/
+
+class RtMidiRecorder
+{
+ public:
+
+  //! Default constructor.
+  RtMidiRecorder( void );
+
+  //! The destructor closes the log if it is open.
+  ~RtMidiRecorder( void );
+
+  //! Create the log \e fileName, replacing any existing file, and start recording.
+  /*!
+    \e queueSize is the size in bytes of the queue between the input
+    thread and the writer thread.  An exception is thrown if a log is
+    already open or if the file cannot be created.
+  */
+  void open( const std::string &fileName, unsigned int queueSize = 1 << 20 );
+
+  //! Stop recording, write the queued messages and the index and close the log.
+  /*!
+    Calls to record() in progress on other threads are waited for.
+    An exception is thrown if the log could not be extended while
+    recording, for example because the disk is full; the log is then
+    closed after the last message that was written.
+  */
+  void close( void );
+
+  //! Returns true if a log is open.
+  bool isOpen( void ) const;
+
+  //! Queue one message for the log.
+  /*!
+    This function never blocks or allocates and may be called from
+    the input thread.  \e deltaTime is the time in seconds since the
+    previous message, as given by RtMidiIn; the first message is
+    recorded at time zero.  Returns false if no log is open or the
+    queue is full.  Only one thread may record at a time.
+  */
+  bool record( double deltaTime, const unsigned char *message, size_t size );
+
+  //! Return the number of messages written to the log since it was opened.
+  unsigned long long getRecordedCount( void ) const;
+
+  //! Return the number of messages lost since the log was opened because the queue was full or the log could not be extended.
+  unsigned long long getDroppedCount( void ) const;
+
+ private:
+  RtMidiRecorder( const RtMidiRecorder & );
+  RtMidiRecorder &operator=( const RtMidiRecorder & );
+
+  void *data_;
+};
+
+/**********************************************************************/
+/*! \class RtMidiLog
+    \brief Reads a log written by RtMidiRecorder or a Standard MIDI File.
+
+    The log file is memory-mapped, so messages are returned without
+    being copied and seeking by time only reads the index and the
+    records after the nearest index entry.  A Standard MIDI File of
+    any format is translated into a log in memory when it is opened,
+    with the tracks merged and the ticks converted to seconds using
+    the tempo map of the file.
+*/
+/**********************************************************************/
+
+class RtMidiLog
+{
+ public:
+
+  //! Default constructor.
+  RtMidiLog( void );
+
+  //! The destructor closes the log if it is open.
+  ~RtMidiLog( void );
+
+  //! Open the log or Standard MIDI File \e fileName and position it at its first message.
+  /*!
+    An exception is thrown if the file cannot be read or is neither
+    a log nor a Standard MIDI File.  A log without an index is
+    indexed while it is opened.
+  */
+  void open( const std::string &fileName );
+
+  //! Close the log (if one is open).
+  void close( void );
+
+  //! Returns true if a log is open.
+  bool isOpen( void ) const;
+
+  //! Return the number of messages in the log.
+  unsigned long long getMessageCount( void ) const;
+
+  //! Return the time of the last message in seconds.
+  double getDuration( void ) const;
+
+  //! Position the log at its first message at or after \e time seconds.
+  void seek( double time );
+
+  //! Return the next message and its time in seconds, or false at the end of the log.
+  /*!
+    \e message points into the log and remains valid until the log
+    is closed.
+  */
+  bool next( double *time, const unsigned char **message, size_t *size );
+
+  //! Write the whole log as a format 0 Standard MIDI File.
+  /*!
+    The file has a resolution of 100 microseconds per tick.  Sysex
+    is written as sysex events, and other system messages as escaped
+    events.  An exception is thrown if no log is open or the file
+    cannot be written.
+  */
+  void writeSmf( const std::string &fileName );
+
+ private:
+  RtMidiLog( const RtMidiLog & );
+  RtMidiLog &operator=( const RtMidiLog & );
+
+  void *data_;
+};
+
+/**********************************************************************/
+/*! \class RtMidiPlayer
+    \brief Replays a log or a Standard MIDI File.
+
+    The messages are sent from a thread of the player to an RtMidiOut
+    port, to a callback function, or to both.  The time at which each
+    message is due is computed from the start of the replay and the
+    thread sleeps until that absolute time (with clock_nanosleep() on
+    Linux), so that the time taken to send the messages does not make
+    the replay drift.
+*/
+/**********************************************************************/
+
+class RtMidiPlayer
+{
+ public:
+
+  //! How the timing of the messages is followed.
+  enum Mode {
+    REAL_TIME,           /*!< The messages are sent at their original times. */
+    SCALED,              /*!< The times are divided by a speed factor. */
+    AS_FAST_AS_POSSIBLE  /*!< The messages are sent without waiting. */
+  };
+
+  //! User callback function type definition.
+  /*!
+    \e timeStamp is the time of the message in the file, in seconds.
+    The callback is invoked on the thread of the player.
+  */
+  typedef void (*RtMidiPlayerCallback)( double timeStamp, const unsigned char *message,
+                                        size_t size, void *userData );
+
+  //! Default constructor.
+  RtMidiPlayer( void );
+
+  //! The destructor stops the replay.
+  ~RtMidiPlayer( void );
+
+  //! Open a log or Standard MIDI File for replay, stopping any replay in progress.
+  /*!
+    An exception is thrown if the file cannot be opened, see
+    RtMidiLog::open().
+  */
+  void open( const std::string &fileName );
+
+  //! Stop the replay and close the file (if one is open).
+  void close( void );
+
+  //! Returns true if a file is open.
+  bool isOpen( void ) const;
+
+  //! Send the messages to \e midiout, or to no port if \e midiout is NULL.
+  /*!
+    The port is not owned by the player.  It can only be changed
+    while the player is stopped.
+  */
+  void setOutput( RtMidiOut *midiout );
+
+  //! Hand the messages to \e callback, or to no callback if \e callback is NULL.
+  /*!
+    The callback can only be changed while the player is stopped.
+  */
+  void setCallback( RtMidiPlayerCallback callback, void *userData = 0 );
+
+  //! Start replaying from \e from seconds into the file, stopping any replay in progress.
+  /*!
+    With the SCALED mode, a \e speed of 2.0 replays twice as fast
+    and 0.5 half as fast.  The replay stops by itself at the end of
+    the file.  An exception is thrown if no file is open or the
+    speed is not positive.
+  */
+  void start( Mode mode = REAL_TIME, double speed = 1.0, double from = 0.0 );
+
+  //! Stop the replay and wait for the thread of the player to finish.
+  void stop( void );
+
+  //! Returns true while a replay is in progress.
+  bool isPlaying( void ) const;
+
+  //! Return the time of the last message of the file in seconds.
+  double getDuration( void ) const;
+
+  //! Return the number of messages sent since the replay was started.
+  unsigned long long getPlayedCount( void ) const;
+
+  //! Return the longest time by which a message was sent after it was due, in seconds.
+  double getMaxLateness( void ) const;
+
+ private:
+  RtMidiPlayer( const RtMidiPlayer & );
+  RtMidiPlayer &operator=( const RtMidiPlayer & );
+
+  void *data_;
+};
+
 
 // **************************************************************** //
 //
@@ -453,6 +1511,29 @@ class MidiApi
   //! A basic error reporting function for RtMidi classes.
   void error( RtMidiError::Type type, std::string errorString );
 
+  virtual void getStats( RtMidiStats *stats );
+  virtual void resetStats( void );
+
+  // The atomic counterparts of RtMidiStats, updated by the API code
+  // on whichever thread handles the message.
+  struct Counters {
+    std::atomic<unsigned long long> messages;
+    std::atomic<unsigned long long> bytes;
+    std::atomic<unsigned long long> overruns;
+    std::atomic<unsigned long long> queueDrops;
+    std::atomic<unsigned long long> queueDropsOldest;
+    std::atomic<unsigned long long> queueCoalesced;
+    std::atomic<unsigned long long> queueGrowths;
+    std::atomic<unsigned long long> sysexMessages;
+    std::atomic<unsigned int> queueHighWater;
+    std::atomic<unsigned long long> callbackTime[RtMidiStats::callbackBins];
+
+    Counters() { reset(); }
+    void reset( void );
+    void countMessage( const unsigned char *bytes, unsigned int nBytes );
+    void countCallback( double seconds );
+  };
+
 protected:
   virtual void initialize( const std::string& clientName ) = 0;
 
@@ -460,6 +1541,7 @@ protected:
   bool connected_;
   std::string errorString_;
   RtMidiErrorCallback errorCallback_;
+  Counters counters_;
 };
 
 class MidiInApi : public MidiApi
@@ -469,54 +1551,163 @@ class MidiInApi : public MidiApi
   MidiInApi( unsigned int queueSizeLimit );
   virtual ~MidiInApi( void );
   void setCallback( RtMidiIn::RtMidiCallback callback, void *userData );
+  void setCallback( RtMidiIn::RtMidiSpanCallback callback, void *userData, unsigned int portTag );
+  void setCallback( RtMidiIn::RtMidiBatchCallback callback, void *userData, unsigned int portTag );
+  void setCallback( RtMidiIn::RtMidiMessageCallback callback, void *userData, unsigned int portTag );
+  void setCallback( RtMidiIn::RtMidiUmpCallback callback, void *userData, unsigned int portTag,
+                    RtMidiUmp::Protocol protocol, unsigned int group );
   void cancelCallback( void );
   virtual void ignoreTypes( bool midiSysex, bool midiTime, bool midiSense );
+  void setSysexSizeHint( unsigned int nBytes );
+  void getSysexStats( unsigned int *peakSize, unsigned int *reallocations );
+  void setThreadScheduling( int priority, int cpu );
+  void setOverflowPolicy( RtMidiIn::OverflowPolicy policy, unsigned int maxBytes,
+                          RtMidiIn::RtMidiOverflowCallback callback, void *userData );
+  void setRecorder( RtMidiRecorder *recorder );
+  void setQueueFilter( RtMidiIn::RtMidiQueueFilter filter, void *userData );
+  void enableErrorEvents( bool enable, double interval );
+  unsigned int getErrorEvents( RtMidiErrorEvent *events, unsigned int maxEvents );
+  void getStats( RtMidiStats *stats );
+  void resetStats( void );
   double getMessage( std::vector<unsigned char> *message );
+  double getMessage( RtMidiMessage *message );
+  unsigned int getMessages( unsigned char *buffer, size_t capacity, RtMidiIn::MessageRecord *records, unsigned int maxRecords );
+  size_t getNextMessageSize( void );
+
+  // A single-producer / single-consumer ring of bytes used to hold
+  // incoming messages when no callback is set.  Each message is
+  // stored as a length-prefixed record (byte count, time stamp, then
+  // the message bytes), so pushing and popping never allocate.  The
+  // ring size is a power of two and the front and back byte indices
+  // run freely, being masked only when the ring is accessed.  The
+  // input thread is the only writer of back.  The front index shares
+  // the head word with an edit sequence: the reader releases records
+  // with a compare-and-swap of the whole word, so the input thread can
+  // also discard records (dropOldest) or, while the sequence is odd,
+  // change queued ones (coalesce) without the reader committing a
+  // stale copy.  Only limit bytes of the ring are used; grow() raises
+  // it up to the ring size.
+  struct MidiQueue {
+    std::atomic<unsigned long long> head;
+    std::atomic<unsigned int> back;
+    unsigned int ringSize;
+    unsigned int limit;
+    unsigned int maxLimit;
+    unsigned char *ring;
 
-  // A MIDI structure used internally by the class to store incoming
-  // messages.  Each message represents one and only one MIDI message.
-  struct MidiMessage { 
-    std::vector<unsigned char> bytes; 
-    double timeStamp;
+    // Bytes used by the record header preceding each message.
+    static const unsigned int headerSize = sizeof(unsigned int) + sizeof(double);
+
+    // Smallest ring allocated by the constructor.
+    static const unsigned int minBytes = 65536;
 
     // Default constructor.
-  MidiMessage()
-  :bytes(0), timeStamp(0.0) {}
+  MidiQueue()
+  :head(0), back(0), ringSize(0), limit(0), maxLimit(0), ring(0) {}
+
+    void allocate( unsigned int nBytes );
+    bool push( const unsigned char *bytes, unsigned int nBytes, double timeStamp );
+    template <class Bytes> bool pop( Bytes *bytes, double *timeStamp );
+    bool peek( double *timeStamp ) const;
+    unsigned int nextSize( void ) const;
+    unsigned int popAll( unsigned char *buffer, size_t capacity, RtMidiIn::MessageRecord *records, unsigned int maxRecords );
+    bool dropOldest( void );
+    bool coalesce( const unsigned char *bytes );
+    bool grow( unsigned int nBytes );
+    bool empty( void ) const { return (unsigned int) head.load( std::memory_order_acquire ) == back.load( std::memory_order_acquire ); }
+    unsigned int used( void ) const { return back.load( std::memory_order_relaxed ) - (unsigned int) head.load( std::memory_order_acquire ); }
+
+  private:
+    void write( unsigned int index, const unsigned char *src, unsigned int nBytes );
+    void read( unsigned int index, unsigned char *dst, unsigned int nBytes ) const;
   };
 
-  struct MidiQueue {
-    unsigned int front;
-    unsigned int back;
-    unsigned int size;
-    unsigned int ringSize;
-    MidiMessage *ring;
+  // Errors reported by the input thread.  report() is lock-free and
+  // may be called from any thread: it counts the error and, unless an
+  // event for its code is already pending, puts the code in a ring.
+  // Since each code is pending at most once, the ring never fills.
+  // take() is called by a single consumer; it turns pending codes into
+  // events, at most one per code per interval, adding up the
+  // occurrences in between.  Unless events are enabled, report()
+  // prints the error instead, with the same limit.
+  struct ErrorEvents {
+    static const unsigned int ringSize = 16;
+    std::atomic<unsigned long long> counts[RtMidiErrorEvent::CODE_COUNT];
+    std::atomic<const char *> messages[RtMidiErrorEvent::CODE_COUNT];
+    std::atomic<bool> pending[RtMidiErrorEvent::CODE_COUNT];
+    std::atomic<double> lastPrinted[RtMidiErrorEvent::CODE_COUNT];
+    std::atomic<unsigned int> ring[ringSize];
+    std::atomic<unsigned int> tail;
+    std::atomic<bool> enabled;
+    std::atomic<double> interval;
+    unsigned int head;
+    unsigned int deferred;
+    double lastEvent[RtMidiErrorEvent::CODE_COUNT];
 
     // Default constructor.
-  MidiQueue()
-  :front(0), back(0), size(0), ringSize(0) {}
+    ErrorEvents();
+
+    void report( RtMidiErrorEvent::Code code, const char *message, unsigned long long count = 1 );
+    unsigned int take( RtMidiErrorEvent *events, unsigned int maxEvents );
   };
 
   // The RtMidiInData structure is used to pass private class data to
   // the MIDI input handling function or thread.
   struct RtMidiInData {
     MidiQueue queue;
-    MidiMessage message;
+    RtMidiMessage message;
+    RtMidiMessage callbackMessage;
+    std::vector<unsigned char> callbackVector;
     unsigned char ignoreFlags;
     bool doInput;
     bool firstMessage;
     void *apiData;
     bool usingCallback;
     RtMidiIn::RtMidiCallback userCallback;
+    RtMidiIn::RtMidiSpanCallback spanCallback;
+    RtMidiIn::RtMidiBatchCallback batchCallback;
+    RtMidiIn::RtMidiMessageCallback messageCallback;
+    RtMidiIn::RtMidiUmpCallback umpCallback;
+    RtMidiUmp::Protocol umpProtocol;
+    unsigned int umpGroup;
+    std::vector<uint32_t> umpWords;
+    unsigned int portTag;
     void *userData;
     bool continueSysex;
+    int threadPriority;
+    int threadCpu;
+    unsigned int sysexSizeHint;
+    std::atomic<unsigned int> sysexPeakSize;
+    std::atomic<unsigned int> sysexReallocations;
+    MidiApi::Counters *counters;
+    RtMidiIn::OverflowPolicy overflowPolicy;
+    RtMidiIn::RtMidiOverflowCallback overflowCallback;
+    void *overflowUserData;
+    RtMidiIn::RtMidiQueueFilter queueFilter;
+    void *queueFilterUserData;
+    std::atomic<RtMidiRecorder *> recorder;
+    ErrorEvents errors;
 
     // Default constructor.
   RtMidiInData()
   : ignoreFlags(7), doInput(false), firstMessage(true),
-      apiData(0), usingCallback(false), userCallback(0), userData(0),
-      continueSysex(false) {}
+      apiData(0), usingCallback(false), userCallback(0), spanCallback(0),
+      batchCallback(0), messageCallback(0), umpCallback(0),
+      umpProtocol(RtMidiUmp::MIDI1), umpGroup(0), portTag(0), userData(0), continueSysex(false),
+      threadPriority(0), threadCpu(-1), sysexSizeHint(1024),
+      sysexPeakSize(0), sysexReallocations(0), counters(0),
+      overflowPolicy(RtMidiIn::DROP_NEWEST), overflowCallback(0), overflowUserData(0),
+      queueFilter(0), queueFilterUserData(0), recorder(0) {}
   };
 
+  // Hand a complete message to the user callback or, if none is set,
+  // push it onto the queue.  The bytes are only copied for the vector
+  // and RtMidiMessage callbacks and the queue filter, into buffers
+  // kept in the input data.
+  // Returns false if the message was dropped because the queue is full.
+  static bool deliverMessage( RtMidiInData *data, double timeStamp, const unsigned char *bytes,
+                              unsigned int nBytes );
+
  protected:
   RtMidiInData inputData_;
 };
@@ -527,7 +1718,15 @@ class MidiOutApi : public MidiApi
 
   MidiOutApi( void );
   virtual ~MidiOutApi( void );
-  virtual void sendMessage( std::vector<unsigned char> *message ) = 0;
+  virtual void sendMessage( const unsigned char *message, size_t size ) = 0;
+  virtual void sendMessages( const unsigned char *messages, size_t size );
+  virtual size_t trySendMessage( const unsigned char *message, size_t size, size_t offset );
+  virtual void setSysexChunking( unsigned int chunkSize, unsigned int poolSize, unsigned int timeout );
+  virtual void setLoopbackLink( double latency, double bytesPerSecond );
+  void sendUmp( const uint32_t *words, unsigned int count );
+
+ protected:
+  RtMidiMessage umpSysex_;
 };
 
 // **************************************************************** //
@@ -542,11 +1741,28 @@ inline void RtMidiIn :: openVirtualPort( const std::string portName ) { rtapi_->
 inline void RtMidiIn :: closePort( void ) { rtapi_->closePort(); }
 inline bool RtMidiIn :: isPortOpen() const { return rtapi_->isPortOpen(); }
 inline void RtMidiIn :: setCallback( RtMidiCallback callback, void *userData ) { ((MidiInApi *)rtapi_)->setCallback( callback, userData ); }
+inline void RtMidiIn :: setCallback( RtMidiSpanCallback callback, void *userData, unsigned int portTag ) { ((MidiInApi *)rtapi_)->setCallback( callback, userData, portTag ); }
+inline void RtMidiIn :: setCallback( RtMidiBatchCallback callback, void *userData, unsigned int portTag ) { ((MidiInApi *)rtapi_)->setCallback( callback, userData, portTag ); }
+inline void RtMidiIn :: setCallback( RtMidiMessageCallback callback, void *userData, unsigned int portTag ) { ((MidiInApi *)rtapi_)->setCallback( callback, userData, portTag ); }
+inline void RtMidiIn :: setCallback( RtMidiUmpCallback callback, void *userData, unsigned int portTag, RtMidiUmp::Protocol protocol, unsigned int group ) { ((MidiInApi *)rtapi_)->setCallback( callback, userData, portTag, protocol, group ); }
 inline void RtMidiIn :: cancelCallback( void ) { ((MidiInApi *)rtapi_)->cancelCallback(); }
 inline unsigned int RtMidiIn :: getPortCount( void ) { return rtapi_->getPortCount(); }
 inline std::string RtMidiIn :: getPortName( unsigned int portNumber ) { return rtapi_->getPortName( portNumber ); }
 inline void RtMidiIn :: ignoreTypes( bool midiSysex, bool midiTime, bool midiSense ) { ((MidiInApi *)rtapi_)->ignoreTypes( midiSysex, midiTime, midiSense ); }
+inline void RtMidiIn :: setSysexSizeHint( unsigned int nBytes ) { ((MidiInApi *)rtapi_)->setSysexSizeHint( nBytes ); }
+inline void RtMidiIn :: getSysexStats( unsigned int *peakSize, unsigned int *reallocations ) { ((MidiInApi *)rtapi_)->getSysexStats( peakSize, reallocations ); }
+inline void RtMidiIn :: setThreadScheduling( int priority, int cpu ) { ((MidiInApi *)rtapi_)->setThreadScheduling( priority, cpu ); }
+inline void RtMidiIn :: setOverflowPolicy( OverflowPolicy policy, unsigned int maxBytes, RtMidiOverflowCallback callback, void *userData ) { ((MidiInApi *)rtapi_)->setOverflowPolicy( policy, maxBytes, callback, userData ); }
+inline void RtMidiIn :: setRecorder( RtMidiRecorder *recorder ) { ((MidiInApi *)rtapi_)->setRecorder( recorder ); }
+inline void RtMidiIn :: setQueueFilter( RtMidiQueueFilter filter, void *userData ) { ((MidiInApi *)rtapi_)->setQueueFilter( filter, userData ); }
+inline void RtMidiIn :: enableErrorEvents( bool enable, double interval ) { ((MidiInApi *)rtapi_)->enableErrorEvents( enable, interval ); }
+inline unsigned int RtMidiIn :: getErrorEvents( RtMidiErrorEvent *events, unsigned int maxEvents ) { return ((MidiInApi *)rtapi_)->getErrorEvents( events, maxEvents ); }
+inline void RtMidiIn :: getStats( RtMidiStats *stats ) { rtapi_->getStats( stats ); }
+inline void RtMidiIn :: resetStats( void ) { rtapi_->resetStats(); }
 inline double RtMidiIn :: getMessage( std::vector<unsigned char> *message ) { return ((MidiInApi *)rtapi_)->getMessage( message ); }
+inline double RtMidiIn :: getMessage( RtMidiMessage *message ) { return ((MidiInApi *)rtapi_)->getMessage( message ); }
+inline unsigned int RtMidiIn :: getMessages( unsigned char *buffer, size_t capacity, MessageRecord *records, unsigned int maxRecords ) { return ((MidiInApi *)rtapi_)->getMessages( buffer, capacity, records, maxRecords ); }
+inline size_t RtMidiIn :: getNextMessageSize( void ) { return ((MidiInApi *)rtapi_)->getNextMessageSize(); }
 inline void RtMidiIn :: setErrorCallback( RtMidiErrorCallback errorCallback ) { rtapi_->setErrorCallback(errorCallback); }
 
 inline RtMidi::Api RtMidiOut :: getCurrentApi( void ) throw() { return rtapi_->getCurrentApi(); }
@@ -556,7 +1772,17 @@ inline void RtMidiOut :: closePort( void ) { rtapi_->closePort(); }
 inline bool RtMidiOut :: isPortOpen() const { return rtapi_->isPortOpen(); }
 inline unsigned int RtMidiOut :: getPortCount( void ) { return rtapi_->getPortCount(); }
 inline std::string RtMidiOut :: getPortName( unsigned int portNumber ) { return rtapi_->getPortName( portNumber ); }
-inline void RtMidiOut :: sendMessage( std::vector<unsigned char> *message ) { ((MidiOutApi *)rtapi_)->sendMessage( message ); }
+inline void RtMidiOut :: sendMessage( std::vector<unsigned char> *message ) { ((MidiOutApi *)rtapi_)->sendMessage( message->empty() ? 0 : &(*message)[0], message->size() ); }
+inline void RtMidiOut :: sendMessage( const RtMidiMessage *message ) { ((MidiOutApi *)rtapi_)->sendMessage( message->data(), message->size() ); }
+inline void RtMidiOut :: sendMessage( const unsigned char *message, size_t size ) { ((MidiOutApi *)rtapi_)->sendMessage( message, size ); }
+inline void RtMidiOut :: sendMessages( const unsigned char *messages, size_t size ) { ((MidiOutApi *)rtapi_)->sendMessages( messages, size ); }
+inline size_t RtMidiOut :: trySendMessage( const std::vector<unsigned char> *message, size_t offset ) { return ((MidiOutApi *)rtapi_)->trySendMessage( message->empty() ? 0 : &(*message)[0], message->size(), offset ); }
+inline size_t RtMidiOut :: trySendMessage( const RtMidiMessage *message, size_t offset ) { return ((MidiOutApi *)rtapi_)->trySendMessage( message->data(), message->size(), offset ); }
+inline void RtMidiOut :: sendUmp( const uint32_t *words, unsigned int count ) { ((MidiOutApi *)rtapi_)->sendUmp( words, count ); }
+inline void RtMidiOut :: setSysexChunking( unsigned int chunkSize, unsigned int poolSize, unsigned int timeout ) { ((MidiOutApi *)rtapi_)->setSysexChunking( chunkSize, poolSize, timeout ); }
+inline void RtMidiOut :: setLoopbackLink( double latency, double bytesPerSecond ) { ((MidiOutApi *)rtapi_)->setLoopbackLink( latency, bytesPerSecond ); }
+inline void RtMidiOut :: getStats( RtMidiStats *stats ) { rtapi_->getStats( stats ); }
+inline void RtMidiOut :: resetStats( void ) { rtapi_->resetStats(); }
 inline void RtMidiOut :: setErrorCallback( RtMidiErrorCallback errorCallback ) { rtapi_->setErrorCallback(errorCallback); }
 
 // **************************************************************** //
@@ -565,9 +1791,8 @@ inline void RtMidiOut :: setErrorCallback( RtMidiErrorCallback errorCallback ) {
 //
 // **************************************************************** //
 
-#if !defined(__LINUX_ALSA__) && !defined(__UNIX_JACK__) && !defined(__MACOSX_CORE__) && !defined(__WINDOWS_MM__)
-  #define __RTMIDI_DUMMY__
-#endif
+// The loopback API needs no system support and is always compiled.
+#define __RTMIDI_LOOPBACK__
 
 #if defined(__MACOSX_CORE__)
 
@@ -598,7 +1823,7 @@ class MidiOutCore: public MidiOutApi
   void closePort( void );
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
-  void sendMessage( std::vector<unsigned char> *message );
+  void sendMessage( const unsigned char *message, size_t size );
 
  protected:
   void initialize( const std::string& clientName );
@@ -638,12 +1863,14 @@ class MidiOutJack: public MidiOutApi
   void closePort( void );
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
-  void sendMessage( std::vector<unsigned char> *message );
+  void sendMessage( const unsigned char *message, size_t size );
+  void sendMessages( const unsigned char *messages, size_t size );
 
  protected:
   std::string clientName;
 
   void connect( void );
+  void reportDrops( void );
   void initialize( const std::string& clientName );
 };
 
@@ -678,10 +1905,14 @@ class MidiOutAlsa: public MidiOutApi
   void closePort( void );
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
-  void sendMessage( std::vector<unsigned char> *message );
+  void sendMessage( const unsigned char *message, size_t size );
+  void sendMessages( const unsigned char *messages, size_t size );
+  size_t trySendMessage( const unsigned char *message, size_t size, size_t offset );
+  void setSysexChunking( unsigned int chunkSize, unsigned int poolSize, unsigned int timeout );
 
  protected:
   void initialize( const std::string& clientName );
+  int outputMessage( const unsigned char *bytes, unsigned int nBytes, unsigned int *offset, bool direct = true );
 };
 
 #endif
@@ -715,7 +1946,7 @@ class MidiOutWinMM: public MidiOutApi
   void closePort( void );
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
-  void sendMessage( std::vector<unsigned char> *message );
+  void sendMessage( const unsigned char *message, size_t size );
 
  protected:
   void initialize( const std::string& clientName );
@@ -723,37 +1954,40 @@ class MidiOutWinMM: public MidiOutApi
 
 #endif
 
-#if defined(__RTMIDI_DUMMY__)
+#if defined(__RTMIDI_LOOPBACK__)
 
-class MidiInDummy: public MidiInApi
+class MidiInLoopback: public MidiInApi
 {
  public:
- MidiInDummy( const std::string /*clientName*/, unsigned int queueSizeLimit ) : MidiInApi( queueSizeLimit ) { errorString_ = "MidiInDummy: This class provides no functionality."; error( RtMidiError::WARNING, errorString_ ); }
-  RtMidi::Api getCurrentApi( void ) { return RtMidi::RTMIDI_DUMMY; }
-  void openPort( unsigned int /*portNumber*/, const std::string /*portName*/ ) {}
-  void openVirtualPort( const std::string /*portName*/ ) {}
-  void closePort( void ) {}
-  unsigned int getPortCount( void ) { return 0; }
-  std::string getPortName( unsigned int portNumber ) { return ""; }
+  MidiInLoopback( const std::string clientName, unsigned int queueSizeLimit );
+  ~MidiInLoopback( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::RTMIDI_LOOPBACK; };
+  void openPort( unsigned int portNumber, const std::string portName );
+  void openVirtualPort( const std::string portName );
+  void closePort( void );
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
 
  protected:
-  void initialize( const std::string& /*clientName*/ ) {}
+  void initialize( const std::string& clientName );
 };
 
-class MidiOutDummy: public MidiOutApi
+class MidiOutLoopback: public MidiOutApi
 {
  public:
-  MidiOutDummy( const std::string /*clientName*/ ) { errorString_ = "MidiOutDummy: This class provides no functionality."; error( RtMidiError::WARNING, errorString_ ); }
-  RtMidi::Api getCurrentApi( void ) { return RtMidi::RTMIDI_DUMMY; }
-  void openPort( unsigned int /*portNumber*/, const std::string /*portName*/ ) {}
-  void openVirtualPort( const std::string /*portName*/ ) {}
-  void closePort( void ) {}
-  unsigned int getPortCount( void ) { return 0; }
-  std::string getPortName( unsigned int /*portNumber*/ ) { return ""; }
-  void sendMessage( std::vector<unsigned char> * /*message*/ ) {}
+  MidiOutLoopback( const std::string clientName );
+  ~MidiOutLoopback( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::RTMIDI_LOOPBACK; };
+  void openPort( unsigned int portNumber, const std::string portName );
+  void openVirtualPort( const std::string portName );
+  void closePort( void );
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+  void sendMessage( const unsigned char *message, size_t size );
+  void setLoopbackLink( double latency, double bytesPerSecond );
 
  protected:
-  void initialize( const std::string& /*clientName*/ ) {}
+  void initialize( const std::string& clientName );
 };
 
 #endif
@@ -0,0 +1,121 @@
+//*****************************************//
+//  alsadecode.cpp
+//
+//  Microbenchmark comparing the per-event cost
+//  of the ALSA channel-voice fast path with the
+//  generic snd_midi_event_decode() parser, and
+//  checking that the output fast path rebuilds
+//  the same events.
+//
+//  RtMidi.cpp is compiled into this program so
+//  that its internal decoder can be called.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "../RtMidi.cpp"
+
+#if defined(__LINUX_ALSA__) && !defined(RTMIDI_ALSA_GENERIC_DECODE)
+
+#include <time.h>
+
+static double now( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 0.000000001;
+}
+
+void usage( void ) {
+  std::cout << "\nusage: alsadecode <N>\n";
+  std::cout << "    where N = number of events to decode (default = 1000000).\n\n";
+  exit( 0 );
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc > 2 ) usage();
+  unsigned int nEvents = 1000000;
+  if ( argc == 2 ) nEvents = (unsigned int) atoi( argv[1] );
+  if ( nEvents == 0 ) usage();
+
+  // A typical mix of channel-voice traffic.
+  const unsigned int nTypes = 7;
+  snd_seq_event_t *events = new snd_seq_event_t[nTypes * 16];
+  for ( unsigned int i=0; i<nTypes * 16; i++ ) {
+    snd_seq_event_t *ev = &events[i];
+    unsigned char ch = i % 16;
+    snd_seq_ev_clear( ev );
+    switch ( i % nTypes ) {
+    case 0: snd_seq_ev_set_noteon( ev, ch, 60 + ch, 100 ); break;
+    case 1: snd_seq_ev_set_noteoff( ev, ch, 60 + ch, 64 ); break;
+    case 2: snd_seq_ev_set_keypress( ev, ch, 60 + ch, 20 ); break;
+    case 3: snd_seq_ev_set_controller( ev, ch, 7, 90 ); break;
+    case 4: snd_seq_ev_set_pgmchange( ev, ch, 5 ); break;
+    case 5: snd_seq_ev_set_chanpress( ev, ch, 33 ); break;
+    case 6: snd_seq_ev_set_pitchbend( ev, ch, -1234 ); break;
+    }
+  }
+
+  snd_midi_event_t *coder;
+  if ( snd_midi_event_new( 32, &coder ) < 0 ) {
+    std::cout << "Error initializing MIDI event parser!\n";
+    exit( EXIT_FAILURE );
+  }
+  snd_midi_event_init( coder );
+  snd_midi_event_no_status( coder, 1 );
+
+  // Check that both decoders agree before timing them.
+  unsigned char generic[32], fast[32];
+  for ( unsigned int i=0; i<nTypes * 16; i++ ) {
+    long n1 = snd_midi_event_decode( coder, generic, sizeof(generic), &events[i] );
+    long n2 = alsaDecodeChannelEvent( &events[i], fast );
+    if ( n1 != n2 || memcmp( generic, fast, n1 ) != 0 ) {
+      std::cout << "Decoders disagree for event type " << (int)events[i].type << "!\n";
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  // The output fast path must rebuild the same events from the bytes.
+  for ( unsigned int i=0; i<nTypes * 16; i++ ) {
+    snd_seq_event_t ev;
+    snd_seq_ev_clear( &ev );
+    long n = alsaDecodeChannelEvent( &events[i], fast );
+    if ( !alsaEncodeChannelMessage( fast, n, &ev ) || ev.type != events[i].type ||
+         memcmp( &ev.data, &events[i].data, sizeof(ev.data) ) != 0 ) {
+      std::cout << "Encoder does not round-trip event type " << (int)events[i].type << "!\n";
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  unsigned long sum = 0;
+  double start = now();
+  for ( unsigned int i=0; i<nEvents; i++ )
+    sum += snd_midi_event_decode( coder, generic, sizeof(generic), &events[i % (nTypes * 16)] ) + generic[1];
+  double genericTime = now() - start;
+
+  start = now();
+  for ( unsigned int i=0; i<nEvents; i++ )
+    sum += alsaDecodeChannelEvent( &events[i % (nTypes * 16)], fast ) + fast[1];
+  double fastTime = now() - start;
+
+  std::cout << "events decoded:           " << nEvents << " (checksum " << sum << ")\n";
+  std::cout << "snd_midi_event_decode:    " << genericTime * 1.0e9 / nEvents << " ns/event\n";
+  std::cout << "channel-voice fast path:  " << fastTime * 1.0e9 / nEvents << " ns/event\n";
+
+  snd_midi_event_free( coder );
+  delete [] events;
+  return 0;
+}
+
+#else
+
+int main( void )
+{
+  std::cout << "\nalsadecode: this benchmark requires the ALSA API with the fast decode path enabled.\n\n";
+  return 0;
+}
+
+#endif
@@ -0,0 +1,167 @@
+//*****************************************//
+//  alsalatency.cpp
+//
+//  Measures the input latency of the ALSA
+//  API under a CPU-hog background load, with
+//  and without real-time scheduling of the
+//  input thread.  Messages are sent one at a
+//  time to a virtual input port of the same
+//  program and timed until they reach the
+//  callback.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "RtMidi.h"
+
+#if defined(__LINUX_ALSA__)
+
+#include <atomic>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+static std::atomic<double> sendTime( 0.0 );
+static std::atomic<bool> received( false );
+static std::atomic<bool> stopHogs( false );
+static std::vector<double> latencies;
+
+static double now( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 0.000000001;
+}
+
+static void sleepFor( long nanoseconds )
+{
+  struct timespec ts;
+  ts.tv_sec = 0;
+  ts.tv_nsec = nanoseconds;
+  nanosleep( &ts, NULL );
+}
+
+void usage( void ) {
+  std::cout << "\nusage: alsalatency <priority> <cpu> <hogs> <N>\n";
+  std::cout << "    where priority = SCHED_FIFO priority of the input thread (default = 0, none),\n";
+  std::cout << "          cpu = processor to pin the input thread to (default = -1, any),\n";
+  std::cout << "          hogs = number of busy background threads (default = number of processors),\n";
+  std::cout << "          N = number of messages to time (default = 2000).\n\n";
+  exit( 0 );
+}
+
+void mycallback( double /*deltatime*/, const unsigned char * /*message*/, size_t /*size*/,
+                 unsigned int /*portTag*/, void * /*userData*/ )
+{
+  if ( latencies.size() < latencies.capacity() )
+    latencies.push_back( now() - sendTime.load() );
+  received.store( true, std::memory_order_release );
+}
+
+void *hog( void * )
+{
+  volatile double x = 1.0;
+  while ( !stopHogs.load( std::memory_order_relaxed ) )
+    x = x * 1.0000001 + 0.5;
+  return 0;
+}
+
+static double percentile( const std::vector<double> &sorted, double p )
+{
+  return sorted[ (size_t) ( p * ( sorted.size() - 1 ) ) ] * 1000000.0;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc > 5 ) usage();
+  int priority = ( argc > 1 ) ? atoi( argv[1] ) : 0;
+  int cpu = ( argc > 2 ) ? atoi( argv[2] ) : -1;
+  int nHogs = ( argc > 3 ) ? atoi( argv[3] ) : (int) sysconf( _SC_NPROCESSORS_ONLN );
+  unsigned int nMessages = ( argc > 4 ) ? (unsigned int) atoi( argv[4] ) : 2000;
+  if ( nHogs < 0 || nMessages == 0 ) usage();
+
+  RtMidiIn *midiin = 0;
+  RtMidiOut *midiout = 0;
+  std::vector<pthread_t> hogs;
+  std::vector<unsigned char> message( 3 );
+  unsigned int i, nPorts, lost = 0;
+
+  try {
+    midiin = new RtMidiIn( RtMidi::LINUX_ALSA );
+    midiin->setThreadScheduling( priority, cpu );
+    midiin->openVirtualPort( "alsalatency" );
+    midiin->setCallback( &mycallback );
+
+    midiout = new RtMidiOut( RtMidi::LINUX_ALSA );
+    nPorts = midiout->getPortCount();
+    for ( i=0; i<nPorts; i++ ) {
+      if ( midiout->getPortName( i ).find( "alsalatency" ) != std::string::npos ) break;
+    }
+    if ( i == nPorts ) {
+      std::cout << "\nalsalatency: unable to find the virtual input port!\n\n";
+      goto cleanup;
+    }
+    midiout->openPort( i );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    goto cleanup;
+  }
+
+  hogs.resize( nHogs );
+  for ( i=0; i<(unsigned int) nHogs; i++ )
+    pthread_create( &hogs[i], NULL, hog, NULL );
+
+  latencies.reserve( nMessages );
+  for ( i=0; i<nMessages; i++ ) {
+    message[0] = 0x90;
+    message[1] = i & 0x7F;
+    message[2] = 100;
+    received.store( false );
+    sendTime.store( now() );
+    midiout->sendMessage( &message );
+
+    // Wait up to a second for the message to arrive.
+    double start = now();
+    while ( !received.load( std::memory_order_acquire ) && now() - start < 1.0 )
+      sleepFor( 20000 );
+    if ( !received.load( std::memory_order_acquire ) ) lost++;
+
+    sleepFor( 1000000 );
+  }
+
+  stopHogs.store( true );
+  for ( i=0; i<hogs.size(); i++ )
+    pthread_join( hogs[i], NULL );
+
+  if ( latencies.empty() )
+    std::cout << "\nalsalatency: no messages received!\n\n";
+  else {
+    std::sort( latencies.begin(), latencies.end() );
+    std::cout << "\npriority = " << priority << ", cpu = " << cpu << ", hogs = " << nHogs
+              << ", messages = " << latencies.size() << ", lost = " << lost << std::endl;
+    std::cout << "latency (us): p50 = " << percentile( latencies, 0.5 )
+              << ", p99 = " << percentile( latencies, 0.99 )
+              << ", p99.9 = " << percentile( latencies, 0.999 )
+              << ", max = " << percentile( latencies, 1.0 ) << "\n\n";
+  }
+
+ cleanup:
+  delete midiout;
+  delete midiin;
+
+  return 0;
+}
+
+#else
+
+int main( void )
+{
+  std::cout << "\nalsalatency: this benchmark requires the ALSA API.\n\n";
+  return 0;
+}
+
+#endif
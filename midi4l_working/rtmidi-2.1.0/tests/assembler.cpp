@@ -0,0 +1,114 @@
+//*****************************************//
+//  assembler.cpp
+//
+//  Checks RtMidiControlAssembler.  14-bit
+//  controller pairs and registered and
+//  non-registered parameter sequences must
+//  each give a single event with the right
+//  number and value, and other controllers
+//  must be passed on.  Coarse 14-bit
+//  controllers must give a value for every
+//  MSB, even when no LSB is ever sent.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include "RtMidi.h"
+
+static unsigned int failures = 0;
+
+// Feed a controller change and compare the result, and the event if
+// there is one, with what is expected.
+static void check( RtMidiControlAssembler &assembler, const char *what,
+                   unsigned int channel, unsigned int control, unsigned int value,
+                   RtMidiControlAssembler::Result expected,
+                   RtMidiControlAssembler::Type type = RtMidiControlAssembler::CC14,
+                   unsigned int number = 0, unsigned int eventValue = 0 )
+{
+  unsigned char message[3] = { (unsigned char) ( 0xB0 | channel ), (unsigned char) control, (unsigned char) value };
+  RtMidiControlAssembler::Event event;
+  RtMidiControlAssembler::Result result = assembler.process( message, 3, &event );
+  if ( result != expected ||
+       ( result == RtMidiControlAssembler::EVENT &&
+         ( event.type != type || event.channel != channel || event.number != number || event.value != eventValue ) ) ) {
+    std::cout << what << ": wrong result!\n";
+    failures++;
+  }
+}
+
+int main( void )
+{
+  typedef RtMidiControlAssembler A;
+  RtMidiControlAssembler assembler;
+
+  if ( assembler.isActive() ) {
+    std::cout << "a new assembler is active!\n";
+    failures++;
+  }
+  check( assembler, "nothing joined", 0, 99, 1, A::PASS );
+  check( assembler, "nothing joined", 0, 6, 1, A::PASS );
+  unsigned char note[3] = { 0x90, 60, 100 };
+  A::Event event;
+  if ( assembler.process( note, 3, &event ) != A::PASS ) {
+    std::cout << "a note was not passed on!\n";
+    failures++;
+  }
+
+  // 14-bit controller 7, with 1 left as a 7-bit controller.
+  assembler.setCc14( 7 );
+  check( assembler, "cc14 MSB", 2, 7, 0x55, A::HOLD );
+  check( assembler, "cc14 LSB", 2, 39, 0x2A, A::EVENT, A::CC14, 7, ( 0x55 << 7 ) | 0x2A );
+  check( assembler, "cc14 LSB alone", 2, 39, 0x01, A::EVENT, A::CC14, 7, ( 0x55 << 7 ) | 0x01 );
+  check( assembler, "cc14 other channel", 3, 39, 0x01, A::EVENT, A::CC14, 7, 0x01 );
+  check( assembler, "7-bit controller", 2, 1, 0x10, A::PASS );
+  check( assembler, "7-bit LSB controller", 2, 33, 0x10, A::PASS );
+
+  // A coarse controller that only moves its MSB loses no value.
+  assembler.setCc14( 1, true, true );
+  check( assembler, "coarse cc14 MSB", 4, 1, 0x10, A::EVENT, A::CC14, 1, 0x10 << 7 );
+  check( assembler, "coarse cc14 next MSB", 4, 1, 0x11, A::EVENT, A::CC14, 1, 0x11 << 7 );
+  check( assembler, "coarse cc14 LSB", 4, 33, 0x05, A::EVENT, A::CC14, 1, ( 0x11 << 7 ) | 0x05 );
+  check( assembler, "coarse cc14 MSB after LSB", 4, 1, 0x12, A::EVENT, A::CC14, 1, 0x12 << 7 );
+  assembler.setCc14( 1, true );
+  check( assembler, "fine cc14 MSB again", 4, 1, 0x13, A::HOLD );
+  assembler.setCc14( 1, false );
+
+  // Without an LSB, parameter values wait.
+  assembler.setParameterMode( A::PARAMETERS_FINE );
+  check( assembler, "NRPN MSB", 0, 99, 0x01, A::HOLD );
+  check( assembler, "NRPN LSB", 0, 98, 0x02, A::HOLD );
+  check( assembler, "NRPN data MSB", 0, 6, 0x40, A::HOLD );
+  check( assembler, "NRPN data LSB", 0, 38, 0x03, A::EVENT, A::NRPN, ( 1 << 7 ) | 2, ( 0x40 << 7 ) | 3 );
+  check( assembler, "NRPN data LSB again", 0, 38, 0x04, A::EVENT, A::NRPN, ( 1 << 7 ) | 2, ( 0x40 << 7 ) | 4 );
+  check( assembler, "increment", 0, 96, 0, A::PASS );
+  check( assembler, "RPN MSB", 0, 101, 0x00, A::HOLD );
+  check( assembler, "RPN LSB", 0, 100, 0x00, A::HOLD );
+  check( assembler, "RPN data MSB", 0, 6, 0x02, A::HOLD );
+  check( assembler, "RPN data LSB", 0, 38, 0x00, A::EVENT, A::RPN, 0, 0x02 << 7 );
+  check( assembler, "null RPN MSB", 0, 101, 127, A::HOLD );
+  check( assembler, "null RPN LSB", 0, 100, 127, A::HOLD );
+  check( assembler, "data after null RPN", 0, 6, 0x10, A::PASS );
+  check( assembler, "data without parameter", 5, 38, 0x10, A::PASS );
+
+  // With coarse values, the MSB completes the value.
+  assembler.setParameterMode( A::PARAMETERS_COARSE );
+  check( assembler, "coarse NRPN MSB", 1, 99, 0x00, A::HOLD );
+  check( assembler, "coarse NRPN LSB", 1, 98, 0x05, A::HOLD );
+  check( assembler, "coarse data MSB", 1, 6, 0x7F, A::EVENT, A::NRPN, 5, 0x7F << 7 );
+  check( assembler, "coarse data LSB", 1, 38, 0x7F, A::EVENT, A::NRPN, 5, 0x3FFF );
+
+  assembler.reset();
+  check( assembler, "data after reset", 1, 6, 0x10, A::PASS );
+
+  assembler.setParameterMode( A::PARAMETERS_OFF );
+  assembler.setCc14( 7, false );
+  if ( assembler.isActive() ) {
+    std::cout << "the assembler is still active!\n";
+    failures++;
+  }
+  check( assembler, "disabled cc14", 2, 7, 0x55, A::PASS );
+
+  std::cout << "\nAssembler checks " << ( failures == 0 ? "passed" : "failed" ) << ".\n\n";
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+//*****************************************//
+//  errorevents.cpp
+//
+//  Checks the error events of RtMidiIn.  A
+//  loopback cable is flooded with more
+//  than the 64 KB input queue can hold
+//  while nobody reads it.  Every
+//  dropped message must be counted, and
+//  reported in at most one event per
+//  interval instead of once per message.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include "RtMidi.h"
+
+int main( void )
+{
+  const unsigned int queueSize = 10, nMessages = 10000;
+  const double interval = 0.1;
+  RtMidiIn *midiin = 0;
+  RtMidiOut *midiout = 0;
+  RtMidiErrorEvent events[RtMidiErrorEvent::CODE_COUNT];
+  unsigned long long reported = 0;
+  unsigned int i, nPorts, nEvents = 0, failures = 0;
+
+  try {
+    midiin = new RtMidiIn( RtMidi::RTMIDI_LOOPBACK, "errorevents", queueSize );
+    midiin->enableErrorEvents( true, interval );
+    midiin->openVirtualPort( "errorevents" );
+
+    midiout = new RtMidiOut( RtMidi::RTMIDI_LOOPBACK, "errorevents" );
+    nPorts = midiout->getPortCount();
+    for ( i=0; i<nPorts; i++ ) {
+      if ( midiout->getPortName( i ).find( "errorevents" ) != std::string::npos ) break;
+    }
+    if ( i == nPorts ) {
+      std::cout << "\nerrorevents: unable to find the virtual input port!\n\n";
+      goto cleanup;
+    }
+    midiout->openPort( i );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    goto cleanup;
+  }
+
+  // Collect events while sending, as an application would.
+  for ( i=0; i<nMessages; i++ ) {
+    std::vector<unsigned char> message( 3 );
+    message[0] = 0x90;
+    message[1] = i & 0x7F;
+    message[2] = 1 + i % 127;
+    midiout->sendMessage( &message );
+    if ( i % 1000 == 999 ) {
+      std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+      unsigned int count = midiin->getErrorEvents( events, RtMidiErrorEvent::CODE_COUNT );
+      for ( unsigned int j=0; j<count; j++ ) {
+        if ( events[j].code != RtMidiErrorEvent::QUEUE_FULL ) {
+          std::cout << "unexpected error event: " << events[j].message << "\n";
+          failures++;
+        }
+        reported += events[j].count;
+      }
+      nEvents += count;
+    }
+  }
+
+  // Whatever is left comes out once the interval has passed.
+  std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+  for ( i=0; i<2; i++ ) {
+    unsigned int count = midiin->getErrorEvents( events, RtMidiErrorEvent::CODE_COUNT );
+    for ( unsigned int j=0; j<count; j++ ) reported += events[j].count;
+    nEvents += count;
+    std::this_thread::sleep_for( std::chrono::milliseconds( 150 ) );
+  }
+
+  RtMidiStats stats;
+  midiin->getStats( &stats );
+  if ( stats.queueDrops == 0 || reported != stats.queueDrops ) {
+    std::cout << reported << " dropped messages reported instead of " << stats.queueDrops << "!\n";
+    failures++;
+  }
+  if ( nEvents == 0 || nEvents > 4 ) {
+    std::cout << nEvents << " events reported, expected one to four!\n";
+    failures++;
+  }
+  std::cout << "\n" << reported << " dropped messages reported in " << nEvents << " events, "
+            << failures << " failures.\n\n";
+
+ cleanup:
+  delete midiout;
+  delete midiin;
+
+  return failures == 0 && nEvents > 0 ? 0 : 1;
+}
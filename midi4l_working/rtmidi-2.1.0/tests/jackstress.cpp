@@ -0,0 +1,141 @@
+//*****************************************//
+//  jackstress.cpp
+//
+//  Stress test for the JACK input path: a
+//  separate JACK client floods an RtMidiIn
+//  port with note messages while the user
+//  callback does slow work, and the number
+//  of xruns reported by JACK is counted.
+//  With the dispatcher thread, callback cost
+//  must not cause xruns.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include "RtMidi.h"
+
+#if defined(__UNIX_JACK__)
+
+#include <atomic>
+#include <time.h>
+#include <unistd.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+static jack_port_t *outPort = 0;
+static unsigned int perCycle = 16;
+static long callbackCost = 100000;
+static std::atomic<unsigned int> sent( 0 );
+static std::atomic<unsigned int> received( 0 );
+static std::atomic<unsigned int> xruns( 0 );
+
+void usage( void ) {
+  std::cout << "\nusage: jackstress <seconds> <events> <cost>\n";
+  std::cout << "    where seconds = duration of the test (default = 10),\n";
+  std::cout << "          events = MIDI events sent per JACK cycle (default = 16),\n";
+  std::cout << "          cost = time spent in the user callback per message in us (default = 100).\n\n";
+  exit( 0 );
+}
+
+int process( jack_nframes_t nframes, void * /*arg*/ )
+{
+  void *buff = jack_port_get_buffer( outPort, nframes );
+  jack_midi_clear_buffer( buff );
+
+  for ( unsigned int i=0; i<perCycle; i++ ) {
+    jack_midi_data_t message[3] = { 0x90, (jack_midi_data_t) ( i & 0x7F ), 100 };
+    if ( jack_midi_event_write( buff, i * nframes / perCycle, message, 3 ) == 0 )
+      sent++;
+  }
+
+  return 0;
+}
+
+int xrun( void * /*arg*/ )
+{
+  xruns++;
+  return 0;
+}
+
+void mycallback( double /*deltatime*/, const unsigned char * /*message*/, size_t /*size*/,
+                 unsigned int /*portTag*/, void * /*userData*/ )
+{
+  // Stand in for expensive user code, such as a Max outlet call.
+  struct timespec ts;
+  ts.tv_sec = 0;
+  ts.tv_nsec = callbackCost;
+  nanosleep( &ts, NULL );
+  received++;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc > 4 ) usage();
+  unsigned int seconds = ( argc > 1 ) ? (unsigned int) atoi( argv[1] ) : 10;
+  if ( argc > 2 ) perCycle = (unsigned int) atoi( argv[2] );
+  if ( argc > 3 ) callbackCost = atol( argv[3] ) * 1000;
+  if ( seconds == 0 || perCycle == 0 ) usage();
+
+  RtMidiIn *midiin = 0;
+  jack_client_t *client = 0;
+  unsigned int i, nPorts;
+  std::string name;
+
+  // The sending client.
+  client = jack_client_open( "jackstress", JackNoStartServer, NULL );
+  if ( client == 0 ) {
+    std::cout << "\njackstress: JACK server not running?\n\n";
+    return 0;
+  }
+  outPort = jack_port_register( client, "out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0 );
+  jack_set_process_callback( client, process, 0 );
+  jack_set_xrun_callback( client, xrun, 0 );
+  name = jack_port_name( outPort );
+
+  try {
+    midiin = new RtMidiIn( RtMidi::UNIX_JACK, "jackstress input" );
+    midiin->setCallback( &mycallback );
+
+    // Connect our sending port to the RtMidiIn port.
+    nPorts = midiin->getPortCount();
+    for ( i=0; i<nPorts; i++ ) {
+      if ( midiin->getPortName( i ) == name ) break;
+    }
+    if ( i == nPorts ) {
+      std::cout << "\njackstress: unable to find the sending port!\n\n";
+      goto cleanup;
+    }
+    midiin->openPort( i, "in" );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    goto cleanup;
+  }
+
+  jack_activate( client );
+  std::cout << "\nSending " << perCycle << " events per cycle for " << seconds << " seconds ...\n";
+  sleep( seconds );
+  jack_deactivate( client );
+
+  // Let the dispatcher catch up before counting.
+  sleep( 1 );
+  std::cout << "events sent = " << sent << ", received = " << received
+            << ", xruns = " << xruns << "\n\n";
+
+ cleanup:
+  delete midiin;
+  jack_client_close( client );
+
+  return 0;
+}
+
+#else
+
+int main( void )
+{
+  std::cout << "\njackstress: this test requires the JACK API.\n\n";
+  return 0;
+}
+
+#endif
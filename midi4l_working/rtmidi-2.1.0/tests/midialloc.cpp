@@ -0,0 +1,219 @@
+//*****************************************//
+//  midialloc.cpp
+//
+//  Counts heap allocations on the message
+//  paths of an RtMidi API.  Channel messages
+//  are sent to a virtual input port of the
+//  same program, once with std::vector and
+//  once with RtMidiMessage, and received
+//  through the queue and the callbacks.
+//  After a warm-up, the RtMidiMessage paths
+//  must not allocate at all.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "RtMidi.h"
+
+static std::atomic<unsigned long> allocations( 0 );
+static std::atomic<unsigned int> received( 0 );
+
+// Count every allocation made by any thread of the program.
+void *operator new( size_t size )
+{
+  allocations.fetch_add( 1, std::memory_order_relaxed );
+  void *p = malloc( size ? size : 1 );
+  if ( p == NULL ) throw std::bad_alloc();
+  return p;
+}
+
+// GCC 11 and later see through the replaced operator new once this is
+// inlined and warn that malloc and free are mismatched with it.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete( void *p ) throw()
+{
+  free( p );
+}
+
+void operator delete( void *p, size_t /*size*/ ) throw()
+{
+  free( p );
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+void usage( void ) {
+  std::cout << "\nusage: midialloc <api> <N>\n";
+  std::cout << "    where api = alsa or loopback (default = loopback),\n";
+  std::cout << "          N = number of messages per test (default = 10000).\n\n";
+  exit( 0 );
+}
+
+void vectorCallback( double /*deltatime*/, std::vector<unsigned char> * /*message*/, void * /*userData*/ )
+{
+  received.fetch_add( 1, std::memory_order_release );
+}
+
+void messageCallback( const RtMidiMessage & /*message*/, unsigned int /*portTag*/, void * /*userData*/ )
+{
+  received.fetch_add( 1, std::memory_order_release );
+}
+
+// Wait until count messages have arrived or nothing arrived for a
+// second.
+static void waitFor( unsigned int count )
+{
+  unsigned int last = received.load( std::memory_order_acquire );
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while ( last < count && std::chrono::steady_clock::now() - start < std::chrono::seconds( 1 ) ) {
+    std::this_thread::yield();
+    unsigned int current = received.load( std::memory_order_acquire );
+    if ( current != last ) {
+      last = current;
+      start = std::chrono::steady_clock::now();
+    }
+  }
+}
+
+// The messages are sent in groups small enough for the input queue.
+static const unsigned int group = 50;
+
+static void sendVectors( RtMidiOut *midiout, unsigned int nMessages )
+{
+  for ( unsigned int i=0; i<nMessages; i++ ) {
+    // Typical client code: a new vector for each message.
+    std::vector<unsigned char> message( 3 );
+    message[0] = 0x90;
+    message[1] = i & 0x7F;
+    message[2] = 100;
+    midiout->sendMessage( &message );
+    if ( ( i + 1 ) % group == 0 ) waitFor( i + 1 );
+  }
+  waitFor( nMessages );
+}
+
+static void sendMessages( RtMidiOut *midiout, unsigned int nMessages )
+{
+  for ( unsigned int i=0; i<nMessages; i++ ) {
+    RtMidiMessage message( 0x90, i & 0x7F, 100 );
+    midiout->sendMessage( &message );
+    if ( ( i + 1 ) % group == 0 ) waitFor( i + 1 );
+  }
+  waitFor( nMessages );
+}
+
+// Receive through the input queue, polling with getMessage().
+template <class Message>
+static void sendAndPoll( RtMidiIn *midiin, RtMidiOut *midiout, Message *message, unsigned int nMessages )
+{
+  for ( unsigned int i=0; i<nMessages; i++ ) {
+    RtMidiMessage out( 0x80, i & 0x7F, 0 );
+    midiout->sendMessage( &out );
+    if ( ( i + 1 ) % group == 0 || i + 1 == nMessages ) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      while ( received.load() < i + 1 && std::chrono::steady_clock::now() - start < std::chrono::seconds( 1 ) ) {
+        midiin->getMessage( message );
+        if ( message->size() > 0 ) received++;
+      }
+    }
+  }
+}
+
+// Run one test twice, reporting the allocations of the second run.
+// Returns the number of allocations per message.
+template <class Test>
+static double measure( const char *name, Test test, unsigned int nMessages )
+{
+  received.store( 0 );
+  test( nMessages );
+  received.store( 0 );
+  unsigned long start = allocations.load();
+  test( nMessages );
+  unsigned long count = allocations.load() - start;
+  double perMessage = (double) count / nMessages;
+
+  std::cout << "  " << name << ": " << received.load() << " of " << nMessages
+            << " messages, " << count << " allocations (" << perMessage << " per message)\n";
+  return perMessage;
+}
+
+static RtMidiIn *midiin = 0;
+static RtMidiOut *midiout = 0;
+static unsigned int nMessages = 10000;
+
+static void vectorCallbackTest( unsigned int n ) { sendVectors( midiout, n ); }
+static void messageCallbackTest( unsigned int n ) { sendMessages( midiout, n ); }
+static void vectorQueueTest( unsigned int n ) { std::vector<unsigned char> message; sendAndPoll( midiin, midiout, &message, n ); }
+static void messageQueueTest( unsigned int n ) { RtMidiMessage message; sendAndPoll( midiin, midiout, &message, n ); }
+
+int main( int argc, char *argv[] )
+{
+  if ( argc > 3 ) usage();
+  std::string which = ( argc > 1 ) ? argv[1] : "loopback";
+  if ( argc > 2 ) nMessages = (unsigned int) atoi( argv[2] );
+  if ( nMessages == 0 ) usage();
+
+  RtMidi::Api api;
+  if ( which == "alsa" ) api = RtMidi::LINUX_ALSA;
+  else if ( which == "loopback" ) api = RtMidi::RTMIDI_LOOPBACK;
+  else usage();
+
+  unsigned int i, nPorts;
+  double steadyState = 0.0;
+
+  try {
+    midiin = new RtMidiIn( api, "midialloc" );
+    if ( midiin->getCurrentApi() != api ) {
+      std::cout << "\nmidialloc: the " << which << " API is not compiled in!\n\n";
+      goto cleanup;
+    }
+    midiin->openVirtualPort( "midialloc" );
+
+    midiout = new RtMidiOut( api, "midialloc" );
+    nPorts = midiout->getPortCount();
+    for ( i=0; i<nPorts; i++ ) {
+      if ( midiout->getPortName( i ).find( "midialloc" ) != std::string::npos ) break;
+    }
+    if ( i == nPorts ) {
+      std::cout << "\nmidialloc: unable to find the virtual input port!\n\n";
+      goto cleanup;
+    }
+    midiout->openPort( i );
+
+    std::cout << "\nAllocations in steady state, " << which << " API:\n";
+    midiin->setCallback( &vectorCallback );
+    measure( "vector send, vector callback", vectorCallbackTest, nMessages );
+    midiin->cancelCallback();
+
+    midiin->setCallback( &messageCallback );
+    steadyState += measure( "RtMidiMessage send, RtMidiMessage callback", messageCallbackTest, nMessages );
+    midiin->cancelCallback();
+
+    measure( "RtMidiMessage send, vector getMessage()", vectorQueueTest, nMessages );
+    steadyState += measure( "RtMidiMessage send, RtMidiMessage getMessage()", messageQueueTest, nMessages );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    goto cleanup;
+  }
+
+  std::cout << ( steadyState == 0.0 ? "\nRtMidiMessage paths do not allocate.\n\n"
+                                    : "\nRtMidiMessage paths allocate!\n\n" );
+
+ cleanup:
+  delete midiout;
+  delete midiin;
+
+  return steadyState == 0.0 ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+//*****************************************//
+//  midibench.cpp
+//
+//  End-to-end benchmark of an RtMidi API.
+//  Messages are sent from an RtMidiOut to a
+//  virtual input port of the same program to
+//  measure message throughput, round-trip
+//  latency percentiles and sysex bandwidth
+//  by message size.  Results are written as
+//  JSON so that builds can be compared.
+//
+//*****************************************//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "RtMidi.h"
+
+static std::atomic<unsigned int> received( 0 );
+static std::atomic<double> receiveTime( 0.0 );
+
+static double now( void )
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void usage( void ) {
+  std::cout << "\nusage: midibench <api> <N> <file>\n";
+  std::cout << "    where api = alsa, loopback or all (default = all),\n";
+  std::cout << "          N = number of messages for the throughput test (default = 100000),\n";
+  std::cout << "          file = JSON output file (default = standard output).\n\n";
+  exit( 0 );
+}
+
+void mycallback( double /*deltatime*/, const unsigned char * /*message*/, size_t /*size*/,
+                 unsigned int /*portTag*/, void * /*userData*/ )
+{
+  receiveTime.store( now(), std::memory_order_relaxed );
+  received.fetch_add( 1, std::memory_order_release );
+}
+
+// Wait until count messages have arrived or nothing arrived for a
+// second.  Spins for the first millisecond so that polling does not
+// dominate short transfers.  Returns false on timeout.
+static bool waitFor( unsigned int count )
+{
+  unsigned int last = received.load( std::memory_order_acquire );
+  double start = now();
+  while ( last < count ) {
+    if ( now() - start < 0.001 )
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for( std::chrono::microseconds( 20 ) );
+    unsigned int current = received.load( std::memory_order_acquire );
+    if ( current != last ) {
+      last = current;
+      start = now();
+    }
+    else if ( now() - start > 1.0 ) return false;
+  }
+  return true;
+}
+
+static double percentile( const std::vector<double> &sorted, double p )
+{
+  if ( sorted.empty() ) return 0.0;
+  return sorted[ (size_t) ( p * ( sorted.size() - 1 ) ) ] * 1000000.0;
+}
+
+// Send as fast as the input keeps up, with at most window messages
+// in flight so that no queue overflows.
+static void throughput( RtMidiOut *midiout, unsigned int nMessages, std::ostream &json )
+{
+  const unsigned int window = 1000;
+  std::vector<unsigned char> message( 3 );
+  unsigned int i;
+
+  received.store( 0 );
+  double start = now();
+  for ( i=0; i<nMessages; i++ ) {
+    if ( i >= window && !waitFor( i - window + 1 ) ) break;
+    message[0] = 0x90 | ( i & 0x0F );
+    message[1] = i & 0x7F;
+    message[2] = 100;
+    midiout->sendMessage( &message );
+  }
+  waitFor( i );
+  double seconds = receiveTime.load() - start;
+  unsigned int count = received.load();
+
+  json << "    \"throughput\": { \"messages\": " << nMessages << ", \"received\": " << count
+       << ", \"seconds\": " << seconds << ", \"messages_per_second\": "
+       << ( seconds > 0.0 ? count / seconds : 0.0 ) << " },\n";
+}
+
+// One message at a time, timed from just before sendMessage() until
+// the callback runs.
+static void latency( RtMidiOut *midiout, unsigned int nMessages, std::ostream &json )
+{
+  std::vector<unsigned char> message( 3 );
+  std::vector<double> latencies;
+  unsigned int lost = 0;
+
+  latencies.reserve( nMessages );
+  received.store( 0 );
+  for ( unsigned int i=0; i<nMessages; i++ ) {
+    message[0] = 0x80;
+    message[1] = i & 0x7F;
+    message[2] = 0;
+    unsigned int expected = received.load() + 1;
+    double start = now();
+    midiout->sendMessage( &message );
+    if ( waitFor( expected ) )
+      latencies.push_back( receiveTime.load() - start );
+    else {
+      lost++;
+      received.store( expected );
+    }
+  }
+  std::sort( latencies.begin(), latencies.end() );
+
+  json << "    \"latency_us\": { \"samples\": " << latencies.size() << ", \"lost\": " << lost
+       << ", \"p50\": " << percentile( latencies, 0.5 )
+       << ", \"p99\": " << percentile( latencies, 0.99 )
+       << ", \"p999\": " << percentile( latencies, 0.999 )
+       << ", \"max\": " << percentile( latencies, 1.0 ) << " },\n";
+}
+
+// Sysex messages of each size are sent one after the other, each
+// once the previous one has arrived.
+static void sysexBandwidth( RtMidiOut *midiout, std::ostream &json )
+{
+  static const unsigned int sizes[] = { 16, 256, 1024, 8192, 32768 };
+  const unsigned int nSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  json << "    \"sysex\": [\n";
+  for ( unsigned int s=0; s<nSizes; s++ ) {
+    std::vector<unsigned char> message( sizes[s], 0x55 );
+    message.front() = 0xF0;
+    message.back() = 0xF7;
+    unsigned int nMessages = 1 + 262144 / sizes[s], i;
+
+    received.store( 0 );
+    double start = now();
+    for ( i=0; i<nMessages; i++ ) {
+      midiout->sendMessage( &message );
+      if ( !waitFor( i + 1 ) ) break;
+    }
+    double seconds = receiveTime.load() - start;
+    unsigned int count = received.load();
+
+    json << "      { \"size\": " << sizes[s] << ", \"messages\": " << nMessages
+         << ", \"received\": " << count << ", \"seconds\": " << seconds
+         << ", \"bytes_per_second\": " << ( seconds > 0.0 ? count * (double) sizes[s] / seconds : 0.0 )
+         << " }" << ( s + 1 < nSizes ? ",\n" : "\n" );
+  }
+  json << "    ]\n";
+}
+
+static bool run( RtMidi::Api api, const std::string &apiName, unsigned int nMessages, std::ostream &json )
+{
+  RtMidiIn *midiin = 0;
+  RtMidiOut *midiout = 0;
+  unsigned int i, nPorts;
+  bool ok = false;
+
+  try {
+    midiin = new RtMidiIn( api, "midibench" );
+    if ( midiin->getCurrentApi() != api ) goto cleanup;
+    midiin->openVirtualPort( "midibench" );
+    midiin->ignoreTypes( false, true, true );
+    midiin->setCallback( &mycallback );
+
+    midiout = new RtMidiOut( api, "midibench" );
+    nPorts = midiout->getPortCount();
+    for ( i=0; i<nPorts; i++ ) {
+      if ( midiout->getPortName( i ).find( "midibench" ) != std::string::npos ) break;
+    }
+    if ( i == nPorts ) {
+      std::cerr << "\nmidibench: unable to find the virtual input port for " << apiName << "!\n\n";
+      goto cleanup;
+    }
+    midiout->openPort( i );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    goto cleanup;
+  }
+
+  std::cerr << "midibench: testing " << apiName << " ...\n";
+  json << "  {\n    \"api\": \"" << apiName << "\",\n";
+  throughput( midiout, nMessages, json );
+  latency( midiout, 2000, json );
+  sysexBandwidth( midiout, json );
+  json << "  }";
+  ok = true;
+
+ cleanup:
+  delete midiout;
+  delete midiin;
+
+  return ok;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc > 4 ) usage();
+  std::string which = ( argc > 1 ) ? argv[1] : "all";
+  unsigned int nMessages = ( argc > 2 ) ? (unsigned int) atoi( argv[2] ) : 100000;
+  if ( nMessages == 0 ) usage();
+  if ( which != "all" && which != "alsa" && which != "loopback" ) usage();
+
+  std::vector<RtMidi::Api> apis;
+  RtMidi::getCompiledApi( apis );
+
+  std::ostringstream results;
+  bool first = true;
+  for ( unsigned int i=0; i<apis.size(); i++ ) {
+    std::string name;
+    if ( apis[i] == RtMidi::LINUX_ALSA ) name = "alsa";
+    else if ( apis[i] == RtMidi::RTMIDI_LOOPBACK ) name = "loopback";
+    else continue;
+    if ( which != "all" && which != name ) continue;
+
+    std::ostringstream json;
+    if ( !run( apis[i], name, nMessages, json ) ) continue;
+    results << ( first ? "" : ",\n" ) << json.str();
+    first = false;
+  }
+
+  if ( first ) {
+    std::cerr << "\nmidibench: no API to test!\n\n";
+    return 1;
+  }
+
+  std::ostringstream out;
+  out << "{\n\"version\": \"" << RtMidi::getVersion() << "\",\n\"results\": [\n"
+      << results.str() << "\n]\n}\n";
+  if ( argc > 3 ) {
+    std::ofstream file( argv[3] );
+    file << out.str();
+  }
+  else
+    std::cout << out.str();
+
+  return 0;
+}
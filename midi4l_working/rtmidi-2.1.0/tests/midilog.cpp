@@ -0,0 +1,184 @@
+//*****************************************//
+//  midilog.cpp
+//
+//  Without arguments, records messages sent
+//  through a loopback cable with
+//  RtMidiRecorder and checks that RtMidiLog
+//  reads them back unchanged and in order,
+//  and that seeking by time finds the right
+//  message.  Given a log file, converts it
+//  to a Standard MIDI File.
+//
+//*****************************************//
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include "RtMidi.h"
+
+void usage( void ) {
+  std::cout << "\nusage: midilog <log> <smf>\n";
+  std::cout << "    where log = a log file written by RtMidiRecorder,\n";
+  std::cout << "          smf = the Standard MIDI File to write (default = log.mid).\n";
+  std::cout << "    Without arguments, the recorder and reader are tested.\n\n";
+  exit( 0 );
+}
+
+static int convert( const std::string &logName, const std::string &smfName )
+{
+  RtMidiLog log;
+  try {
+    log.open( logName );
+    log.writeSmf( smfName );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    return 1;
+  }
+  std::cout << "\n" << log.getMessageCount() << " messages over " << log.getDuration()
+            << " seconds written to " << smfName << ".\n\n";
+  return 0;
+}
+
+// The messages are only recorded.
+void mycallback( double /*deltatime*/, const unsigned char * /*message*/, size_t /*size*/,
+                 unsigned int /*portTag*/, void * /*userData*/ )
+{
+}
+
+static RtMidiOut *openOutput( const std::string &portName )
+{
+  RtMidiOut *midiout = new RtMidiOut( RtMidi::RTMIDI_LOOPBACK, "midilog" );
+  unsigned int i, nPorts = midiout->getPortCount();
+  for ( i=0; i<nPorts; i++ ) {
+    if ( midiout->getPortName( i ).find( portName ) != std::string::npos ) break;
+  }
+  if ( i < nPorts ) midiout->openPort( i );
+  return midiout;
+}
+
+static int test( void )
+{
+  const std::string logName = "midilog.log";
+  const unsigned int nMessages = 3000;
+  std::vector< std::vector<unsigned char> > sent;
+  RtMidiIn *midiin = 0;
+  RtMidiOut *midiout = 0;
+  RtMidiRecorder recorder;
+  RtMidiLog log;
+  unsigned int i, failures = 0;
+
+  // Notes, with a sysex message now and then.
+  for ( i=0; i<nMessages; i++ ) {
+    std::vector<unsigned char> message( 3 );
+    if ( i % 100 == 99 ) message.resize( 5 + i % 13 );
+    for ( unsigned int j=0; j<message.size(); j++ ) message[j] = ( i + j ) & 0x7F;
+    if ( message.size() == 3 ) message[0] = 0x90 | ( i & 0x0F );
+    else {
+      message.front() = 0xF0;
+      message.back() = 0xF7;
+    }
+    sent.push_back( message );
+  }
+
+  try {
+    midiin = new RtMidiIn( RtMidi::RTMIDI_LOOPBACK, "midilog" );
+    midiin->openVirtualPort( "midilog" );
+    midiin->ignoreTypes( false, false, false );
+    midiin->setCallback( &mycallback );
+    recorder.open( logName );
+    midiin->setRecorder( &recorder );
+    midiout = openOutput( "midilog" );
+
+    // Send in groups one millisecond apart, so that the times grow.
+    for ( i=0; i<nMessages; i++ ) {
+      midiout->sendMessage( &sent[i] );
+      if ( i % 10 == 9 ) std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    for ( i=0; i<100 && recorder.getRecordedCount() < nMessages; i++ )
+      std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+    midiin->setRecorder( 0 );
+    recorder.close();
+    std::cout << "\nRecorded " << recorder.getRecordedCount() << " messages, "
+              << recorder.getDroppedCount() << " dropped.\n";
+
+    log.open( logName );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    delete midiout;
+    delete midiin;
+    return 1;
+  }
+
+  // Every message must come back in order, with times that never
+  // decrease.
+  std::vector<double> times;
+  double time;
+  const unsigned char *message;
+  size_t size;
+  for ( i=0; log.next( &time, &message, &size ); i++ ) {
+    if ( i >= nMessages || std::vector<unsigned char>( message, message + size ) != sent[i] ) {
+      std::cout << "message " << i << " did not come back unchanged!\n";
+      failures++;
+    }
+    if ( !times.empty() && time < times.back() ) {
+      std::cout << "message " << i << " goes back in time!\n";
+      failures++;
+    }
+    times.push_back( time );
+  }
+  if ( i != nMessages || log.getMessageCount() != nMessages ) {
+    std::cout << "the log holds " << i << " messages instead of " << nMessages << "!\n";
+    failures++;
+  }
+
+  // Seeking must find the first message at or after a given time.
+  for ( i=0; i<times.size(); i+=97 ) {
+    log.seek( times[i] );
+    unsigned int first = i;
+    while ( first > 0 && times[first-1] == times[i] ) first--;
+    if ( !log.next( &time, &message, &size ) || std::vector<unsigned char>( message, message + size ) != sent[first] ) {
+      std::cout << "seeking to " << times[i] << " seconds does not find message " << first << "!\n";
+      failures++;
+    }
+  }
+
+  try {
+    log.writeSmf( "midilog.mid" );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    failures++;
+  }
+  std::ifstream smf( "midilog.mid", std::ios::binary );
+  char magic[4] = { 0, 0, 0, 0 };
+  smf.read( magic, 4 );
+  if ( std::string( magic, 4 ) != "MThd" ) {
+    std::cout << "the Standard MIDI File was not written!\n";
+    failures++;
+  }
+
+  std::cout << log.getMessageCount() << " messages over " << log.getDuration() << " seconds read back, "
+            << failures << " failures.\n\n";
+
+  delete midiout;
+  delete midiin;
+
+  return failures == 0 ? 0 : 1;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc > 3 ) usage();
+  if ( argc == 1 ) return test();
+
+  std::string logName = argv[1];
+  std::string smfName = ( argc > 2 ) ? argv[2] : logName + ".mid";
+  if ( logName == "-h" || logName == "--help" ) usage();
+  return convert( logName, smfName );
+}
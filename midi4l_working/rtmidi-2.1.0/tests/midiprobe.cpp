@@ -17,7 +17,7 @@ int main()
   apiMap[RtMidi::WINDOWS_MM] = "Windows MultiMedia";
   apiMap[RtMidi::UNIX_JACK] = "Jack Client";
   apiMap[RtMidi::LINUX_ALSA] = "Linux ALSA";
-  apiMap[RtMidi::RTMIDI_DUMMY] = "RtMidi Dummy";
+  apiMap[RtMidi::RTMIDI_LOOPBACK] = "RtMidi Loopback";
 
   std::vector< RtMidi::Api > apis;
   RtMidi :: getCompiledApi( apis );
@@ -0,0 +1,184 @@
+//*****************************************//
+//  midireplay.cpp
+//
+//  Checks RtMidiPlayer.  A log of notes two
+//  milliseconds apart is written, then
+//  replayed through a loopback cable in
+//  real time, at four times the speed and
+//  as fast as possible, and once more after
+//  conversion to a Standard MIDI File.  All
+//  messages must arrive in order and the
+//  player must not drift: the replay must
+//  still be on time at the end and its
+//  lateness must not grow over the run.  A single
+//  late wakeup is scheduler jitter and is
+//  only reported, unless MIDIREPLAY_STRICT
+//  is set in the environment.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "RtMidi.h"
+
+static const unsigned int nMessages = 500;
+static const double interval = 0.002;
+static std::vector< std::vector<unsigned char> > arrived;
+static std::vector<double> arrivalTimes;
+static std::atomic<unsigned int> nArrived( 0 );
+
+static double now( void )
+{
+  return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void mycallback( double /*deltatime*/, const unsigned char *message, size_t size,
+                 unsigned int /*portTag*/, void * /*userData*/ )
+{
+  arrivalTimes.push_back( now() );
+  arrived.push_back( std::vector<unsigned char>( message, message + size ) );
+  nArrived.store( arrived.size(), std::memory_order_release );
+}
+
+static std::vector<unsigned char> note( unsigned int i )
+{
+  std::vector<unsigned char> message( 3 );
+  message[0] = 0x90 | ( i & 0x0F );
+  message[1] = i & 0x7F;
+  message[2] = 1 + i % 127;
+  return message;
+}
+
+// Median of the timing errors from first to last.
+static double median( std::vector<double>::const_iterator first, std::vector<double>::const_iterator last )
+{
+  std::vector<double> sorted( first, last );
+  std::sort( sorted.begin(), sorted.end() );
+  return sorted[ sorted.size() / 2 ];
+}
+
+// Replay the open file and check what arrives.  A tolerance of zero
+// skips the timing checks.  Returns the number of failures.
+static unsigned int replay( RtMidiPlayer &player, const char *name, RtMidiPlayer::Mode mode,
+                            double speed, double tolerance )
+{
+  unsigned int i, failures = 0;
+  double maxError = 0.0;
+  std::vector<double> errors;
+
+  arrived.clear();
+  arrivalTimes.clear();
+  nArrived.store( 0 );
+  double start = now();
+  player.start( mode, speed );
+  while ( player.isPlaying() ) std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+  for ( i=0; i<100 && nArrived.load( std::memory_order_acquire ) < nMessages; i++ )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+  double elapsed = now() - start;
+
+  for ( i=0; i<nMessages; i++ ) {
+    if ( i >= arrived.size() || arrived[i] != note( i ) ) {
+      std::cout << "  message " << i << " did not arrive unchanged!\n";
+      failures++;
+      break;
+    }
+    double error = arrivalTimes[i] - start - i * interval / speed;
+    errors.push_back( error );
+    if ( std::fabs( error ) > maxError ) maxError = std::fabs( error );
+  }
+
+  if ( tolerance > 0.0 && errors.size() == nMessages ) {
+    // Medians over the first and last quarters of the run leave out
+    // single late wakeups.  By the end the replay must still be on
+    // time, and typically no later than at the start.
+    unsigned int quarter = nMessages / 4;
+    double startError = median( errors.begin(), errors.begin() + quarter );
+    double endError = median( errors.end() - quarter, errors.end() );
+    if ( std::fabs( endError ) > tolerance ) {
+      std::cout << "  the replay ended " << endError * 1000.0 << " ms off its due times!\n";
+      failures++;
+    }
+    if ( endError - startError > tolerance / 2 ) {
+      std::cout << "  lateness grew by " << ( endError - startError ) * 1000.0 << " ms over the replay!\n";
+      failures++;
+    }
+
+    if ( getenv( "MIDIREPLAY_STRICT" ) && maxError > tolerance ) {
+      std::cout << "  messages arrived up to " << maxError * 1000.0 << " ms from their due times!\n";
+      failures++;
+    }
+  }
+
+  std::cout << "  " << name << ": " << arrived.size() << " of " << nMessages << " messages in "
+            << elapsed << " seconds";
+  if ( tolerance > 0.0 )
+    std::cout << ", largest timing error " << maxError * 1000.0 << " ms, sent up to "
+              << player.getMaxLateness() * 1000.0 << " ms late";
+  std::cout << "\n";
+  return failures;
+}
+
+int main( void )
+{
+  RtMidiIn *midiin = 0;
+  RtMidiOut *midiout = 0;
+  RtMidiRecorder recorder;
+  RtMidiPlayer player;
+  unsigned int i, nPorts, failures = 0;
+
+  try {
+    // Record the notes with made-up times.
+    recorder.open( "midireplay.log" );
+    for ( i=0; i<nMessages; i++ ) {
+      std::vector<unsigned char> message = note( i );
+      recorder.record( interval, &message[0], message.size() );
+    }
+    recorder.close();
+    RtMidiLog log;
+    log.open( "midireplay.log" );
+    log.writeSmf( "midireplay.mid" );
+
+    midiin = new RtMidiIn( RtMidi::RTMIDI_LOOPBACK, "midireplay" );
+    midiin->openVirtualPort( "midireplay" );
+    midiin->setCallback( &mycallback );
+
+    midiout = new RtMidiOut( RtMidi::RTMIDI_LOOPBACK, "midireplay" );
+    nPorts = midiout->getPortCount();
+    for ( i=0; i<nPorts; i++ ) {
+      if ( midiout->getPortName( i ).find( "midireplay" ) != std::string::npos ) break;
+    }
+    if ( i == nPorts ) {
+      std::cout << "\nmidireplay: unable to find the virtual input port!\n\n";
+      goto cleanup;
+    }
+    midiout->openPort( i );
+
+    std::cout << "\nReplaying " << nMessages << " notes " << interval * 1000.0 << " ms apart:\n";
+    player.setOutput( midiout );
+    player.open( "midireplay.log" );
+    failures += replay( player, "real time", RtMidiPlayer::REAL_TIME, 1.0, 0.01 );
+    failures += replay( player, "four times the speed", RtMidiPlayer::SCALED, 4.0, 0.01 );
+    failures += replay( player, "as fast as possible", RtMidiPlayer::AS_FAST_AS_POSSIBLE, 1.0, 0.0 );
+    player.open( "midireplay.mid" );
+    failures += replay( player, "Standard MIDI File", RtMidiPlayer::REAL_TIME, 1.0, 0.01 );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    failures++;
+  }
+
+  std::cout << ( failures == 0 ? "\nAll replays passed.\n\n" : "\nSome replays failed!\n\n" );
+
+ cleanup:
+  player.stop();
+  delete midiout;
+  delete midiin;
+
+  return failures == 0 ? 0 : 1;
+}
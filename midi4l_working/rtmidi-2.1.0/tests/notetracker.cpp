@@ -0,0 +1,130 @@
+//*****************************************//
+//  notetracker.cpp
+//
+//  Checks RtMidiNoteTracker.  Notes are
+//  turned on and off in several ways, and
+//  release() must give exactly one note off
+//  for each note left on, which are then
+//  sent through a loopback cable in one
+//  sendMessages() call.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "RtMidi.h"
+
+static std::vector< std::vector<unsigned char> > arrived;
+static std::atomic<unsigned int> nArrived( 0 );
+
+void mycallback( double /*deltatime*/, const unsigned char *message, size_t size,
+                 unsigned int /*portTag*/, void * /*userData*/ )
+{
+  arrived.push_back( std::vector<unsigned char>( message, message + size ) );
+  nArrived.store( arrived.size(), std::memory_order_release );
+}
+
+static void send( RtMidiNoteTracker &tracker, unsigned char b0, unsigned char b1, unsigned char b2 )
+{
+  unsigned char message[3] = { b0, b1, b2 };
+  tracker.track( message, 3 );
+}
+
+int main( void )
+{
+  RtMidiNoteTracker tracker, other;
+  std::vector<unsigned char> noteOffs;
+  unsigned int i, failures = 0;
+
+  send( tracker, 0x90, 60, 100 );
+  send( tracker, 0x90, 60, 100 );    // twice on is still one note
+  send( tracker, 0x90, 64, 100 );
+  send( tracker, 0x80, 64, 0 );      // off
+  send( tracker, 0x90, 67, 100 );
+  send( tracker, 0x90, 67, 0 );      // off by zero velocity
+  send( tracker, 0x9F, 127, 1 );
+  send( tracker, 0x93, 0, 1 );
+  send( tracker, 0x93, 1, 1 );
+  send( tracker, 0xB3, 123, 0 );     // all notes off on channel 3
+  send( tracker, 0x85, 10, 0 );      // off for a note never on
+  send( other, 0x95, 70, 90 );
+  send( other, 0x90, 60, 90 );       // already on in tracker
+  tracker.merge( other );
+
+  if ( tracker.getCount() != 3 ) {
+    std::cout << tracker.getCount() << " notes on instead of 3!\n";
+    failures++;
+  }
+
+  static const unsigned char expected[] = { 0x80, 60, 0, 0x85, 70, 0, 0x8F, 127, 0 };
+  if ( tracker.release( &noteOffs ) != 3 ||
+       noteOffs != std::vector<unsigned char>( expected, expected + sizeof( expected ) ) ) {
+    std::cout << "release() did not give the expected note offs!\n";
+    failures++;
+  }
+  if ( tracker.getCount() != 0 || tracker.release( &noteOffs ) != 0 ) {
+    std::cout << "notes are still on after release()!\n";
+    failures++;
+  }
+
+  // Every note on every channel, then a system reset.
+  for ( i=0; i<16*128; i++ ) send( tracker, 0x90 | ( i >> 7 ), i & 0x7F, 1 );
+  if ( tracker.getCount() != 16 * 128 ) {
+    std::cout << "not all notes are on!\n";
+    failures++;
+  }
+  unsigned char reset = 0xFF;
+  tracker.track( &reset, 1 );
+  if ( tracker.getCount() != 0 ) {
+    std::cout << "a system reset did not clear the notes!\n";
+    failures++;
+  }
+
+  // Send the note offs of a few notes through a loopback cable.
+  RtMidiIn *midiin = 0;
+  RtMidiOut *midiout = 0;
+  try {
+    midiin = new RtMidiIn( RtMidi::RTMIDI_LOOPBACK, "notetracker" );
+    midiin->openVirtualPort( "notetracker" );
+    midiin->setCallback( &mycallback );
+    midiout = new RtMidiOut( RtMidi::RTMIDI_LOOPBACK, "notetracker" );
+    unsigned int nPorts = midiout->getPortCount();
+    for ( i=0; i<nPorts; i++ ) {
+      if ( midiout->getPortName( i ).find( "notetracker" ) != std::string::npos ) break;
+    }
+    midiout->openPort( i );
+
+    for ( i=0; i<20; i++ ) send( tracker, 0x90 | ( i % 3 ), 30 + i, 100 );
+    noteOffs.clear();
+    unsigned int count = tracker.release( &noteOffs );
+    midiout->sendMessages( &noteOffs[0], noteOffs.size() );
+    for ( i=0; i<100 && nArrived.load( std::memory_order_acquire ) < count; i++ )
+      std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+    for ( i=0; i<count; i++ ) {
+      if ( i >= arrived.size() || arrived[i] != std::vector<unsigned char>( &noteOffs[3*i], &noteOffs[3*i] + 3 ) ) {
+        std::cout << "note off " << i << " did not arrive!\n";
+        failures++;
+        break;
+      }
+    }
+    if ( count != 20 || arrived.size() != 20 ) {
+      std::cout << arrived.size() << " of " << count << " note offs arrived, 20 expected!\n";
+      failures++;
+    }
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    failures++;
+  }
+
+  delete midiout;
+  delete midiin;
+
+  std::cout << "\nNote tracker checks " << ( failures == 0 ? "passed" : "failed" ) << ".\n\n";
+  return failures == 0 ? 0 : 1;
+}
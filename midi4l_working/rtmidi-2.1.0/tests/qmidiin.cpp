@@ -9,6 +9,7 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <vector>
 #include <signal.h>
 #include "RtMidi.h"
 
@@ -35,9 +36,9 @@ void usage( void ) {
 int main( int argc, char *argv[] )
 {
   RtMidiIn *midiin = 0;
-  std::vector<unsigned char> message;
-  int nBytes, i;
-  double stamp;
+  std::vector<unsigned char> buffer( 1024 );
+  RtMidiIn::MessageRecord records[64];
+  unsigned int nMessages, i, j;
 
   // Minimal command-line check.
   if ( argc > 2 ) usage();
@@ -76,15 +77,23 @@ int main( int argc, char *argv[] )
   done = false;
   (void) signal(SIGINT, finish);
 
-  // Periodically check input queue.
+  // Periodically drain the input queue.
   std::cout << "Reading MIDI from port ... quit with Ctrl-C.\n";
   while ( !done ) {
-    stamp = midiin->getMessage( &message );
-    nBytes = message.size();
-    for ( i=0; i<nBytes; i++ )
-      std::cout << "Byte " << i << " = " << (int)message[i] << ", ";
-    if ( nBytes > 0 )
-      std::cout << "stamp = " << stamp << std::endl;
+    nMessages = midiin->getMessages( &buffer[0], buffer.size(), records, 64 );
+
+    // Make room for a message larger than the buffer, such as a long
+    // sysex dump, or it would block the queue.
+    if ( nMessages == 0 ) {
+      size_t nextSize = midiin->getNextMessageSize();
+      if ( nextSize > buffer.size() ) buffer.resize( nextSize );
+    }
+
+    for ( j=0; j<nMessages; j++ ) {
+      for ( i=0; i<records[j].size; i++ )
+        std::cout << "Byte " << i << " = " << (int)buffer[records[j].offset + i] << ", ";
+      std::cout << "stamp = " << records[j].timeStamp << std::endl;
+    }
 
     // Sleep for 10 milliseconds.
     SLEEP( 10 );
@@ -0,0 +1,101 @@
+//*****************************************//
+//  queuefilter.cpp
+//
+//  Checks the queue filter of RtMidiIn.
+//  The filter runs on the input thread as
+//  messages arrive, while the queue is
+//  read later: it must see every message,
+//  and its changes and drops must show in
+//  what getMessage() returns.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "RtMidi.h"
+
+static std::atomic<unsigned int> nFiltered( 0 );
+static std::thread::id filterThread;
+
+// Transpose notes up an octave and keep control changes out of the queue.
+bool myfilter( double /*timeStamp*/, unsigned char *message, size_t size, void * /*userData*/ )
+{
+  filterThread = std::this_thread::get_id();
+  nFiltered.fetch_add( 1 );
+  if ( ( message[0] & 0xF0 ) == 0xB0 ) return false;
+  if ( ( message[0] & 0xF0 ) == 0x90 && size == 3 ) message[1] += 12;
+  return true;
+}
+
+int main( void )
+{
+  RtMidiIn *midiin = 0;
+  RtMidiOut *midiout = 0;
+  unsigned int i, failures = 0;
+
+  try {
+    midiin = new RtMidiIn( RtMidi::RTMIDI_LOOPBACK, "queuefilter" );
+    midiin->setQueueFilter( &myfilter );
+    midiin->ignoreTypes( false );
+    midiin->openVirtualPort( "queuefilter" );
+    midiout = new RtMidiOut( RtMidi::RTMIDI_LOOPBACK, "queuefilter" );
+    unsigned int nPorts = midiout->getPortCount();
+    for ( i=0; i<nPorts; i++ ) {
+      if ( midiout->getPortName( i ).find( "queuefilter" ) != std::string::npos ) break;
+    }
+    midiout->openPort( i );
+
+    // Notes and control changes in turn, then a sysex message.
+    for ( i=0; i<20; i++ ) {
+      unsigned char message[3] = { (unsigned char) ( i % 2 ? 0xB0 : 0x90 ), (unsigned char) i, 100 };
+      midiout->sendMessage( message, 3 );
+    }
+    const unsigned char sysex[] = { 0xF0, 0x7D, 1, 2, 3, 0xF7 };
+    midiout->sendMessage( sysex, sizeof( sysex ) );
+    for ( i=0; i<100 && nFiltered.load() < 21; i++ )
+      std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+    if ( nFiltered.load() != 21 ) {
+      std::cout << "the filter saw " << nFiltered.load() << " messages instead of 21!\n";
+      failures++;
+    }
+    if ( filterThread == std::this_thread::get_id() ) {
+      std::cout << "the filter ran on the reading thread!\n";
+      failures++;
+    }
+
+    std::vector<unsigned char> message;
+    for ( i=0; i<10; i++ ) {
+      midiin->getMessage( &message );
+      if ( message.size() != 3 || message[0] != 0x90 || message[1] != 2 * i + 12 ) {
+        std::cout << "queued note " << i << " is wrong!\n";
+        failures++;
+        break;
+      }
+    }
+    midiin->getMessage( &message );
+    if ( message != std::vector<unsigned char>( sysex, sysex + sizeof( sysex ) ) ) {
+      std::cout << "the sysex message was not queued whole!\n";
+      failures++;
+    }
+    midiin->getMessage( &message );
+    if ( !message.empty() ) {
+      std::cout << "the queue holds messages the filter dropped!\n";
+      failures++;
+    }
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    failures++;
+  }
+
+  delete midiout;
+  delete midiin;
+
+  std::cout << "\nQueue filter checks " << ( failures == 0 ? "passed" : "failed" ) << ".\n\n";
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+//*****************************************//
+//  transform.cpp
+//
+//  Checks RtMidiTransform.  Messages are
+//  run through channel, split, transpose,
+//  velocity and controller mappings and
+//  compared with the expected results, and
+//  a mapping is committed over and over
+//  while another thread applies it.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include "RtMidi.h"
+
+static unsigned int failures = 0;
+
+// Apply the transform to a copy of in and compare it with out, where
+// an empty out means the message must be dropped.
+static void check( const RtMidiTransform &transform, const char *what,
+                   std::vector<unsigned char> in, const std::vector<unsigned char> &out )
+{
+  bool kept = transform.apply( &in[0], in.size() );
+  if ( kept != !out.empty() || ( kept && in != out ) ) {
+    std::cout << what << ": wrong result!\n";
+    failures++;
+  }
+}
+
+static std::vector<unsigned char> bytes( unsigned char b0, unsigned char b1, int b2 = -1 )
+{
+  std::vector<unsigned char> message( 1, b0 );
+  message.push_back( b1 );
+  if ( b2 >= 0 ) message.push_back( (unsigned char) b2 );
+  return message;
+}
+
+static const std::vector<unsigned char> dropped;
+
+static std::atomic<bool> running( true );
+static std::atomic<unsigned int> torn( 0 );
+
+// The main thread commits two mappings that send note 60 to different
+// channels and notes, so every result must come whole from one of them.
+static void applier( const RtMidiTransform *transform )
+{
+  while ( running.load() ) {
+    unsigned char message[3] = { 0x90, 60, 100 };
+    if ( !transform->apply( message, 3 ) ||
+         !( ( message[0] == 0x91 && message[1] == 72 ) || ( message[0] == 0x92 && message[1] == 48 ) ) )
+      torn.fetch_add( 1 );
+  }
+}
+
+int main( void )
+{
+  RtMidiTransform transform;
+
+  check( transform, "identity", bytes( 0x93, 60, 100 ), bytes( 0x93, 60, 100 ) );
+  check( transform, "system message", bytes( 0xF2, 1, 2 ), bytes( 0xF2, 1, 2 ) );
+
+  transform.setChannel( 0, 4 );
+  transform.setChannel( 1, -1 );
+  transform.setSplit( 2, 0, 59, 5, -12 );
+  transform.setSplit( 2, 60, 127, 6, 12 );
+  transform.setTranspose( 3, 7 );
+  transform.setNote( 7, 36, 9, 38 );
+  transform.setVelocityCurve( 2.0, 20, 120 );
+  transform.setControl( 1, 74 );
+  transform.setControl( 2, -1 );
+
+  // Nothing changes until the mapping is committed.
+  check( transform, "uncommitted", bytes( 0x90, 60, 100 ), bytes( 0x90, 60, 100 ) );
+  transform.commit();
+
+  check( transform, "channel note on", bytes( 0x90, 60, 0 ), bytes( 0x94, 60, 0 ) );
+  check( transform, "channel program change", bytes( 0xC0, 5 ), bytes( 0xC4, 5 ) );
+  check( transform, "dropped channel", bytes( 0x91, 60, 100 ), dropped );
+  check( transform, "dropped channel pitch bend", bytes( 0xE1, 0, 64 ), dropped );
+  check( transform, "lower split", bytes( 0x82, 59, 64 ), bytes( 0x85, 47, 64 ) );
+  check( transform, "upper split", bytes( 0x82, 60, 64 ), bytes( 0x86, 72, 64 ) );
+  check( transform, "split out of range", bytes( 0x82, 120, 64 ), dropped );
+  check( transform, "key pressure split", bytes( 0xA2, 10, 3 ), dropped );
+  check( transform, "transpose", bytes( 0xA3, 10, 3 ), bytes( 0xA3, 17, 3 ) );
+  check( transform, "single note", bytes( 0x87, 36, 0 ), bytes( 0x89, 38, 0 ) );
+  check( transform, "lowest velocity", bytes( 0x95, 60, 1 ), bytes( 0x95, 60, 20 ) );
+  check( transform, "highest velocity", bytes( 0x95, 60, 127 ), bytes( 0x95, 60, 120 ) );
+  check( transform, "note off velocity", bytes( 0x85, 60, 127 ), bytes( 0x85, 60, 127 ) );
+  check( transform, "controller", bytes( 0xB5, 1, 9 ), bytes( 0xB5, 74, 9 ) );
+  check( transform, "controller on mapped channel", bytes( 0xB0, 1, 9 ), bytes( 0xB4, 74, 9 ) );
+  check( transform, "dropped controller", bytes( 0xB5, 2, 9 ), dropped );
+
+  // The curve must never map a note on to velocity zero or go down.
+  unsigned char last = 0;
+  for ( unsigned int velocity=1; velocity<128; velocity++ ) {
+    unsigned char message[3] = { 0x90, 60, (unsigned char) velocity };
+    transform.apply( message, 3 );
+    if ( message[2] == 0 || message[2] < last ) {
+      std::cout << "velocity " << velocity << " maps to " << (int) message[2] << "!\n";
+      failures++;
+      break;
+    }
+    last = message[2];
+  }
+
+  try {
+    transform.setChannel( 16, 0 );
+    std::cout << "channel 16 was accepted!\n";
+    failures++;
+  }
+  catch ( RtMidiError & ) {
+  }
+
+  // Commit two mappings in turn while another thread applies them.
+  transform.reset();
+  transform.setSplit( 0, 0, 127, 2, -12 );
+  transform.commit();
+  std::thread thread( applier, &transform );
+  for ( unsigned int i=0; i<20000; i++ ) {
+    transform.reset();
+    if ( i % 2 ) transform.setSplit( 0, 0, 127, 1, 12 );
+    else transform.setSplit( 0, 0, 127, 2, -12 );
+    transform.commit();
+  }
+  running.store( false );
+  thread.join();
+  if ( torn.load() > 0 ) {
+    std::cout << torn.load() << " messages were transformed by a mapping being changed!\n";
+    failures++;
+  }
+
+  std::cout << "\nTransform checks " << ( failures == 0 ? "passed" : "failed" ) << ".\n\n";
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+//*****************************************//
+//  umptest.cpp
+//
+//  Checks the Universal MIDI Packet
+//  translation.  Value scaling must round
+//  trip for every 7 and 14-bit value, and
+//  messages sent through a loopback cable,
+//  received as MIDI 2.0 packets and sent on
+//  with sendUmp() must arrive unchanged.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "RtMidi.h"
+
+static RtMidiOut *forward = 0;
+static std::vector< std::vector<unsigned char> > arrived;
+static std::atomic<unsigned int> nArrived( 0 );
+
+// First hop: hand the packets on to the second output.
+void umpCallback( double /*timeStamp*/, const uint32_t *words, unsigned int count,
+                  unsigned int /*portTag*/, void * /*userData*/ )
+{
+  forward->sendUmp( words, count );
+}
+
+void byteCallback( double /*timeStamp*/, const unsigned char *message, size_t size,
+                   unsigned int /*portTag*/, void * /*userData*/ )
+{
+  arrived.push_back( std::vector<unsigned char>( message, message + size ) );
+  nArrived.store( arrived.size(), std::memory_order_release );
+}
+
+static bool checkScaling( void )
+{
+  for ( uint32_t v=0; v<(1u<<7); v++ ) {
+    if ( RtMidiUmp::scaleDown( RtMidiUmp::scaleUp( v, 7, 16 ), 16, 7 ) != v ||
+         RtMidiUmp::scaleDown( RtMidiUmp::scaleUp( v, 7, 32 ), 32, 7 ) != v ) {
+      std::cout << "7-bit value " << v << " does not round trip!\n";
+      return false;
+    }
+  }
+  for ( uint32_t v=0; v<(1u<<14); v++ ) {
+    if ( RtMidiUmp::scaleDown( RtMidiUmp::scaleUp( v, 14, 32 ), 32, 14 ) != v ) {
+      std::cout << "14-bit value " << v << " does not round trip!\n";
+      return false;
+    }
+  }
+  if ( RtMidiUmp::scaleUp( 127, 7, 32 ) != 0xFFFFFFFF || RtMidiUmp::scaleUp( 64, 7, 32 ) != 0x80000000 ) {
+    std::cout << "scaling does not map the maximum and center values!\n";
+    return false;
+  }
+  return true;
+}
+
+static RtMidiOut *openOutput( const std::string &portName )
+{
+  RtMidiOut *midiout = new RtMidiOut( RtMidi::RTMIDI_LOOPBACK, "umptest" );
+  unsigned int i, nPorts = midiout->getPortCount();
+  for ( i=0; i<nPorts; i++ ) {
+    if ( midiout->getPortName( i ).find( portName ) != std::string::npos ) break;
+  }
+  if ( i < nPorts ) midiout->openPort( i );
+  return midiout;
+}
+
+int main( void )
+{
+  RtMidiIn *first = 0, *second = 0;
+  RtMidiOut *midiout = 0;
+  std::vector< std::vector<unsigned char> > sent;
+  unsigned int i, failures = 0;
+
+  if ( !checkScaling() ) return 1;
+  std::cout << "\nValue scaling round trips.\n";
+
+  // Channel and system messages, and sysex of several packet counts.
+  static const unsigned char messages[][3] = {
+    { 0x90, 60, 100 }, { 0x80, 60, 0 }, { 0x91, 61, 127 }, { 0x91, 61, 0 }, { 0xA2, 62, 1 },
+    { 0xB3, 7, 64 }, { 0xC4, 5, 0 }, { 0xD5, 126, 0 }, { 0xE6, 0x00, 0x40 },
+    { 0xEF, 0x7F, 0x7F }, { 0xE0, 0x01, 0x00 }, { 0xF2, 0x10, 0x20 }, { 0xF8, 0, 0 }
+  };
+  for ( i=0; i<sizeof(messages)/sizeof(messages[0]); i++ ) {
+    unsigned int size = messages[i][0] >= 0xF8 ? 1 : ( messages[i][0] & 0xF0 ) == 0xC0 || ( messages[i][0] & 0xF0 ) == 0xD0 ? 2 : 3;
+    sent.push_back( std::vector<unsigned char>( messages[i], messages[i] + size ) );
+  }
+  for ( unsigned int size=2; size<=40; size+=7 ) {
+    std::vector<unsigned char> sysex( size );
+    for ( unsigned int j=0; j<size; j++ ) sysex[j] = j & 0x7F;
+    sysex.front() = 0xF0;
+    sysex.back() = 0xF7;
+    sent.push_back( sysex );
+  }
+
+  try {
+    first = new RtMidiIn( RtMidi::RTMIDI_LOOPBACK, "umptest" );
+    first->openVirtualPort( "umptest first" );
+    first->ignoreTypes( false, false, false );
+    first->setCallback( &umpCallback, 0, 0, RtMidiUmp::MIDI2 );
+
+    second = new RtMidiIn( RtMidi::RTMIDI_LOOPBACK, "umptest" );
+    second->openVirtualPort( "umptest second" );
+    second->ignoreTypes( false, false, false );
+    second->setCallback( &byteCallback );
+
+    forward = openOutput( "umptest second" );
+    midiout = openOutput( "umptest first" );
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    goto cleanup;
+  }
+
+  for ( i=0; i<sent.size(); i++ )
+    midiout->sendMessage( &sent[i] );
+
+  for ( i=0; i<100 && nArrived.load( std::memory_order_acquire ) < sent.size(); i++ )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+  delete first;
+  first = 0;
+
+  for ( i=0; i<sent.size(); i++ ) {
+    std::vector<unsigned char> expected = sent[i];
+    // MIDI 2.0 has no note on with zero velocity.
+    if ( ( expected[0] & 0xF0 ) == 0x90 && expected[2] == 0 ) expected[0] = 0x80 | ( expected[0] & 0x0F );
+    if ( i >= arrived.size() || arrived[i] != expected ) {
+      std::cout << "message " << i << " (status 0x" << std::hex << (int) expected[0] << std::dec
+                << ", " << expected.size() << " bytes) did not arrive unchanged!\n";
+      failures++;
+    }
+  }
+  std::cout << sent.size() - failures << " of " << sent.size() << " messages passed through MIDI 2.0 packets unchanged.\n\n";
+
+ cleanup:
+  delete midiout;
+  delete forward;
+  delete second;
+  delete first;
+
+  return failures == 0 && arrived.size() == sent.size() ? 0 : 1;
+}